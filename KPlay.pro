@@ -1,31 +1,85 @@
-QT += core gui
-QT += multimedia
-QT += multimedia widgets
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++17
-
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-SOURCES += \
-    main.cpp \
-    mainwindow.cpp \
-    playlist.cpp \
-    track.cpp
-
-HEADERS += \
-    mainwindow.h \
-    playlist.h \
-    track.h \
-    utils.h
-
-FORMS += \
-    mainwindow.ui
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
+QT += core gui
+QT += multimedia
+QT += multimedia widgets
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++17
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+    coverart.cpp \
+    cuesheet.cpp \
+    duplicatefinder.cpp \
+    fingerprint.cpp \
+    fingerprintscanner.cpp \
+    folderscanner.cpp \
+    librarywatcher.cpp \
+    listeninglog.cpp \
+    main.cpp \
+    mainwindow.cpp \
+    metadatacache.cpp \
+    namedplaylists.cpp \
+    pathindex.cpp \
+    permutation.cpp \
+    playhistory.cpp \
+    playlist.cpp \
+    playlistfile.cpp \
+    playqueue.cpp \
+    query.cpp \
+    shuffleorder.cpp \
+    smartplaylists.cpp \
+    tagreader.cpp \
+    tagscanner.cpp \
+    tempo.cpp \
+    temposcanner.cpp \
+    textsearch.cpp \
+    track.cpp \
+    trackchecker.cpp \
+    trackcolumns.cpp \
+    tracklistmodel.cpp
+
+HEADERS += \
+    coverart.h \
+    cuesheet.h \
+    duplicatefinder.h \
+    fft.h \
+    fingerprint.h \
+    fingerprintscanner.h \
+    folderscanner.h \
+    librarywatcher.h \
+    listeninglog.h \
+    hash.h \
+    mainwindow.h \
+    metadatacache.h \
+    namedplaylists.h \
+    pathindex.h \
+    permutation.h \
+    playhistory.h \
+    playlist.h \
+    playlistfile.h \
+    playqueue.h \
+    query.h \
+    shuffleorder.h \
+    smartplaylists.h \
+    tagreader.h \
+    tagscanner.h \
+    tempo.h \
+    temposcanner.h \
+    textsearch.h \
+    track.h \
+    trackchecker.h \
+    trackcolumns.h \
+    tracklistmodel.h \
+    utils.h
+
+FORMS += \
+    mainwindow.ui
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "permutation.h"
+#include "shuffleorder.h"
+
+using namespace std;
+
+namespace {
+
+const int Repeats = 5;
+
+// Position lookups timed per size; jumps go to random tracks.
+const int Steps = 1000000;
+
+// What a stored order costs: the id list plus the id -> position map, at
+// about 40 bytes an entry for a 64-bit unordered_map.
+const double BytesPerStoredTrack = 4 + 40;
+
+template<typename Work>
+double bestOf(Work work)
+{
+    double best = 1e300;
+    for(int r = 0; r < Repeats; r++)
+    {
+        auto start = chrono::steady_clock::now();
+        work();
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// The order the vector shufflePlaylist() stored before shuffling went
+// lazy: every id, Fisher-Yates shuffled, and where each one ended up.
+struct VectorOrder
+{
+    vector<unsigned int> order;
+
+    unordered_map<unsigned int, int> positions;
+
+    void shuffle(const vector<unsigned int> &ids, uint64_t seed)
+    {
+        std::mt19937_64 random(seed);
+        order = ids;
+        for(size_t i = order.size(); i > 1; i--)
+        {
+            size_t j = std::uniform_int_distribution<size_t>(0, i - 1)(random);
+            std::swap(order[i - 1], order[j]);
+        }
+        positions.clear();
+        positions.reserve(order.size());
+        for(size_t p = 0; p < order.size(); p++)
+            positions[order[p]] = int(p);
+    }
+};
+
+void report(const char *name, double setup, double next, double back, double jump, double bytes)
+{
+    printf("  %-14s %12.3f %10.1f %10.1f %10.1f %12.2f\n", name, setup / 1e6, next, back, jump, bytes / 1e6);
+}
+
+void bench(int n)
+{
+    vector<unsigned int> ids(n);
+    for(int i = 0; i < n; i++)
+        ids[i] = unsigned(i) * 3 + 1;
+
+    std::mt19937_64 random(7);
+    vector<int> jumps(Steps);
+    for(int &j : jumps)
+        j = int(std::uniform_int_distribution<int>(0, n - 1)(random));
+
+    // Walks wrap around, so small playlists are timed over the same number
+    // of steps as big ones. sink keeps the loops from being optimized away.
+    uint64_t sink = 0;
+    printf("%d tracks\n", n);
+    printf("  %-14s %12s %10s %10s %10s %12s\n", "", "setup ms", "next ns", "back ns", "jump ns", "stored MB");
+
+    VectorOrder vectorOrder;
+    double setup = bestOf([&] { vectorOrder.shuffle(ids, 42); });
+    double next = bestOf([&] {
+        for(int s = 0; s < Steps; s++)
+            sink += vectorOrder.order[s % n];
+    });
+    double back = bestOf([&] {
+        for(int s = Steps; s > 0; s--)
+            sink += vectorOrder.order[s % n];
+    });
+    double jump = bestOf([&] {
+        for(int j : jumps)
+            sink += unsigned(vectorOrder.positions.find(ids[j])->second);
+    });
+    report("vector", setup, next / Steps, back / Steps, jump / Steps, n * BytesPerStoredTrack);
+
+    ShuffleOrder stored;
+    setup = bestOf([&] {
+        stored.shuffle(n, 42);
+        stored.materialize(ids);
+    });
+    next = bestOf([&] {
+        for(int s = 0; s < Steps; s++)
+            sink += stored.at(s % n);
+    });
+    back = bestOf([&] {
+        for(int s = Steps; s > 0; s--)
+            sink += stored.at(s % n);
+    });
+    jump = bestOf([&] {
+        for(int j : jumps)
+            sink += unsigned(stored.positionOf(ids[j]));
+    });
+    report("materialized", setup, next / Steps, back / Steps, jump / Steps, n * BytesPerStoredTrack);
+
+    ShuffleOrder lazy;
+    setup = bestOf([&] { lazy.shuffle(n, 42); });
+    next = bestOf([&] {
+        for(int s = 0; s < Steps; s++)
+            sink += unsigned(lazy.indexAt(s % n));
+    });
+    back = bestOf([&] {
+        for(int s = Steps; s > 0; s--)
+            sink += unsigned(lazy.indexAt(s % n));
+    });
+    jump = bestOf([&] {
+        for(int j : jumps)
+            sink += unsigned(lazy.positionOfIndex(j));
+    });
+    report("lazy", setup, next / Steps, back / Steps, jump / Steps, 0);
+
+    Permutation permutation;
+    setup = bestOf([&] { permutation = Permutation(uint64_t(n), 42); });
+    next = bestOf([&] {
+        for(int s = 0; s < Steps; s++)
+            sink += permutation.map(uint64_t(s % n));
+    });
+    back = bestOf([&] {
+        for(int s = Steps; s > 0; s--)
+            sink += permutation.map(uint64_t(s % n));
+    });
+    jump = bestOf([&] {
+        for(int j : jumps)
+            sink += permutation.unmap(uint64_t(j));
+    });
+    report("Permutation", setup, next / Steps, back / Steps, jump / Steps, 0);
+
+    printf("  (checksum %llu)\n\n", (unsigned long long)(sink & 0xffff));
+}
+
+}
+
+int main()
+{
+    printf("best of %d runs; next, back and jump are per step over %d steps\n\n", Repeats, Steps);
+    for(int n : { 1000, 100000, 1000000 })
+        bench(n);
+    return 0;
+}
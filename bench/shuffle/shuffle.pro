@@ -0,0 +1,18 @@
+# Times the lazy Permutation shuffle against a materialized ShuffleOrder
+# and the vector Fisher-Yates shuffle it replaced. Build in release mode.
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle qt
+
+TARGET = shufflebench
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../permutation.cpp \
+    ../../shuffleorder.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../permutation.h \
+    ../../shuffleorder.h
@@ -0,0 +1,119 @@
+// The kernels are private to textsearch.cpp, so it is compiled in here to
+// time each of them, not just the one picked for this CPU.
+#include "textsearch.cpp"
+#include <QString>
+#include <QStringList>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const int Titles = 1000000;
+
+const int Repeats = 5;
+
+// Made-up titles of two to six words, in the mix of cases tags come in.
+vector<string> makeTitles(int count)
+{
+    static const char *words[] = {
+        "love", "night", "the", "of", "heart", "Dance", "Remastered", "LIVE", "Version", "blue",
+        "Moon", "river", "fire", "a", "in", "Song", "my", "you", "Dream", "Rain", "City", "Road",
+        "home", "light", "Shadow", "(Demo)", "Part", "II", "Edit", "Radio", "mix", "Summer",
+        "Winter", "Time", "gold", "Stone", "wild", "Angel", "Kiss", "Paradise", "Ocean", "Storm"
+    };
+    const int wordCount = int(sizeof(words) / sizeof(words[0]));
+
+    std::mt19937_64 random(1);
+    std::uniform_int_distribution<int> length(2, 6), word(0, wordCount - 1), track(1, 20);
+    vector<string> titles;
+    titles.reserve(count);
+    for(int i = 0; i < count; i++)
+    {
+        string title = to_string(track(random)) + " - ";
+        int n = length(random);
+        for(int w = 0; w < n; w++)
+        {
+            if(w > 0)
+                title += ' ';
+            title += words[word(random)];
+        }
+        titles.push_back(title);
+    }
+    return titles;
+}
+
+template<typename Match>
+void run(const char *name, const vector<string> &needles, Match match)
+{
+    printf("%-8s", name);
+    for(const string &needle : needles)
+    {
+        double best = 1e300;
+        int found = 0;
+        for(int r = 0; r < Repeats; r++)
+        {
+            auto start = chrono::steady_clock::now();
+            found = match(needle);
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        printf("  %8.2f ms %7d", best, found);
+    }
+    printf("\n");
+}
+
+int countWith(const vector<string> &titles, const string &needle, Kernel kernel)
+{
+    int found = 0;
+    for(const string &title : titles)
+        found += kernel(title.data(), title.size(), needle.data(), needle.size()) ? 1 : 0;
+    return found;
+}
+
+}
+
+int main()
+{
+    vector<string> titles = makeTitles(Titles);
+    QStringList qtitles;
+    qtitles.reserve(Titles);
+    for(const string &title : titles)
+        qtitles.append(QString::fromStdString(title));
+
+    // Common, rare, missing, one letter and long needles, lower-cased as
+    // Query does.
+    vector<string> needles = { "love", "paradise", "zqx", "e", "remastered version" };
+
+    printf("%d titles, best of %d; each column is time and matches\n", Titles, Repeats);
+    printf("%-8s", "needle");
+    for(const string &needle : needles)
+        printf("  %-19s", ("\"" + needle + "\"").c_str());
+    printf("\n");
+
+    // What the search bar did before: lower both as QStrings and search
+    // the converted copies.
+    run("toLower", needles, [&](const string &needle) {
+        QString lowered = QString::fromStdString(needle).toLower();
+        int found = 0;
+        for(const QString &title : qtitles)
+            found += title.toLower().toStdString().find(lowered.toStdString()) != string::npos ? 1 : 0;
+        return found;
+    });
+
+    run("scalar", needles, [&](const string &needle) { return countWith(titles, needle, scalarContains); });
+#ifdef TEXTSEARCH_SSE2
+    run("sse2", needles, [&](const string &needle) { return countWith(titles, needle, sse2Contains); });
+#endif
+#ifdef TEXTSEARCH_X86
+    if(cpuHasAvx2())
+        run("avx2", needles, [&](const string &needle) { return countWith(titles, needle, avx2Contains); });
+#endif
+
+    printf("picked for this CPU: %s\n", textSearchKernel());
+    return 0;
+}
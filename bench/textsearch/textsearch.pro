@@ -0,0 +1,16 @@
+# Times the case-insensitive title search: the QString::toLower scan the
+# search bar used to do against each containsLowered() kernel. Build in
+# release mode and run from anywhere; it needs no data.
+
+QT -= gui
+QT += core
+
+CONFIG += c++17 console release
+CONFIG -= app_bundle
+
+TARGET = textsearchbench
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp
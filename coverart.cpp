@@ -0,0 +1,257 @@
+#include "coverart.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include "cuesheet.h"
+#include "hash.h"
+#include "tagreader.h"
+
+namespace {
+
+// Decoded thumbnails kept in memory.
+const size_t LruCapacity = 256;
+
+const char *const folderNames[] = {
+    "cover.jpg", "folder.jpg", "front.jpg", "Cover.jpg", "Folder.jpg", "AlbumArt.jpg",
+    "cover.png", "folder.png", "front.png",
+};
+
+}
+
+CoverArt::CoverArt(const QString &directory, QObject *parent)
+    : QObject(parent)
+    , directory(directory)
+{
+    QDir().mkpath(directory);
+    pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+    pool.setThreadPriority(QThread::LowPriority);
+    connect(this, SIGNAL(loaded()), this, SLOT(on_loaded()));
+}
+
+CoverArt::~CoverArt()
+{
+    cancelled = true;
+    pool.waitForDone();
+}
+
+QImage CoverArt::find(unsigned int id, const std::string &location)
+{
+    auto it = keys.find(id);
+    if(it != keys.end())
+    {
+        if(it->second == 0)
+            return QImage();
+
+        QImage image = cached(it->second);
+        if(!image.isNull())
+            return image;
+    }
+
+    // Unknown, or evicted from the LRU: the thumbnail is on disk by then,
+    // so a repeated lookup is cheap.
+    if(requested.insert(id).second)
+        lookup(id, location);
+
+    return QImage();
+}
+
+QImage CoverArt::cached(unsigned long long key)
+{
+    auto it = lruIndex.find(key);
+    if(it == lruIndex.end())
+        return QImage();
+
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->second;
+}
+
+void CoverArt::remember(unsigned long long key, const QImage &image)
+{
+    auto it = lruIndex.find(key);
+    if(it != lruIndex.end())
+    {
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+
+    lru.emplace_front(key, image);
+    lruIndex[key] = lru.begin();
+    if(lru.size() > LruCapacity)
+    {
+        lruIndex.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+unsigned long long CoverArt::folderArt(const QString &folder, QByteArray &bytes)
+{
+    std::string name = folder.toStdString();
+    QString image;
+    bool known = false;
+    {
+        QMutexLocker locker(&mutex);
+        auto it = folders.find(name);
+        if(it != folders.end())
+        {
+            image = it->second;
+            known = true;
+        }
+    }
+
+    if(!known)
+    {
+        for(const char *candidate : folderNames)
+        {
+            if(QFile::exists(folder + "/" + candidate))
+            {
+                image = folder + "/" + candidate;
+                break;
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        folders[name] = image;
+    }
+
+    if(image.isEmpty())
+        return 0;
+
+    QFile file(image);
+    if(!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    bytes = file.readAll();
+    return Hash64::of(bytes.constData(), size_t(bytes.size()));
+}
+
+QString CoverArt::thumbnailPath(unsigned long long key) const
+{
+    return directory + "/" + QString::number(key, 16) + ".png";
+}
+
+void CoverArt::lookup(unsigned int id, const std::string &location)
+{
+    pool.start([this, id, location]() {
+        if(cancelled)
+            return;
+
+        Result result;
+        result.id = id;
+        result.key = 0;
+        result.shared = false;
+
+        // A track of a cue sheet has the art of the image it is cut from.
+        QString path = QString::fromStdString(CueSheet::fileOf(location));
+        QFile file(path);
+        uchar *map = nullptr;
+        const unsigned char *art = nullptr;
+        size_t artSize = 0;
+        std::string scratch;
+        QByteArray bytes;
+
+        if(file.open(QIODevice::ReadOnly) && file.size() > 0)
+            map = file.map(0, file.size());
+        if(map && findCoverArt(map, size_t(file.size()), art, artSize, scratch))
+            result.key = Hash64::of(art, artSize);
+        else
+        {
+            result.key = folderArt(QFileInfo(path).absolutePath(), bytes);
+            art = reinterpret_cast<const unsigned char *>(bytes.constData());
+            artSize = size_t(bytes.size());
+        }
+
+        if(result.key != 0)
+            result.image = thumbnail(result.key, art, artSize, result.shared);
+
+        if(map)
+            file.unmap(map);
+
+        bool wasEmpty;
+        mutex.lock();
+        if(result.shared && decoding.count(result.key) == 0)
+        {
+            // The decoding task finished meanwhile; its thumbnail is on disk.
+            mutex.unlock();
+            result.image.load(thumbnailPath(result.key));
+            result.shared = false;
+            mutex.lock();
+        }
+        wasEmpty = results.empty();
+        results.push_back(result);
+        mutex.unlock();
+        if(wasEmpty)
+            emit loaded();
+    });
+}
+
+QImage CoverArt::thumbnail(unsigned long long key, const unsigned char *art, size_t artSize, bool &shared)
+{
+    QImage image;
+    QString path = thumbnailPath(key);
+    if(image.load(path))
+        return image;
+
+    // Only one task decodes a given image at a time. The others report back
+    // as shared and are settled when the decoding task's result arrives.
+    {
+        QMutexLocker locker(&mutex);
+        shared = !decoding.insert(key).second;
+    }
+    if(shared)
+        return image;
+
+    QImage full = QImage::fromData(art, int(artSize));
+    if(!full.isNull())
+    {
+        image = full.scaled(ThumbnailSize, ThumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        if(image.save(path + ".tmp", "PNG"))
+            QFile::rename(path + ".tmp", path);
+    }
+
+    QMutexLocker locker(&mutex);
+    decoding.erase(key);
+    return image;
+}
+
+void CoverArt::on_loaded()
+{
+    std::vector<Result> taken;
+    {
+        QMutexLocker locker(&mutex);
+        taken.swap(results);
+    }
+
+    for(const Result &result : taken)
+    {
+        // Tracks whose image another task is decoding wait for that task
+        // instead of asking again on every repaint.
+        if(result.shared)
+        {
+            keys[result.id] = result.key;
+            waiting[result.key].push_back(result.id);
+            continue;
+        }
+
+        // Art that could not be decoded counts as no art.
+        unsigned long long key = result.image.isNull() ? 0 : result.key;
+        keys[result.id] = key;
+        requested.erase(result.id);
+        if(key != 0)
+            remember(key, result.image);
+
+        auto it = waiting.find(result.key);
+        if(it != waiting.end())
+        {
+            for(unsigned int id : it->second)
+            {
+                keys[id] = key;
+                requested.erase(id);
+            }
+            waiting.erase(it);
+        }
+    }
+
+    emit artReady();
+}
@@ -0,0 +1,95 @@
+#ifndef COVERART_H
+#define COVERART_H
+
+#include <QObject>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Album art thumbnails. Art comes from the file's own tags or, failing
+// that, a folder.jpg/cover.jpg next to it. It is decoded and downscaled on
+// background threads and stored on disk under the XXH64 of the encoded
+// image, so the art shared by every track of an album is decoded once and
+// kept once. Decoded thumbnails are held in a small LRU.
+class CoverArt : public QObject
+{
+    Q_OBJECT
+
+public:
+    CoverArt(const QString &directory, QObject *parent = nullptr);
+
+    ~CoverArt();
+
+    // The thumbnail of a track if it is in memory. Otherwise returns a null
+    // image and looks the art up in the background; artReady() follows.
+    QImage find(unsigned int id, const std::string &location);
+
+    static const int ThumbnailSize = 96;
+
+signals:
+    void artReady();
+
+    void loaded();
+
+private slots:
+    void on_loaded();
+
+private:
+    struct Result
+    {
+        unsigned int id;
+
+        unsigned long long key; // 0 when the track has no art
+
+        bool shared; // another task is decoding the same image
+
+        QImage image;
+    };
+
+    void lookup(unsigned int id, const std::string &location);
+
+    unsigned long long folderArt(const QString &folder, QByteArray &bytes);
+
+    QImage thumbnail(unsigned long long key, const unsigned char *art, size_t artSize, bool &shared);
+
+    QString thumbnailPath(unsigned long long key) const;
+
+    QImage cached(unsigned long long key);
+
+    void remember(unsigned long long key, const QImage &image);
+
+    QString directory;
+
+    QThreadPool pool;
+
+    std::atomic<bool> cancelled{false};
+
+    // Shared with the pool.
+    QMutex mutex;
+
+    std::vector<Result> results;
+
+    std::unordered_set<unsigned long long> decoding;
+
+    std::unordered_map<std::string, QString> folders; // image file per folder, if any
+
+    // GUI thread only.
+    std::unordered_map<unsigned int, unsigned long long> keys;
+
+    std::unordered_set<unsigned int> requested;
+
+    std::unordered_map<unsigned long long, std::vector<unsigned int>> waiting;
+
+    std::list<std::pair<unsigned long long, QImage>> lru;
+
+    std::unordered_map<unsigned long long, std::list<std::pair<unsigned long long, QImage>>::iterator> lruIndex;
+};
+
+#endif // COVERART_H
@@ -0,0 +1,296 @@
+#include "cuesheet.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_set>
+#include "utils.h"
+
+namespace {
+
+// What an image named in a sheet may have been encoded to since.
+const char *const imageSuffixes[] = { "flac", "ape", "wv", "wav", "tta", "m4a", "ogg", "opus", "mp3" };
+
+// INDEX times count CD frames, 75 to the second.
+const int FramesPerSecond = 75;
+
+string lowered(string text)
+{
+    for(char &c : text)
+        c = toLowerAscii(c);
+    return text;
+}
+
+// The quoted string or the word at pos, moving pos past it.
+string nextValue(const string &line, size_t &pos)
+{
+    while(pos < line.size() && (line[pos] == ' ' || line[pos] == '\t'))
+        pos++;
+    if(pos >= line.size())
+        return string();
+
+    size_t end;
+    string value;
+    if(line[pos] == '"')
+    {
+        end = line.find('"', pos + 1);
+        if(end == string::npos)
+            end = line.size();
+        value = line.substr(pos + 1, end - pos - 1);
+        end++;
+    }
+    else
+    {
+        end = line.find_first_of(" \t", pos);
+        if(end == string::npos)
+            end = line.size();
+        value = line.substr(pos, end - pos);
+    }
+    pos = end;
+    return value;
+}
+
+// mm:ss:ff in ms, or -1.
+long long timeOf(const string &text)
+{
+    int minutes, seconds, frames;
+    if(sscanf(text.c_str(), "%d:%d:%d", &minutes, &seconds, &frames) != 3)
+        return -1;
+    return (minutes * 60LL + seconds) * 1000 + frames * 1000LL / FramesPerSecond;
+}
+
+// Rippers write the sheet before the image is encoded, so the "disc.wav"
+// it names may well be disc.flac by now.
+string findFile(const QDir &directory, const string &name)
+{
+    QString path = QDir::cleanPath(directory.absoluteFilePath(QString::fromStdString(name).replace('\\', '/')));
+    if(QFileInfo::exists(path))
+        return path.toStdString();
+
+    QFileInfo info(path);
+    QString stem = info.absolutePath() + "/" + info.completeBaseName() + ".";
+    for(const char *suffix : imageSuffixes)
+    {
+        if(QFileInfo::exists(stem + suffix))
+            return (stem + suffix).toStdString();
+    }
+    return path.toStdString();
+}
+
+}
+
+bool CueSheet::read(const string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if(!in)
+        return false;
+
+    *this = CueSheet();
+    QDir directory = QFileInfo(QString::fromStdString(path)).absoluteDir();
+    string file;
+    string line;
+    bool first = true;
+    bool inTrack = false;
+    int current = -1; // the audio track being described
+    while(getline(in, line))
+    {
+        if(first && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+            line.erase(0, 3);
+        first = false;
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if(!isValidUtf8(line.data(), line.size()))
+            line = latin1ToUtf8(line);
+
+        size_t pos = 0;
+        string command = lowered(nextValue(line, pos));
+        if(command == "file")
+        {
+            // The track stays open: sheets with the gaps appended (EAC's
+            // "noncompliant" ones) put a track's INDEX 00 at the end of
+            // one file and its INDEX 01 at the start of the next.
+            file = findFile(directory, nextValue(line, pos));
+        }
+        else if(command == "track")
+        {
+            // Data tracks of mixed-mode discs are left out.
+            int number = atoi(nextValue(line, pos).c_str());
+            string type = lowered(nextValue(line, pos));
+            inTrack = true;
+            current = -1;
+            if(type == "audio" && number > 0 && !file.empty())
+            {
+                Track track;
+                track.number = number;
+                track.file = file;
+                track.start = -1;
+                tracks.push_back(track);
+                current = int(tracks.size()) - 1;
+            }
+        }
+        else if(command == "index")
+        {
+            // INDEX 00 opens the pregap, which is heard at the end of the
+            // track before, as on the disc.
+            int number = atoi(nextValue(line, pos).c_str());
+            long long time = timeOf(nextValue(line, pos));
+            if(current != -1 && number == 1)
+            {
+                tracks[current].file = file;
+                tracks[current].start = time;
+            }
+        }
+        else if(command == "title" || command == "performer")
+        {
+            if(inTrack && current == -1)
+                continue;
+            Track *track = current != -1 ? &tracks[current] : nullptr;
+            string value = nextValue(line, pos);
+            if(command == "title")
+                (track ? track->title : title) = value;
+            else
+                (track ? track->performer : performer) = value;
+        }
+        else if(command == "rem")
+        {
+            string key = lowered(nextValue(line, pos));
+            if(key == "genre")
+                genre = nextValue(line, pos);
+            else if(key == "date")
+                year = atoi(nextValue(line, pos).c_str());
+        }
+    }
+
+    // A track runs to the start of the next one in the same file, so
+    // consecutive tracks play on without a gap.
+    for(size_t i = 0; i < tracks.size(); )
+    {
+        if(tracks[i].start < 0)
+            tracks.erase(tracks.begin() + i);
+        else
+            i++;
+    }
+    for(size_t i = 0; i + 1 < tracks.size(); i++)
+    {
+        if(tracks[i + 1].file == tracks[i].file && tracks[i + 1].start > tracks[i].start)
+            tracks[i].end = tracks[i + 1].start;
+    }
+    return !tracks.empty();
+}
+
+bool CueSheet::readCached(const string &path)
+{
+    long long modified = QFileInfo(QString::fromStdString(path)).lastModified().toMSecsSinceEpoch();
+    if(path != source || modified != sourceModified)
+    {
+        if(!read(path))
+            *this = CueSheet();
+        source = path;
+        sourceModified = modified;
+    }
+    return !tracks.empty();
+}
+
+const CueSheet::Track *CueSheet::find(int number) const
+{
+    for(const Track &track : tracks)
+    {
+        if(track.number == number)
+            return &track;
+    }
+    return nullptr;
+}
+
+void CueSheet::describe(const Track &track, TrackInfo &info) const
+{
+    long long end = track.end >= 0 ? track.end : info.duration;
+    info.duration = end > track.start ? int(end - track.start) : 0;
+    info.title = track.title.empty() ? "Track " + to_string(track.number) : track.title;
+    if(!track.performer.empty() || !performer.empty())
+        info.artist = track.performer.empty() ? performer : track.performer;
+    if(!title.empty())
+        info.album = title;
+    if(!genre.empty())
+        info.genre = genre;
+    if(year > 0)
+        info.year = year;
+    info.trackNumber = track.number;
+    info.bpm = 0; // a tempo tagged on the image is not this track's
+}
+
+bool CueSheet::isSheet(const string &path)
+{
+    return path.size() > 4 && lowered(path.substr(path.size() - 4)) == ".cue";
+}
+
+string CueSheet::locationOf(const string &sheet, int number)
+{
+    return sheet + "#" + to_string(number);
+}
+
+bool CueSheet::split(const string &location, string &sheet, int &number)
+{
+    size_t hash = location.rfind('#');
+    if(hash == string::npos || hash + 1 == location.size() || location.size() - hash > 4)
+        return false;
+    for(size_t i = hash + 1; i < location.size(); i++)
+    {
+        if(location[i] < '0' || location[i] > '9')
+            return false;
+    }
+    if(!isSheet(location.substr(0, hash)))
+        return false;
+
+    sheet = location.substr(0, hash);
+    number = atoi(location.c_str() + hash + 1);
+    return true;
+}
+
+string CueSheet::fileOf(const string &location)
+{
+    string path;
+    int number;
+    CueSheet sheet;
+    if(!split(location, path, number) || !sheet.read(path) || !sheet.find(number))
+        return location;
+    return sheet.find(number)->file;
+}
+
+void CueSheet::expand(vector<string> &locations)
+{
+    vector<CueSheet> sheets;
+    std::unordered_set<string> covered;
+    for(const string &location : locations)
+    {
+        if(!isSheet(location))
+            continue;
+
+        // A sheet that cannot be read leaves the files it names alone.
+        CueSheet sheet;
+        sheet.read(location);
+        for(const Track &track : sheet.tracks)
+            covered.insert(track.file);
+        sheets.push_back(std::move(sheet));
+    }
+    if(sheets.empty())
+        return;
+
+    vector<string> expanded;
+    size_t next = 0;
+    for(const string &location : locations)
+    {
+        if(isSheet(location))
+        {
+            for(const Track &track : sheets[next].tracks)
+                expanded.push_back(locationOf(location, track.number));
+            next++;
+        }
+        else if(!covered.count(QDir::cleanPath(QString::fromStdString(location)).toStdString()))
+        {
+            expanded.push_back(location);
+        }
+    }
+    locations.swap(expanded);
+}
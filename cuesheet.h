@@ -0,0 +1,77 @@
+#ifndef CUESHEET_H
+#define CUESHEET_H
+
+#include <string>
+#include <vector>
+#include "tagreader.h"
+
+using namespace std;
+
+// A cue sheet: the tracks of a disc ripped to one audio image (or a few
+// files), each with where in its file it starts. Every track becomes a
+// track of the playlist of its own, located "<sheet>#<number>", and the
+// image it is cut from is left out of the playlist.
+class CueSheet
+{
+public:
+    struct Track
+    {
+        int number = 0;
+
+        string file; // the audio file, as an absolute path
+
+        string title;
+
+        string performer;
+
+        long long start = 0; // ms into file
+
+        long long end = -1; // ms into file, -1 for the end of the file
+    };
+
+    // Returns false when the sheet cannot be read or has no audio tracks.
+    bool read(const string &path);
+
+    // read(), unless this is the sheet last read from path and the file has
+    // not changed since: the tracks of a disc tend to come up one after
+    // another, and each needs the sheet.
+    bool readCached(const string &path);
+
+    const Track *find(int number) const;
+
+    // Fills in what the sheet says about track, over what the tags of its
+    // file said. info.duration goes in as the length of the whole file.
+    void describe(const Track &track, TrackInfo &info) const;
+
+    static bool isSheet(const string &path);
+
+    static string locationOf(const string &sheet, int number);
+
+    // Whether location is a track of a cue sheet, and which.
+    static bool split(const string &location, string &sheet, int &number);
+
+    // The audio file a location plays: the file a cue sheet track is cut
+    // from, or location itself.
+    static string fileOf(const string &location);
+
+    // Replaces the cue sheets among locations by their tracks, and drops
+    // the files those tracks are cut from.
+    static void expand(vector<string> &locations);
+
+    string title;
+
+    string performer;
+
+    string genre;
+
+    int year = 0;
+
+    vector<Track> tracks;
+
+private:
+    string source; // the path last read, even if that failed
+
+    long long sourceModified = -1;
+};
+
+#endif // CUESHEET_H
@@ -0,0 +1,223 @@
+#include "duplicatefinder.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include "cuesheet.h"
+#include "hash.h"
+#include "tagreader.h"
+
+namespace {
+
+// Bytes hashed at each end of the payload in the partial stage.
+const size_t PartialBytes = 64 * 1024;
+
+// Candidates handed to one pool task.
+const size_t CandidatesPerTask = 16;
+
+}
+
+struct DuplicateFinder::Candidate
+{
+    size_t order;
+
+    unsigned int id;
+
+    string location;
+
+    unsigned long long length = 0;
+
+    bool ogg = false;
+
+    uint64_t hash = 0;
+
+    bool ok = false;
+};
+
+DuplicateFinder::DuplicateFinder(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(1);
+    workers.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+DuplicateFinder::~DuplicateFinder()
+{
+    cancelled = true;
+    pool.waitForDone();
+}
+
+void DuplicateFinder::find(const vector<Job> &jobs)
+{
+    if(running.exchange(true))
+        return;
+
+    pool.start([this, jobs]() {
+        run(jobs);
+        running = false;
+        emit finished();
+    });
+}
+
+bool DuplicateFinder::isRunning() const
+{
+    return running;
+}
+
+vector<vector<unsigned int>> DuplicateFinder::takeGroups()
+{
+    QMutexLocker locker(&mutex);
+    vector<vector<unsigned int>> taken;
+    taken.swap(groups);
+    return taken;
+}
+
+// Runs work(candidate, data, size, payload) on every candidate across the
+// worker pool, with the file mapped; candidates that cannot be read are
+// dropped afterwards.
+template<typename Work>
+void DuplicateFinder::forEach(vector<Candidate> &candidates, Work work)
+{
+    for(size_t first = 0; first < candidates.size(); first += CandidatesPerTask)
+    {
+        size_t last = std::min(candidates.size(), first + CandidatesPerTask);
+        workers.start([this, &candidates, work, first, last]() {
+            for(size_t c = first; c < last && !cancelled; c++)
+            {
+                Candidate &candidate = candidates[c];
+                candidate.ok = false;
+
+                QFile file(QString::fromStdString(candidate.location));
+                if(!file.open(QIODevice::ReadOnly) || file.size() == 0)
+                    continue;
+                uchar *data = file.map(0, file.size());
+                if(!data)
+                    continue;
+
+                AudioPayload payload;
+                if(findAudioPayload(data, size_t(file.size()), payload))
+                {
+                    work(candidate, data, payload);
+                    candidate.ok = true;
+                }
+                file.unmap(data);
+            }
+        });
+    }
+    workers.waitForDone();
+
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [](const Candidate &candidate) { return !candidate.ok; }),
+                     candidates.end());
+}
+
+namespace {
+
+// Keeps only the candidates that share their key with another one, sorted
+// by key.
+template<typename Candidates, typename Key>
+void keepShared(Candidates &candidates, Key key)
+{
+    std::sort(candidates.begin(), candidates.end(),
+              [&key](const auto &a, const auto &b) { return key(a) < key(b); });
+
+    Candidates shared;
+    for(size_t i = 0; i < candidates.size();)
+    {
+        size_t j = i + 1;
+        while(j < candidates.size() && key(candidates[j]) == key(candidates[i]))
+            j++;
+        if(j - i > 1)
+            shared.insert(shared.end(), candidates.begin() + i, candidates.begin() + j);
+        i = j;
+    }
+    candidates.swap(shared);
+}
+
+uint64_t hashRange(const uchar *data, const AudioPayload &payload, size_t from, size_t to, Hash64 &hash)
+{
+    forEachAudioChunk(data, payload, from, to, [&hash](const unsigned char *p, size_t n) { hash.update(p, n); });
+    return hash.digest();
+}
+
+}
+
+void DuplicateFinder::run(vector<Job> jobs)
+{
+    // A track of a cue sheet is a stretch of its image, with no payload
+    // of its own to compare, so such tracks are left out; copies of a
+    // disc are for FingerprintScanner to find.
+    vector<Candidate> candidates;
+    for(size_t i = 0; i < jobs.size(); i++)
+    {
+        string sheet;
+        int number;
+        if(CueSheet::split(jobs[i].location, sheet, number))
+            continue;
+
+        Candidate candidate;
+        candidate.order = i;
+        candidate.id = jobs[i].id;
+        candidate.location = jobs[i].location;
+        candidates.push_back(candidate);
+    }
+
+    // Stage 1: payload length, from the container headers only.
+    forEach(candidates, [](Candidate &candidate, const uchar *, const AudioPayload &payload) {
+        candidate.length = payload.end - payload.begin;
+        candidate.ogg = payload.ogg;
+    });
+    auto byLength = [](const Candidate &c) { return std::make_pair(c.length, c.ogg); };
+    keepShared(candidates, byLength);
+
+    // Stage 2: both ends of the payload. Payloads this short are hashed
+    // whole here already.
+    forEach(candidates, [](Candidate &candidate, const uchar *data, const AudioPayload &payload) {
+        Hash64 hash;
+        if(payload.end - payload.begin <= 2 * PartialBytes)
+            candidate.hash = hashRange(data, payload, payload.begin, payload.end, hash);
+        else
+        {
+            hashRange(data, payload, payload.begin, payload.begin + PartialBytes, hash);
+            candidate.hash = hashRange(data, payload, payload.end - PartialBytes, payload.end, hash);
+        }
+    });
+    auto byHash = [](const Candidate &c) { return std::make_tuple(c.length, c.ogg, c.hash); };
+    keepShared(candidates, byHash);
+
+    // Stage 3: the whole payload, for what is still ambiguous.
+    vector<Candidate> large, small;
+    for(Candidate &candidate : candidates)
+        (candidate.length > 2 * PartialBytes ? large : small).push_back(std::move(candidate));
+    forEach(large, [](Candidate &candidate, const uchar *data, const AudioPayload &payload) {
+        Hash64 hash;
+        candidate.hash = hashRange(data, payload, payload.begin, payload.end, hash);
+    });
+    keepShared(large, byHash);
+    candidates.swap(small);
+    candidates.insert(candidates.end(), large.begin(), large.end());
+
+    if(cancelled)
+        return;
+
+    // Group, then order members and groups as the jobs were given.
+    std::sort(candidates.begin(), candidates.end(), [&byHash](const Candidate &a, const Candidate &b) {
+        return byHash(a) != byHash(b) ? byHash(a) < byHash(b) : a.order < b.order;
+    });
+    vector<pair<size_t, vector<unsigned int>>> found;
+    for(size_t i = 0; i < candidates.size();)
+    {
+        size_t j = i;
+        vector<unsigned int> ids;
+        while(j < candidates.size() && byHash(candidates[j]) == byHash(candidates[i]))
+            ids.push_back(candidates[j++].id);
+        found.emplace_back(candidates[i].order, ids);
+        i = j;
+    }
+    std::sort(found.begin(), found.end());
+
+    QMutexLocker locker(&mutex);
+    groups.clear();
+    for(auto &group : found)
+        groups.push_back(std::move(group.second));
+}
@@ -0,0 +1,67 @@
+#ifndef DUPLICATEFINDER_H
+#define DUPLICATEFINDER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Finds tracks whose encoded audio is identical, whatever their paths and
+// tags. Files are compared in stages so that most are never read in full:
+// first by payload length (from the headers alone), then, among equal
+// lengths, by a hash of the first and last 64 KiB of the payload, and only
+// then by a hash of the whole payload. Each stage runs across a thread
+// pool over memory-mapped files; finished() is emitted at the end. Tracks
+// of cue sheets are not files of their own and are skipped.
+class DuplicateFinder : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        unsigned int id;
+
+        string location;
+    };
+
+    DuplicateFinder(QObject *parent = nullptr);
+
+    ~DuplicateFinder();
+
+    void find(const vector<Job> &jobs);
+
+    bool isRunning() const;
+
+    // Groups of track ids with identical audio, in job order.
+    vector<vector<unsigned int>> takeGroups();
+
+signals:
+    void finished();
+
+private:
+    struct Candidate;
+
+    void run(vector<Job> jobs);
+
+    template<typename Work>
+    void forEach(vector<Candidate> &candidates, Work work);
+
+    QThreadPool pool;
+
+    QThreadPool workers;
+
+    QMutex mutex;
+
+    vector<vector<unsigned int>> groups;
+
+    std::atomic<bool> running{false};
+
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // DUPLICATEFINDER_H
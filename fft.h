@@ -0,0 +1,88 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Radix-2 FFT over split real/imaginary arrays. Twiddle factors are laid
+// out stage by stage, so the inner butterfly loop reads every array with
+// unit stride and the compiler turns it into SSE/AVX code.
+class Fft
+{
+public:
+    static constexpr double Pi = 3.14159265358979323846;
+
+    explicit Fft(int n) : n(n)
+    {
+        int bits = 0;
+        while((1 << bits) < n)
+            bits++;
+
+        reversed.resize(n);
+        for(int i = 0; i < n; i++)
+        {
+            int r = 0;
+            for(int b = 0; b < bits; b++)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            reversed[i] = r;
+        }
+
+        for(int half = 1; half < n; half *= 2)
+        {
+            for(int j = 0; j < half; j++)
+            {
+                twiddleRe.push_back(float(std::cos(-Pi * j / half)));
+                twiddleIm.push_back(float(std::sin(-Pi * j / half)));
+            }
+        }
+    }
+
+    void transform(vector<float> &re, vector<float> &im) const
+    {
+        for(int i = 0; i < n; i++)
+        {
+            int r = reversed[i];
+            if(r > i)
+            {
+                std::swap(re[i], re[r]);
+                std::swap(im[i], im[r]);
+            }
+        }
+
+        const float *wr = twiddleRe.data();
+        const float *wi = twiddleIm.data();
+        for(int half = 1; half < n; half *= 2)
+        {
+            for(int block = 0; block < n; block += 2 * half)
+            {
+                float *ar = re.data() + block, *ai = im.data() + block;
+                float *br = ar + half, *bi = ai + half;
+                for(int j = 0; j < half; j++)
+                {
+                    float tr = br[j] * wr[j] - bi[j] * wi[j];
+                    float ti = br[j] * wi[j] + bi[j] * wr[j];
+                    br[j] = ar[j] - tr;
+                    bi[j] = ai[j] - ti;
+                    ar[j] += tr;
+                    ai[j] += ti;
+                }
+            }
+            wr += half;
+            wi += half;
+        }
+    }
+
+private:
+    int n;
+
+    vector<int> reversed;
+
+    vector<float> twiddleRe;
+
+    vector<float> twiddleIm;
+};
+
+#endif // FFT_H
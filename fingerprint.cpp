@@ -0,0 +1,308 @@
+#include "fingerprint.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "fft.h"
+
+namespace {
+
+const double Pi = 3.14159265358979323846;
+
+// Lowest and highest frequencies folded into the chroma, in Hz.
+const double MinFrequency = 55;
+const double MaxFrequency = 3520;
+
+// Input below this level before the first sound is skipped (about -60 dB),
+// so leading silence does not shift the frames.
+const float SilenceLevel = 0.001f;
+
+// Locality-sensitive hashing: tables, and bits sampled per table. A pair
+// at distance d shares a bucket in a table with probability (1 - d)^16,
+// so it is found with probability 1 - (1 - (1 - d)^16)^96: about 94% at
+// the 0.2 cut-off, 99.9% at 0.15 and all but certainly below that.
+// Unrelated pairs (d near 0.5) share a bucket once in 65536 tries.
+const int Tables = 96;
+const int BitsPerKey = 16;
+
+// Buckets larger than this hold near-constant fingerprints (silence,
+// test tones) that would match everything; they are skipped.
+const size_t MaxBucket = 64;
+
+// Pitch class of every FFT bin, or -1 outside the analysed range.
+vector<int> pitchClasses()
+{
+    vector<int> classes(Fingerprinter::FrameSize / 2, -1);
+    for(int k = 1; k < Fingerprinter::FrameSize / 2; k++)
+    {
+        double frequency = double(k) * Fingerprinter::SampleRate / Fingerprinter::FrameSize;
+        if(frequency < MinFrequency || frequency > MaxFrequency)
+            continue;
+        int note = int(std::lround(12 * std::log2(frequency / 440.0))) + 69;
+        classes[k] = note % 12;
+    }
+    return classes;
+}
+
+const Fft &fft()
+{
+    static const Fft instance(Fingerprinter::FrameSize);
+    return instance;
+}
+
+const vector<int> &binClasses()
+{
+    static const vector<int> classes = pitchClasses();
+    return classes;
+}
+
+int popcount(uint32_t x)
+{
+    x = x - ((x >> 1) & 0x55555555u);
+    x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+    return int((((x + (x >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24);
+}
+
+// fingerprintDistance() <= maxDistance for two full-length fingerprints,
+// giving up on an alignment as soon as it has too many differing bits;
+// unrelated recordings get there about halfway through.
+bool isNear(const uint32_t *a, const uint32_t *b, double maxDistance, int maxOffset = 2)
+{
+    const size_t n = Fingerprinter::Frames;
+    for(int step = 0; step <= 2 * maxOffset; step++)
+    {
+        // 0, 1, -1, 2, -2...: pairs from the same bucket are usually
+        // aligned already.
+        int offset = (step & 1) ? (step + 1) / 2 : -step / 2;
+        size_t ia = offset > 0 ? size_t(offset) : 0;
+        size_t ib = offset < 0 ? size_t(-offset) : 0;
+        size_t overlap = n - ia - ib;
+        int limit = int(maxDistance * 32.0 * double(overlap));
+
+        int differing = 0;
+        size_t i = 0;
+        for(; i < overlap && differing <= limit; i++)
+            differing += popcount(a[ia + i] ^ b[ib + i]);
+        if(i == overlap && differing <= limit)
+            return true;
+    }
+    return false;
+}
+
+}
+
+Fingerprinter::Fingerprinter(int sampleRate)
+    : step(double(sampleRate) / SampleRate)
+    , window(FrameSize)
+{
+    for(int i = 0; i < FrameSize; i++)
+        window[i] = float(0.5 - 0.5 * std::cos(2 * Pi * i / (FrameSize - 1)));
+}
+
+void Fingerprinter::feed(const float *input, size_t n)
+{
+    // Box-filter decimation to SampleRate: every output sample is the mean
+    // of the input samples it covers. Chroma only looks below 3.5 kHz, so
+    // this is filter enough.
+    for(size_t i = 0; i < n && !isFull(); i++)
+    {
+        if(!started)
+        {
+            if(std::fabs(input[i]) < SilenceLevel)
+                continue;
+            started = true;
+        }
+
+        accumulated += input[i];
+        accumulatedCount++;
+        position += 1;
+        if(position < step)
+            continue;
+
+        float sample = accumulated / float(accumulatedCount);
+        accumulated = 0;
+        accumulatedCount = 0;
+        for(; position >= step && !isFull(); position -= step)
+        {
+            samples.push_back(sample);
+            if(int(samples.size()) == FrameSize)
+                frame();
+        }
+    }
+}
+
+bool Fingerprinter::isFull() const
+{
+    return int(chroma.size()) >= Frames * 12;
+}
+
+void Fingerprinter::frame()
+{
+    vector<float> re(FrameSize), im(FrameSize, 0.0f);
+    for(int i = 0; i < FrameSize; i++)
+        re[i] = samples[i] * window[i];
+    fft().transform(re, im);
+
+    const vector<int> &classes = binClasses();
+    float bins[12] = {};
+    for(int k = 1; k < FrameSize / 2; k++)
+    {
+        if(classes[k] >= 0)
+            bins[classes[k]] += re[k] * re[k] + im[k] * im[k];
+    }
+    chroma.insert(chroma.end(), bins, bins + 12);
+
+    samples.erase(samples.begin(), samples.begin() + Hop);
+}
+
+vector<uint32_t> Fingerprinter::result() const
+{
+    int frames = int(chroma.size() / 12);
+    vector<uint32_t> words;
+    if(frames < 3)
+        return words;
+
+    // Smooth over three frames, then normalise so loudness drops out.
+    vector<float> c(chroma.size());
+    double total = 0;
+    for(int t = 0; t < frames; t++)
+    {
+        float norm = 0;
+        for(int i = 0; i < 12; i++)
+        {
+            float sum = 0;
+            for(int d = -1; d <= 1; d++)
+                sum += chroma[std::min(std::max(t + d, 0), frames - 1) * 12 + i];
+            c[t * 12 + i] = sum;
+            norm += sum * sum;
+            total += sum;
+        }
+        norm = std::sqrt(norm);
+        for(int i = 0; i < 12; i++)
+            c[t * 12 + i] = norm > 0 ? c[t * 12 + i] / norm : 0;
+    }
+    if(total <= 0)
+        return words;
+
+    words.resize(frames);
+    for(int t = 0; t < frames; t++)
+    {
+        const float *now = &c[t * 12];
+        const float *before = &c[std::max(t - 2, 0) * 12];
+        uint32_t word = 0;
+        for(int i = 0; i < 12; i++)
+        {
+            word |= uint32_t(now[i] > now[(i + 1) % 12]) << i;
+            word |= uint32_t(now[i] > before[i]) << (12 + i);
+        }
+        for(int i = 0; i < 8; i++)
+            word |= uint32_t(now[i] > now[(i + 3) % 12]) << (24 + i);
+        words[t] = word;
+    }
+    return words;
+}
+
+double fingerprintDistance(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, int maxOffset)
+{
+    double best = 1;
+    size_t shorter = std::min(na, nb);
+    for(int offset = -maxOffset; offset <= maxOffset; offset++)
+    {
+        size_t ia = offset > 0 ? size_t(offset) : 0;
+        size_t ib = offset < 0 ? size_t(-offset) : 0;
+        if(ia >= na || ib >= nb)
+            continue;
+
+        size_t overlap = std::min(na - ia, nb - ib);
+        if(overlap * 2 < shorter)
+            continue;
+
+        int differing = 0;
+        for(size_t i = 0; i < overlap; i++)
+            differing += popcount(a[ia + i] ^ b[ib + i]);
+        best = std::min(best, double(differing) / (32.0 * overlap));
+    }
+    return best;
+}
+
+void SimilarityIndex::add(unsigned int id, const uint32_t *fingerprint, size_t n)
+{
+    // Keys sample fixed bit positions, so only full-length fingerprints
+    // take part.
+    if(n < size_t(Fingerprinter::Frames))
+        return;
+
+    ids.push_back(id);
+    words.insert(words.end(), fingerprint, fingerprint + Fingerprinter::Frames);
+}
+
+vector<vector<unsigned int>> SimilarityIndex::groups(double maxDistance) const
+{
+    const size_t count = ids.size();
+    const int totalBits = Fingerprinter::Frames * 32;
+
+    // Confirmed pairs are joined with union-find as they come up, so
+    // recordings already grouped are not compared again from other tables.
+    vector<uint32_t> parent(count);
+    for(size_t e = 0; e < count; e++)
+        parent[e] = uint32_t(e);
+    auto root = [&parent](uint32_t e) {
+        while(parent[e] != e)
+            e = parent[e] = parent[parent[e]];
+        return e;
+    };
+
+    // The same sampled positions on every run.
+    std::mt19937 random(20240611);
+    std::uniform_int_distribution<int> position(0, totalBits - 1);
+
+    vector<pair<uint32_t, uint32_t>> keys(count);
+    for(int table = 0; table < Tables; table++)
+    {
+        int bits[BitsPerKey];
+        for(int &bit : bits)
+            bit = position(random);
+
+        for(size_t e = 0; e < count; e++)
+        {
+            const uint32_t *fingerprint = &words[e * Fingerprinter::Frames];
+            uint32_t key = 0;
+            for(int b = 0; b < BitsPerKey; b++)
+                key = (key << 1) | ((fingerprint[bits[b] >> 5] >> (bits[b] & 31)) & 1);
+            keys[e] = { key, uint32_t(e) };
+        }
+        std::sort(keys.begin(), keys.end());
+
+        for(size_t i = 0; i < count;)
+        {
+            size_t j = i + 1;
+            while(j < count && keys[j].first == keys[i].first)
+                j++;
+            if(j - i > 1 && j - i <= MaxBucket)
+            {
+                for(size_t x = i; x < j; x++)
+                {
+                    for(size_t y = x + 1; y < j; y++)
+                    {
+                        uint32_t a = keys[x].second, b = keys[y].second;
+                        if(root(a) != root(b) &&
+                           isNear(&words[a * size_t(Fingerprinter::Frames)], &words[b * size_t(Fingerprinter::Frames)], maxDistance))
+                            parent[root(b)] = root(a);
+                    }
+                }
+            }
+            i = j;
+        }
+    }
+
+    vector<vector<unsigned int>> members(count);
+    for(size_t e = 0; e < count; e++)
+        members[root(uint32_t(e))].push_back(ids[e]);
+
+    vector<vector<unsigned int>> found;
+    for(vector<unsigned int> &group : members)
+    {
+        if(group.size() > 1)
+            found.push_back(std::move(group));
+    }
+    return found;
+}
@@ -0,0 +1,80 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Acoustic fingerprint of the first seconds of a recording: one 32-bit
+// word per analysis frame, each bit comparing chroma (energy per pitch
+// class) between neighbouring pitch classes or between nearby frames.
+// Such comparisons survive lossy re-encoding, resampling and volume
+// changes, so the same recording as MP3 and FLAC gives nearly the same
+// bits while different recordings disagree on about half of them.
+class Fingerprinter
+{
+public:
+    static const int SampleRate = 11025;
+
+    static const int FrameSize = 4096;
+
+    static const int Hop = FrameSize / 3;
+
+    // About 16 seconds of audio.
+    static const int Frames = 128;
+
+    Fingerprinter(int sampleRate);
+
+    // Mono samples at the rate given to the constructor, in [-1, 1].
+    void feed(const float *samples, size_t n);
+
+    bool isFull() const;
+
+    // The fingerprint so far; empty if the audio was (nearly) silent.
+    vector<uint32_t> result() const;
+
+private:
+    void frame();
+
+    double step;
+
+    double position = 0;
+
+    float accumulated = 0;
+
+    int accumulatedCount = 0;
+
+    vector<float> window;
+
+    vector<float> samples;
+
+    vector<float> chroma; // 12 per frame
+
+    bool started = false;
+};
+
+// Share of differing bits, at the best alignment within maxOffset frames.
+double fingerprintDistance(const uint32_t *a, size_t na, const uint32_t *b, size_t nb, int maxOffset = 2);
+
+// Groups of near-identical recordings among many fingerprints. Candidate
+// pairs come from locality-sensitive hashing: several tables each key a
+// fingerprint by a fixed random sample of its bits, so fingerprints that
+// differ in few bits very likely share a bucket in at least one table,
+// and unrelated ones almost never do. Candidates are then confirmed with
+// fingerprintDistance().
+class SimilarityIndex
+{
+public:
+    void add(unsigned int id, const uint32_t *words, size_t n);
+
+    vector<vector<unsigned int>> groups(double maxDistance = 0.2) const;
+
+private:
+    vector<unsigned int> ids;
+
+    vector<uint32_t> words; // Fingerprinter::Frames per entry
+};
+
+#endif // FINGERPRINT_H
@@ -0,0 +1,336 @@
+#include "fingerprintscanner.h"
+#include <algorithm>
+#include <QAudioFormat>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QUrl>
+#include <QtEndian>
+#include "cuesheet.h"
+#include "hash.h"
+
+namespace {
+
+// Layout, little endian:
+//   header  "KPFP", version, record count, reserved         16 bytes
+//   records: key u64, size i64, modified i64, word count u32, words u32...
+const char Magic[4] = { 'K', 'P', 'F', 'P' };
+const quint32 Version = 1;
+const int HeaderSize = 16;
+const int RecordHeaderSize = 28;
+
+}
+
+vector<float> FingerprintScanner::monoSamples(const QAudioBuffer &buffer)
+{
+    const QAudioFormat format = buffer.format();
+    const int channels = std::max(1, format.channelCount());
+    const qsizetype frames = buffer.frameCount();
+    vector<float> mono(size_t(frames), 0.0f);
+
+    for(qsizetype f = 0; f < frames; f++)
+    {
+        float sum = 0;
+        for(int c = 0; c < channels; c++)
+        {
+            qsizetype i = f * channels + c;
+            switch(format.sampleFormat())
+            {
+            case QAudioFormat::UInt8:
+                sum += (buffer.constData<quint8>()[i] - 128) / 128.0f;
+                break;
+            case QAudioFormat::Int16:
+                sum += buffer.constData<qint16>()[i] / 32768.0f;
+                break;
+            case QAudioFormat::Int32:
+                sum += buffer.constData<qint32>()[i] / 2147483648.0f;
+                break;
+            case QAudioFormat::Float:
+                sum += buffer.constData<float>()[i];
+                break;
+            default:
+                break;
+            }
+        }
+        mono[size_t(f)] = sum / channels;
+    }
+    return mono;
+}
+
+FingerprintScanner::FingerprintScanner(const QString &path, QObject *parent)
+    : QObject(parent)
+    , path(path)
+{
+    pool.setMaxThreadCount(1);
+    pool.setThreadPriority(QThread::LowestPriority);
+
+    // Ask for what the fingerprint uses; backends that cannot convert hand
+    // out their own format, which monoSamples() and Fingerprinter handle.
+    decoder = new QAudioDecoder(this);
+    QAudioFormat format;
+    format.setSampleRate(Fingerprinter::SampleRate);
+    format.setChannelCount(1);
+    format.setSampleFormat(QAudioFormat::Float);
+    decoder->setAudioFormat(format);
+
+    connect(decoder, SIGNAL(bufferReady()), this, SLOT(on_bufferReady()));
+    connect(decoder, SIGNAL(finished()), this, SLOT(on_decoderFinished()));
+    connect(decoder, SIGNAL(error(QAudioDecoder::Error)), this, SLOT(on_decoderError()));
+    connect(this, SIGNAL(checked()), this, SLOT(on_checked()));
+    connect(this, SIGNAL(fingerprinted()), this, SLOT(decodeNext()));
+    connect(this, SIGNAL(grouped()), this, SLOT(on_grouped()));
+}
+
+FingerprintScanner::~FingerprintScanner()
+{
+    decoder->stop();
+    pool.waitForDone();
+}
+
+void FingerprintScanner::scan(const vector<Job> &jobs)
+{
+    if(running)
+        return;
+    running = true;
+
+    // Stat every file off the GUI thread; only new or changed files are
+    // decoded.
+    pool.start([this, jobs]() {
+        if(!loaded)
+        {
+            load();
+            loaded = true;
+        }
+
+        ready.clear();
+        pending.clear();
+        CueSheet sheet;
+        for(const Job &job : jobs)
+        {
+            // A track of a cue sheet is its stretch of the image, and
+            // changes with the image or the sheet.
+            Pending entry;
+            entry.id = job.id;
+            entry.location = job.location;
+            entry.file = job.location;
+            long long sheetModified = 0;
+            string sheetPath;
+            int number;
+            if(CueSheet::split(job.location, sheetPath, number))
+            {
+                const CueSheet::Track *track = sheet.readCached(sheetPath) ? sheet.find(number) : nullptr;
+                if(!track)
+                    continue;
+                entry.file = track->file;
+                entry.start = track->start * 1000;
+                entry.end = track->end >= 0 ? track->end * 1000 : -1;
+                sheetModified = QFileInfo(QString::fromStdString(sheetPath)).lastModified().toMSecsSinceEpoch();
+            }
+
+            QFileInfo info(QString::fromStdString(entry.file));
+            if(!info.exists())
+                continue;
+
+            entry.size = info.size();
+            entry.modified = std::max(info.lastModified().toMSecsSinceEpoch(), sheetModified);
+            auto it = store.find(Hash64::of(job.location));
+            if(it != store.end() && it->second.size == entry.size && it->second.modified == entry.modified)
+            {
+                if(!it->second.words.empty())
+                    ready.emplace_back(job.id, it->second.words);
+            }
+            else
+                pending.push_back(entry);
+        }
+        emit checked();
+    });
+}
+
+bool FingerprintScanner::isRunning() const
+{
+    return running;
+}
+
+vector<vector<unsigned int>> FingerprintScanner::takeGroups()
+{
+    QMutexLocker locker(&mutex);
+    vector<vector<unsigned int>> taken;
+    taken.swap(groups);
+    return taken;
+}
+
+void FingerprintScanner::on_checked()
+{
+    next = 0;
+    total = int(pending.size());
+    decodeNext();
+}
+
+void FingerprintScanner::decodeNext()
+{
+    if(next < pending.size())
+    {
+        emit progress(int(next), total);
+        fingerprinter.reset();
+        full = std::make_shared<atomic<bool>>(false);
+        decoding = true;
+        decoder->setSource(QUrl::fromLocalFile(QString::fromStdString(pending[next].file)));
+        decoder->start();
+        return;
+    }
+
+    emit progress(total, total);
+    pool.start([this]() {
+        SimilarityIndex index;
+        for(const auto &entry : ready)
+            index.add(entry.first, entry.second.data(), entry.second.size());
+        vector<vector<unsigned int>> found = index.groups();
+
+        if(dirty)
+            dirty = !save();
+
+        {
+            QMutexLocker locker(&mutex);
+            groups.swap(found);
+        }
+        emit grouped();
+    });
+}
+
+void FingerprintScanner::on_grouped()
+{
+    running = false;
+    emit finished();
+}
+
+void FingerprintScanner::on_bufferReady()
+{
+    QAudioBuffer buffer = decoder->read();
+    if(!decoding || !buffer.isValid())
+        return;
+
+    const Pending &track = pending[next];
+    long long time = buffer.startTime();
+    if(track.end >= 0 && time >= track.end)
+    {
+        finishTrack();
+        return;
+    }
+
+    int rate = buffer.format().sampleRate();
+    long long skip = time < track.start ? (track.start - time) * rate / 1000000 : 0;
+    if(skip >= buffer.frameCount())
+        return;
+
+    if(!fingerprinter)
+        fingerprinter = std::make_shared<Fingerprinter>(rate);
+    pool.start([fingerprinter = fingerprinter, full = full, buffer, skip]() {
+        vector<float> mono = monoSamples(buffer);
+        fingerprinter->feed(mono.data() + skip, mono.size() - size_t(skip));
+        if(fingerprinter->isFull())
+            *full = true;
+    });
+
+    // Only the first seconds are needed; the rest is never decoded.
+    if(*full)
+        finishTrack();
+}
+
+void FingerprintScanner::on_decoderFinished()
+{
+    if(decoding)
+        finishTrack();
+}
+
+void FingerprintScanner::on_decoderError()
+{
+    if(decoding)
+        finishTrack();
+}
+
+void FingerprintScanner::finishTrack()
+{
+    decoding = false;
+    decoder->stop();
+
+    // Files that cannot be decoded are stored with an empty fingerprint,
+    // so they are not tried again until they change. The result is taken
+    // after the buffers already handed to the pool.
+    pool.start([this, track = pending[next], fingerprinter = fingerprinter]() {
+        vector<uint32_t> words = fingerprinter ? fingerprinter->result() : vector<uint32_t>();
+        if(!words.empty())
+            ready.emplace_back(track.id, words);
+        store[Hash64::of(track.location)] = { track.size, track.modified, std::move(words) };
+        dirty = true;
+        emit fingerprinted();
+    });
+    fingerprinter.reset();
+    next++;
+
+    // Starting the next file from inside a decoder signal is not safe;
+    // fingerprinted() is always delivered through the event loop.
+}
+
+void FingerprintScanner::load()
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+
+    QByteArray bytes = file.readAll();
+    const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+    qint64 size = bytes.size();
+    if(size < HeaderSize || memcmp(data, Magic, 4) != 0 || qFromLittleEndian<quint32>(data + 4) != Version)
+        return;
+
+    quint32 records = qFromLittleEndian<quint32>(data + 8);
+    qint64 pos = HeaderSize;
+    for(quint32 r = 0; r < records && pos + RecordHeaderSize <= size; r++)
+    {
+        const uchar *record = data + pos;
+        quint32 count = qFromLittleEndian<quint32>(record + 24);
+        if(pos + RecordHeaderSize + qint64(count) * 4 > size)
+            break;
+
+        Stored &stored = store[qFromLittleEndian<quint64>(record)];
+        stored.size = qFromLittleEndian<qint64>(record + 8);
+        stored.modified = qFromLittleEndian<qint64>(record + 16);
+        stored.words.resize(count);
+        for(quint32 i = 0; i < count; i++)
+            stored.words[i] = qFromLittleEndian<quint32>(record + RecordHeaderSize + 4 * i);
+        pos += RecordHeaderSize + qint64(count) * 4;
+    }
+}
+
+bool FingerprintScanner::save()
+{
+    qint64 size = HeaderSize;
+    for(const auto &entry : store)
+        size += RecordHeaderSize + qint64(entry.second.words.size()) * 4;
+
+    QByteArray bytes(int(size), '\0');
+    uchar *out = reinterpret_cast<uchar *>(bytes.data());
+    memcpy(out, Magic, 4);
+    qToLittleEndian<quint32>(Version, out + 4);
+    qToLittleEndian<quint32>(quint32(store.size()), out + 8);
+
+    uchar *record = out + HeaderSize;
+    for(const auto &entry : store)
+    {
+        const Stored &stored = entry.second;
+        qToLittleEndian<quint64>(entry.first, record);
+        qToLittleEndian<qint64>(stored.size, record + 8);
+        qToLittleEndian<qint64>(stored.modified, record + 16);
+        qToLittleEndian<quint32>(quint32(stored.words.size()), record + 24);
+        for(size_t i = 0; i < stored.words.size(); i++)
+            qToLittleEndian<quint32>(stored.words[i], record + RecordHeaderSize + 4 * i);
+        record += RecordHeaderSize + stored.words.size() * 4;
+    }
+
+    // The old file is only replaced once the new one is complete.
+    QSaveFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size() && file.commit();
+}
@@ -0,0 +1,145 @@
+#ifndef FINGERPRINTSCANNER_H
+#define FINGERPRINTSCANNER_H
+
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "fingerprint.h"
+
+using namespace std;
+
+// Finds tracks that are the same recording even when encoded differently
+// (MP3 and FLAC of one rip, say). The first seconds of every track are
+// decoded and fingerprinted (see Fingerprinter); fingerprints are kept in
+// a file next to the metadata cache, keyed by location and checked against
+// size and mtime, so a library is only decoded once. Decoding is the only
+// work left on the GUI thread: samples are converted and analysed on a
+// low-priority worker thread, as TempoScanner does, and grouping runs
+// there too through a SimilarityIndex; finished() follows.
+class FingerprintScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        unsigned int id;
+
+        string location;
+    };
+
+    FingerprintScanner(const QString &path, QObject *parent = nullptr);
+
+    ~FingerprintScanner();
+
+    void scan(const vector<Job> &jobs);
+
+    bool isRunning() const;
+
+    vector<vector<unsigned int>> takeGroups();
+
+    // Mono samples in [-1, 1] from any of the sample formats a decoder
+    // hands out.
+    static vector<float> monoSamples(const QAudioBuffer &buffer);
+
+signals:
+    void progress(int done, int total);
+
+    void finished();
+
+    void checked();
+
+    void fingerprinted();
+
+    void grouped();
+
+private slots:
+    void on_checked();
+
+    void on_grouped();
+
+    void on_bufferReady();
+
+    void on_decoderFinished();
+
+    void on_decoderError();
+
+    void decodeNext();
+
+private:
+    struct Stored
+    {
+        long long size;
+
+        long long modified;
+
+        vector<uint32_t> words;
+    };
+
+    struct Pending
+    {
+        unsigned int id;
+
+        string location;
+
+        string file; // what is decoded: location, or the image of a cue sheet track
+
+        long long start = 0; // microseconds into file where the track starts
+
+        long long end = -1; // microseconds into file, -1 for the end of it
+
+        long long size;
+
+        long long modified;
+    };
+
+    void load();
+
+    bool save();
+
+    void finishTrack();
+
+    QString path;
+
+    QThreadPool pool;
+
+    QAudioDecoder *decoder;
+
+    // Fed on the pool, which runs one task at a time in order.
+    shared_ptr<Fingerprinter> fingerprinter;
+
+    shared_ptr<atomic<bool>> full;
+
+    bool running = false;
+
+    bool decoding = false;
+
+    bool loaded = false;
+
+    bool dirty = false;
+
+    // Only touched on the pool.
+    unordered_map<unsigned long long, Stored> store;
+
+    vector<pair<unsigned int, vector<uint32_t>>> ready;
+
+    vector<Pending> pending;
+
+    size_t next = 0;
+
+    int total = 0;
+
+    QMutex mutex;
+
+    vector<vector<unsigned int>> groups;
+};
+
+#endif // FINGERPRINTSCANNER_H
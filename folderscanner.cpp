@@ -0,0 +1,165 @@
+#include "folderscanner.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include "cuesheet.h"
+#include "tagreader.h"
+
+namespace {
+
+// Paths a task collects before publishing them.
+const size_t FilesPerBatch = 256;
+
+const char *const audioSuffixes[] = {
+    "mp3", "mp2", "flac", "ogg", "oga", "opus", "m4a", "m4b", "mp4", "aac", "wav", "wma", "aif", "aiff",
+    "ape", "wv",
+};
+
+// Files that commonly sit next to music and are never opened to check.
+const char *const otherSuffixes[] = {
+    "jpg", "jpeg", "png", "gif", "bmp", "webp", "txt", "nfo", "log", "cue", "m3u", "m3u8", "pls", "xspf",
+    "pdf", "sfv", "md5", "accurip", "db", "ini", "lrc", "url", "htm", "html", "xml", "json",
+};
+
+bool listed(const QString &suffix, const char *const *list, size_t n)
+{
+    for(size_t i = 0; i < n; i++)
+    {
+        if(suffix.compare(QLatin1String(list[i]), Qt::CaseInsensitive) == 0)
+            return true;
+    }
+    return false;
+}
+
+}
+
+FolderScanner::FolderScanner(QObject *parent)
+    : QObject(parent)
+{
+    // Listing is mostly waiting on the file system (a network share in the
+    // worst case), so use more threads than there are cores.
+    pool.setMaxThreadCount(std::max(4, QThread::idealThreadCount() * 2));
+}
+
+FolderScanner::~FolderScanner()
+{
+    cancelled = true;
+    pool.waitForDone();
+}
+
+void FolderScanner::scan(const QString &folder, bool files)
+{
+    pending++;
+    pool.start([this, folder, files]() { listDirectory(folder, files); });
+}
+
+bool FolderScanner::isScanning() const
+{
+    return pending > 0;
+}
+
+bool FolderScanner::isAudioFile(const QString &path, const QString &suffix)
+{
+    if(listed(suffix, audioSuffixes, std::size(audioSuffixes)))
+        return true;
+    if(listed(suffix, otherSuffixes, std::size(otherSuffixes)))
+        return false;
+
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray head = file.read(16);
+    return looksLikeAudio(reinterpret_cast<const unsigned char *>(head.constData()), size_t(head.size()));
+}
+
+void FolderScanner::listDirectory(const QString &directory, bool files)
+{
+    vector<string> batch;
+    vector<string> listed(1, directory.toStdString());
+
+    if(!cancelled)
+    {
+        // Symbolic links are not followed, so a link back up the tree
+        // cannot make the walk loop forever.
+        QDir::Filters filters = QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks;
+        if(files)
+            filters |= QDir::Files;
+
+        QDirIterator it(directory, filters);
+        while(it.hasNext() && !cancelled)
+        {
+            QString path = it.next();
+            QFileInfo info = it.fileInfo();
+
+            if(info.isDir())
+            {
+                pending++;
+                pool.start([this, path, files]() { listDirectory(path, files); });
+            }
+            else if(CueSheet::isSheet(path.toStdString()) || isAudioFile(path, info.suffix()))
+            {
+                batch.push_back(path.toStdString());
+            }
+        }
+
+        // Keep an album in order; directories themselves arrive in whatever
+        // order the threads finish them. A disc image with a cue sheet is
+        // replaced by the sheet's tracks, in the sheet's order.
+        std::sort(batch.begin(), batch.end());
+        CueSheet::expand(batch);
+        for(size_t first = 0; first < batch.size(); first += FilesPerBatch)
+        {
+            vector<string> part(batch.begin() + first,
+                                batch.begin() + std::min(batch.size(), first + FilesPerBatch));
+            publish(part, listed);
+        }
+
+        // The directory itself is reported with its first batch of files,
+        // or on its own if it has none.
+        if(batch.empty())
+            publish(batch, listed);
+    }
+
+    if(--pending == 0)
+        emit finished();
+}
+
+void FolderScanner::publish(vector<string> &batch, vector<string> &listed)
+{
+    if(batch.empty() && listed.empty())
+        return;
+
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&mutex);
+        wasEmpty = files.empty() && directories.empty();
+        files.insert(files.end(), batch.begin(), batch.end());
+        directories.insert(directories.end(), listed.begin(), listed.end());
+    }
+    batch.clear();
+    listed.clear();
+
+    if(wasEmpty)
+        emit filesFound();
+}
+
+vector<string> FolderScanner::takeFiles()
+{
+    QMutexLocker locker(&mutex);
+    vector<string> taken;
+    taken.swap(files);
+    return taken;
+}
+
+vector<string> FolderScanner::takeDirectories()
+{
+    QMutexLocker locker(&mutex);
+    vector<string> taken;
+    taken.swap(directories);
+    return taken;
+}
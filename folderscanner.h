@@ -0,0 +1,67 @@
+#ifndef FOLDERSCANNER_H
+#define FOLDERSCANNER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Finds the audio files under a folder. Every directory is listed by its
+// own pool task, which queues a task for each subdirectory it meets, so
+// wide trees (a NAS share with thousands of album folders) are listed by
+// all threads at once. Files are recognised by extension, or by their
+// first bytes when the extension says nothing; a disc image that has a cue
+// sheet is listed as the sheet's tracks. Paths are collected in
+// batches; filesFound() is emitted whenever a batch lands in an empty
+// queue and finished() once the whole tree has been listed. The
+// directories walked are collected too, for LibraryWatcher.
+class FolderScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    FolderScanner(QObject *parent = nullptr);
+
+    ~FolderScanner();
+
+    // With files false only directories are collected.
+    void scan(const QString &folder, bool files = true);
+
+    bool isScanning() const;
+
+    vector<string> takeFiles();
+
+    vector<string> takeDirectories();
+
+    static bool isAudioFile(const QString &path, const QString &suffix);
+
+signals:
+    void filesFound();
+
+    void finished();
+
+private:
+    void listDirectory(const QString &directory, bool files);
+
+    void publish(vector<string> &batch, vector<string> &directories);
+
+    QThreadPool pool;
+
+    QMutex mutex;
+
+    vector<string> files;
+
+    vector<string> directories;
+
+    // Directories queued or being listed.
+    std::atomic<int> pending{0};
+
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // FOLDERSCANNER_H
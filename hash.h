@@ -0,0 +1,163 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// XXH64 (xxHash, 64-bit variant). Fast, well distributed and stable across
+// runs and platforms, so its values can be stored on disk.
+class Hash64
+{
+public:
+    explicit Hash64(uint64_t seed = 0)
+    {
+        v[0] = seed + Prime1 + Prime2;
+        v[1] = seed + Prime2;
+        v[2] = seed;
+        v[3] = seed - Prime1;
+        this->seed = seed;
+    }
+
+    void update(const void *data, size_t n)
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        total += n;
+
+        if(buffered + n < 32)
+        {
+            memcpy(buffer + buffered, p, n);
+            buffered += n;
+            return;
+        }
+
+        if(buffered > 0)
+        {
+            size_t fill = 32 - buffered;
+            memcpy(buffer + buffered, p, fill);
+            stripe(buffer);
+            p += fill;
+            n -= fill;
+            buffered = 0;
+        }
+
+        while(n >= 32)
+        {
+            stripe(p);
+            p += 32;
+            n -= 32;
+        }
+
+        memcpy(buffer, p, n);
+        buffered = n;
+    }
+
+    uint64_t digest() const
+    {
+        uint64_t h;
+        if(total >= 32)
+        {
+            h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+            for(int i = 0; i < 4; i++)
+                h = (h ^ round(0, v[i])) * Prime1 + Prime4;
+        }
+        else
+            h = seed + Prime5;
+
+        h += total;
+
+        const unsigned char *p = buffer;
+        size_t n = buffered;
+        while(n >= 8)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * Prime1 + Prime4;
+            p += 8;
+            n -= 8;
+        }
+        if(n >= 4)
+        {
+            h ^= uint64_t(read32(p)) * Prime1;
+            h = rotl(h, 23) * Prime2 + Prime3;
+            p += 4;
+            n -= 4;
+        }
+        while(n > 0)
+        {
+            h ^= *p * Prime5;
+            h = rotl(h, 11) * Prime1;
+            p++;
+            n--;
+        }
+
+        h ^= h >> 33;
+        h *= Prime2;
+        h ^= h >> 29;
+        h *= Prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static uint64_t of(const void *data, size_t n, uint64_t seed = 0)
+    {
+        Hash64 hash(seed);
+        hash.update(data, n);
+        return hash.digest();
+    }
+
+    static uint64_t of(const std::string &str, uint64_t seed = 0)
+    {
+        return of(str.data(), str.size(), seed);
+    }
+
+private:
+    static const uint64_t Prime1 = 11400714785074694791ULL;
+    static const uint64_t Prime2 = 14029467366897019727ULL;
+    static const uint64_t Prime3 = 1609587929392839161ULL;
+    static const uint64_t Prime4 = 9650029242287828579ULL;
+    static const uint64_t Prime5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static uint64_t read64(const unsigned char *p)
+    {
+        uint64_t x;
+        memcpy(&x, p, 8);
+        return x;
+    }
+
+    static uint32_t read32(const unsigned char *p)
+    {
+        uint32_t x;
+        memcpy(&x, p, 4);
+        return x;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * Prime2;
+        return rotl(acc, 31) * Prime1;
+    }
+
+    void stripe(const unsigned char *p)
+    {
+        for(int i = 0; i < 4; i++)
+            v[i] = round(v[i], read64(p + 8 * i));
+    }
+
+    uint64_t v[4];
+
+    uint64_t seed;
+
+    uint64_t total = 0;
+
+    unsigned char buffer[32];
+
+    size_t buffered = 0;
+};
+
+#endif // HASH_H
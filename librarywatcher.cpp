@@ -0,0 +1,294 @@
+#include "librarywatcher.h"
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <algorithm>
+#include <fstream>
+#include <unordered_map>
+#include "cuesheet.h"
+#include "folderscanner.h"
+#include "utils.h"
+
+namespace {
+
+// Notifications arriving within this window are handled together, so a
+// copy of a whole album costs one listing of its folder.
+const int DebounceMs = 500;
+
+bool isUnder(const string &location, const string &directory)
+{
+    return location.size() > directory.size() && location[directory.size()] == '/'
+           && location.compare(0, directory.size(), directory) == 0;
+}
+
+}
+
+LibraryWatcher::LibraryWatcher(Playlist *playlist, MetadataCache *cache, QObject *parent)
+    : QObject(parent)
+    , playlist(playlist)
+    , cache(cache)
+{
+    std::ifstream read("folders");
+    string folder;
+    while(getline(read, folder))
+    {
+        if(!folder.empty())
+            roots.append(QString::fromStdString(folder));
+    }
+
+    debounce.setSingleShot(true);
+    debounce.setInterval(DebounceMs);
+    pool.setMaxThreadCount(1);
+
+    connect(&watcher, SIGNAL(directoryChanged(QString)), this, SLOT(on_directoryChanged(QString)));
+    connect(&debounce, SIGNAL(timeout()), this, SLOT(on_flush()));
+    connect(this, SIGNAL(listed()), this, SLOT(on_listed()));
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+    pool.waitForDone();
+}
+
+QStringList LibraryWatcher::getRoots() const
+{
+    return roots;
+}
+
+void LibraryWatcher::addRoot(const QString &folder)
+{
+    if(roots.contains(folder))
+        return;
+
+    roots.append(folder);
+    std::ofstream write("folders");
+    for(const QString &root : roots)
+        write << root.toStdString() << std::endl;
+}
+
+void LibraryWatcher::watch(const vector<string> &directories)
+{
+    QStringList paths;
+    for(const string &directory : directories)
+    {
+        if(watched.insert(directory).second)
+            paths.append(QString::fromStdString(directory));
+    }
+    if(paths.isEmpty())
+        return;
+
+    // Fails for directories past the system's watch limit; those are simply
+    // not kept up to date.
+    for(const QString &path : watcher.addPaths(paths))
+        watched.erase(path.toStdString());
+}
+
+// Stops watching directory and everything below it, and returns those
+// directories (directory itself always included).
+vector<string> LibraryWatcher::unwatchTree(const string &directory)
+{
+    vector<string> removed(1, directory);
+    QStringList paths;
+    if(watched.erase(directory))
+        paths.append(QString::fromStdString(directory));
+
+    auto it = watched.lower_bound(directory + "/");
+    while(it != watched.end() && isUnder(*it, directory))
+    {
+        removed.push_back(*it);
+        paths.append(QString::fromStdString(*it));
+        it = watched.erase(it);
+    }
+
+    if(!paths.isEmpty())
+        watcher.removePaths(paths);
+    return removed;
+}
+
+void LibraryWatcher::on_directoryChanged(const QString &path)
+{
+    // The window is not restarted by later events, so a steady stream of
+    // changes is still picked up every DebounceMs.
+    dirty.insert(path.toStdString());
+    if(!debounce.isActive())
+        debounce.start();
+}
+
+void LibraryWatcher::on_flush()
+{
+    vector<string> directories(dirty.begin(), dirty.end());
+    dirty.clear();
+
+    pool.start([this, directories]() {
+        vector<Listing> batch;
+        for(const string &directory : directories)
+        {
+            Listing listing;
+            listing.directory = directory;
+
+            QString path = QString::fromStdString(directory);
+            listing.exists = QFileInfo(path).isDir();
+            if(listing.exists)
+            {
+                QDirIterator it(path, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+                while(it.hasNext())
+                {
+                    QString entry = it.next();
+                    QFileInfo info = it.fileInfo();
+                    if(info.isDir())
+                        listing.subdirectories.push_back(entry.toStdString());
+                    else if(CueSheet::isSheet(entry.toStdString()) || FolderScanner::isAudioFile(entry, info.suffix()))
+                    {
+                        listing.files.push_back(entry.toStdString());
+                        listing.stats[entry.toStdString()] = { info.size(), info.lastModified().toMSecsSinceEpoch() };
+                    }
+                }
+                CueSheet::expand(listing.files);
+            }
+            batch.push_back(std::move(listing));
+        }
+
+        {
+            QMutexLocker locker(&mutex);
+            for(Listing &listing : batch)
+                listings.push_back(std::move(listing));
+        }
+        emit listed();
+    });
+}
+
+void LibraryWatcher::on_listed()
+{
+    vector<Listing> taken;
+    {
+        QMutexLocker locker(&mutex);
+        taken.swap(listings);
+    }
+    if(taken.empty())
+        return;
+
+    // Directories that are gone, either reported themselves or missing from
+    // their parent's listing, lose every track and watch below them.
+    vector<string> gone;
+    for(const Listing &listing : taken)
+    {
+        if(!listing.exists)
+        {
+            gone.push_back(listing.directory);
+            continue;
+        }
+
+        unordered_set<string> subdirectories(listing.subdirectories.begin(), listing.subdirectories.end());
+        for(const string &subdirectory : listing.subdirectories)
+        {
+            if(!watched.count(subdirectory))
+                changes.newDirectories.append(QString::fromStdString(subdirectory));
+        }
+
+        // Watched children of this directory, skipping their subtrees:
+        // everything below child sorts between "child/" and "child0".
+        const string &directory = listing.directory;
+        auto it = watched.lower_bound(directory + "/");
+        while(it != watched.end() && isUnder(*it, directory))
+        {
+            size_t slash = it->find('/', directory.size() + 1);
+            if(slash == string::npos)
+            {
+                if(!subdirectories.count(*it))
+                    gone.push_back(*it);
+                ++it;
+            }
+            else
+                it = watched.lower_bound(it->substr(0, slash) + "0");
+        }
+    }
+
+    set<int> removed;
+    for(const string &directory : gone)
+    {
+        for(const string &below : unwatchTree(directory))
+        {
+            for(int i : playlist->tracksIn(below))
+                removed.insert(i);
+        }
+    }
+
+    // Compare every listed directory with the tracks the playlist has there.
+    vector<string> appeared;
+    for(const Listing &listing : taken)
+    {
+        if(!listing.exists)
+            continue;
+
+        unordered_set<string> files(listing.files.begin(), listing.files.end());
+        for(int i : playlist->tracksIn(listing.directory))
+        {
+            if(files.erase(playlist->tracks[i].getLocation()) == 0)
+                removed.insert(i);
+        }
+        for(const string &location : listing.files)
+        {
+            if(files.count(location) && playlist->indexOfLocation(location) == -1)
+                appeared.push_back(location);
+        }
+    }
+
+    // A new file with the name, size and mtime of a vanished one is taken
+    // to be that track, moved, so it keeps its id and history. A name alone
+    // is not enough: every album has its "01 - Intro.mp3". Tracks the
+    // metadata cache does not know yet cannot be told apart, so they are
+    // removed and added instead. A track of a cue sheet goes by the sheet.
+    unordered_map<string, pair<long long, long long>> stats;
+    for(const Listing &listing : taken)
+        stats.insert(listing.stats.begin(), listing.stats.end());
+
+    unordered_multimap<string, pair<int, pair<long long, long long>>> vanished;
+    for(int i : removed)
+    {
+        MetadataCache::Entry entry;
+        if(cache->find(playlist->tracks[i].getLocation(), entry) && entry.size >= 0)
+            vanished.emplace(getNameFromLocation(playlist->tracks[i].getLocation()),
+                             make_pair(i, make_pair(entry.size, entry.modified)));
+    }
+
+    std::sort(appeared.begin(), appeared.end());
+    for(const string &location : appeared)
+    {
+        string sheet;
+        int number;
+        auto stat = stats.find(CueSheet::split(location, sheet, number) ? sheet : location);
+
+        auto it = vanished.end();
+        auto range = vanished.equal_range(getNameFromLocation(location));
+        for(auto candidate = range.first; stat != stats.end() && candidate != range.second; ++candidate)
+        {
+            if(candidate->second.second == stat->second)
+            {
+                it = candidate;
+                break;
+            }
+        }
+        if(it != vanished.end())
+        {
+            changes.moved.emplace_back(it->second.first, location);
+            removed.erase(it->second.first);
+            vanished.erase(it);
+        }
+        else
+            changes.added.push_back(location);
+    }
+    changes.removed.insert(changes.removed.end(), removed.begin(), removed.end());
+
+    if(!changes.removed.empty() || !changes.moved.empty() || !changes.added.empty()
+       || !changes.newDirectories.isEmpty())
+        emit changed();
+}
+
+LibraryWatcher::Changes LibraryWatcher::takeChanges()
+{
+    Changes taken;
+    std::swap(taken, changes);
+    return taken;
+}
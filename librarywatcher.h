@@ -0,0 +1,112 @@
+#ifndef LIBRARYWATCHER_H
+#define LIBRARYWATCHER_H
+
+#include <QFileSystemWatcher>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "metadatacache.h"
+#include "playlist.h"
+
+using namespace std;
+
+// Keeps the playlist in step with the folders added through "Add folder".
+// Every directory under them is watched. Change notifications are collected
+// for a short window, the affected directories are listed again off the GUI
+// thread, and each listing is compared with the tracks the playlist holds
+// for that directory. The outcome is a minimal set of changes: files that
+// disappeared, files that appeared, and files that moved (a disappearance
+// and an appearance of the same file name, size and mtime within one
+// window; the last two as the metadata cache has them for the old one).
+class LibraryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Changes
+    {
+        vector<int> removed; // playlist indexes
+
+        vector<pair<int, string>> moved; // playlist index, new location
+
+        vector<string> added;
+
+        QStringList newDirectories; // to be walked and watched
+    };
+
+    LibraryWatcher(Playlist *playlist, MetadataCache *cache, QObject *parent = nullptr);
+
+    ~LibraryWatcher();
+
+    // Root folders, remembered in the "folders" file.
+    QStringList getRoots() const;
+
+    void addRoot(const QString &folder);
+
+    void watch(const vector<string> &directories);
+
+    Changes takeChanges();
+
+signals:
+    void changed();
+
+    void listed();
+
+private slots:
+    void on_directoryChanged(const QString &path);
+
+    void on_flush();
+
+    void on_listed();
+
+private:
+    struct Listing
+    {
+        string directory;
+
+        bool exists;
+
+        vector<string> files;
+
+        // Size and mtime (ms) of every file listed, cue sheets included.
+        unordered_map<string, pair<long long, long long>> stats;
+
+        vector<string> subdirectories;
+    };
+
+    vector<string> unwatchTree(const string &directory);
+
+    Playlist *playlist;
+
+    MetadataCache *cache;
+
+    QFileSystemWatcher watcher;
+
+    QTimer debounce;
+
+    QThreadPool pool;
+
+    QStringList roots;
+
+    // Ordered, so the directories below one are a contiguous range.
+    set<string> watched;
+
+    unordered_set<string> dirty;
+
+    Changes changes;
+
+    // Shared with the pool.
+    QMutex mutex;
+
+    vector<Listing> listings;
+};
+
+#endif // LIBRARYWATCHER_H
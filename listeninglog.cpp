@@ -0,0 +1,344 @@
+#include "listeninglog.h"
+#include <QDateTime>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Open log: "KPLT", version, first sequence number (u64), base time (u64),
+// then records of key (u64), delta (u32), event (u8), 0 (u8), position
+// (u16). Sealed file: blocks of "KPLB", count (u32), first sequence number
+// (u64), base time (u64), then the key, delta, event and position columns.
+// All little endian.
+const char TailMagic[4] = { 'K', 'P', 'L', 'T' };
+const char BlockMagic[4] = { 'K', 'P', 'L', 'B' };
+const quint32 Version = 1;
+const int HeaderSize = 24;
+const int RecordSize = 16;
+const int ColumnsSize = 8 + 4 + 1 + 2;
+
+}
+
+ListeningLog::ListeningLog(const QString &path)
+    : path(path)
+    , tail(path + ".log")
+{
+}
+
+ListeningLog::~ListeningLog()
+{
+    tail.close();
+}
+
+void ListeningLog::load()
+{
+    // Sealed blocks: only the key, delta and event columns are read.
+    QFile sealed(path);
+    if(sealed.open(QIODevice::ReadOnly))
+    {
+        QByteArray bytes = sealed.readAll();
+        const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+        qint64 size = bytes.size();
+        qint64 pos = 0;
+        while(pos + HeaderSize <= size && memcmp(data + pos, BlockMagic, 4) == 0)
+        {
+            quint32 count = qFromLittleEndian<quint32>(data + pos + 4);
+            if(pos + HeaderSize + qint64(count) * ColumnsSize > size)
+                break;
+
+            long long time = qFromLittleEndian<qint64>(data + pos + 16);
+            const uchar *keys = data + pos + HeaderSize;
+            const uchar *deltas = keys + 8 * qint64(count);
+            const uchar *events = deltas + 4 * qint64(count);
+            const uchar *positions = events + qint64(count);
+            for(quint32 i = 0; i < count; i++)
+            {
+                time += qFromLittleEndian<quint32>(deltas + 4 * i);
+                uint64_t key = qFromLittleEndian<quint64>(keys + 8 * i);
+                apply(key, events[i], time);
+                store(key, events[i], qFromLittleEndian<quint16>(positions + 2 * i), time);
+            }
+
+            next = qFromLittleEndian<qint64>(data + pos + 8) + count;
+            lastTime = time;
+            pos += HeaderSize + qint64(count) * ColumnsSize;
+        }
+
+        // A block torn by a crash while sealing is cut off, or the blocks
+        // sealed after it would be appended behind it and never read.
+        sealed.close();
+        if(pos < size)
+            QFile::resize(path, pos);
+    }
+
+    // The open log; records already sealed (if sealing was cut short) are
+    // skipped by sequence number.
+    tailFirst = next;
+    tailBase = lastTime;
+    if(tail.open(QIODevice::ReadOnly))
+    {
+        QByteArray bytes = tail.readAll();
+        tail.close();
+        const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+        if(bytes.size() >= HeaderSize && memcmp(data, TailMagic, 4) == 0
+           && qFromLittleEndian<quint32>(data + 4) == Version)
+        {
+            long long sequence = qFromLittleEndian<qint64>(data + 8);
+            long long time = qFromLittleEndian<qint64>(data + 16);
+            for(qint64 pos = HeaderSize; pos + RecordSize <= bytes.size(); pos += RecordSize, sequence++)
+            {
+                Record record;
+                record.key = qFromLittleEndian<quint64>(data + pos);
+                record.delta = qFromLittleEndian<quint32>(data + pos + 8);
+                record.event = data[pos + 12];
+                record.position = qFromLittleEndian<quint16>(data + pos + 14);
+                time += record.delta;
+                if(sequence < next)
+                    continue;
+
+                apply(record.key, record.event, time);
+                store(record.key, record.event, record.position, time);
+                pending.push_back(record);
+                next = sequence + 1;
+                lastTime = time;
+            }
+        }
+    }
+
+    // The open log is rewritten from pending rather than appended to.
+    if(pending.size() < size_t(BlockSize) || !seal())
+        openTail();
+}
+
+const ListeningLog::Stats &ListeningLog::record(Event event, uint64_t key, qint64 position)
+{
+    long long now = QDateTime::currentSecsSinceEpoch();
+    Record record;
+    record.key = key;
+    record.delta = uint32_t(std::min<long long>(std::max(0LL, now - lastTime), 0xffffffffLL));
+    record.event = uint8_t(event);
+    record.position = uint16_t(std::min<qint64>(std::max<qint64>(0, position / 1000), 0xffff));
+    lastTime += record.delta;
+
+    uchar bytes[RecordSize] = {};
+    qToLittleEndian<quint64>(record.key, bytes);
+    qToLittleEndian<quint32>(record.delta, bytes + 8);
+    bytes[12] = record.event;
+    qToLittleEndian<quint16>(record.position, bytes + 14);
+    if(tail.isOpen())
+    {
+        tail.write(reinterpret_cast<const char *>(bytes), RecordSize);
+        tail.flush();
+    }
+
+    pending.push_back(record);
+    next++;
+    if(pending.size() >= size_t(BlockSize))
+        seal();
+
+    apply(key, record.event, lastTime);
+    store(key, record.event, record.position, lastTime);
+    return stats[key];
+}
+
+const ListeningLog::Stats *ListeningLog::find(uint64_t key) const
+{
+    auto it = stats.find(key);
+    return it == stats.end() ? nullptr : &it->second;
+}
+
+long long ListeningLog::size() const
+{
+    return next;
+}
+
+void ListeningLog::apply(uint64_t key, uint8_t event, long long time)
+{
+    Stats &s = stats[key];
+    switch(event)
+    {
+    case Start:
+        s.starts++;
+        s.lastPlayed = time;
+        break;
+    case Skip:
+        s.skips++;
+        break;
+    case Complete:
+        s.completions++;
+        break;
+    case Seek:
+        s.seeks++;
+        break;
+    }
+}
+
+const vector<uint64_t> &ListeningLog::getTrackKeys() const
+{
+    return trackKeys;
+}
+
+void ListeningLog::store(uint64_t key, uint8_t event, uint16_t position, long long time)
+{
+    auto it = trackNumbers.find(key);
+    if(it == trackNumbers.end())
+    {
+        it = trackNumbers.emplace(key, uint32_t(trackKeys.size())).first;
+        trackKeys.push_back(key);
+    }
+
+    if(segments.empty() || segments.back().times.size() >= size_t(BlockSize))
+    {
+        segments.emplace_back();
+        segments.back().times.reserve(BlockSize);
+        segments.back().minTime = uint32_t(time);
+    }
+
+    Segment &segment = segments.back();
+    segment.times.push_back(uint32_t(time));
+    segment.tracks.push_back(it->second);
+    segment.events.push_back(event);
+    segment.positions.push_back(position);
+    segment.maxTime = uint32_t(time);
+}
+
+void ListeningLog::rowsIn(const Segment &segment, long long from, long long to, size_t &begin, size_t &end)
+{
+    // Zone map first: most segments are wholly inside or outside.
+    if(segment.maxTime < from || segment.minTime >= to)
+    {
+        begin = end = 0;
+        return;
+    }
+
+    begin = segment.minTime >= from ? 0
+            : size_t(std::lower_bound(segment.times.begin(), segment.times.end(), uint32_t(from)) - segment.times.begin());
+    end = segment.maxTime < to ? segment.times.size()
+          : size_t(std::lower_bound(segment.times.begin(), segment.times.end(), uint32_t(to)) - segment.times.begin());
+}
+
+vector<long long> ListeningLog::startsByGroup(long long from, long long to, const vector<int> &groupOfTrack,
+                                              int groups) const
+{
+    // One extra bucket takes the rows left out, so the loop has no branch.
+    vector<long long> counts(size_t(groups) + 1, 0);
+    long long *bucket = counts.data() + 1;
+    for(const Segment &segment : segments)
+    {
+        size_t begin, end;
+        rowsIn(segment, from, to, begin, end);
+
+        const uint32_t *tracks = segment.tracks.data();
+        const uint8_t *events = segment.events.data();
+        for(size_t r = begin; r < end; r++)
+        {
+            int group = tracks[r] < groupOfTrack.size() ? groupOfTrack[tracks[r]] : -1;
+            bucket[group] += events[r] == Start ? 1 : 0;
+        }
+    }
+    counts.erase(counts.begin());
+    return counts;
+}
+
+vector<long long> ListeningLog::secondsByWeekday(long long from, long long to, long long utcOffset) const
+{
+    vector<long long> seconds(7, 0);
+    for(const Segment &segment : segments)
+    {
+        size_t begin, end;
+        rowsIn(segment, from, to, begin, end);
+
+        // Rows are in time order, so each day is one run of rows, found by
+        // binary search; summing a run is a plain loop the compiler
+        // vectorises.
+        const uint32_t *times = segment.times.data();
+        const uint8_t *events = segment.events.data();
+        const uint16_t *positions = segment.positions.data();
+        while(begin < end)
+        {
+            long long day = (times[begin] + utcOffset) / 86400;
+            long long nextDay = (day + 1) * 86400 - utcOffset;
+            size_t dayEnd = nextDay > 0xffffffffLL ? end
+                            : size_t(std::lower_bound(times + begin, times + end, uint32_t(nextDay)) - times);
+
+            // Skip and Complete are adjacent, so one unsigned compare
+            // picks both.
+            uint32_t sum = 0;
+            for(size_t r = begin; r < dayEnd; r++)
+                sum += uint8_t(events[r] - Skip) <= uint8_t(Complete - Skip) ? positions[r] : 0;
+
+            // 1 January 1970 was a Thursday.
+            seconds[size_t((day + 3) % 7)] += sum;
+            begin = dayEnd;
+        }
+    }
+    return seconds;
+}
+
+bool ListeningLog::openTail()
+{
+    // The header is rewritten along with whatever is still pending, so a
+    // log cut off in the middle of a record is repaired here.
+    tail.close();
+    if(!tail.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QByteArray bytes(HeaderSize + int(pending.size()) * RecordSize, '\0');
+    uchar *out = reinterpret_cast<uchar *>(bytes.data());
+    memcpy(out, TailMagic, 4);
+    qToLittleEndian<quint32>(Version, out + 4);
+    qToLittleEndian<qint64>(tailFirst, out + 8);
+    qToLittleEndian<qint64>(tailBase, out + 16);
+    out += HeaderSize;
+    for(const Record &record : pending)
+    {
+        qToLittleEndian<quint64>(record.key, out);
+        qToLittleEndian<quint32>(record.delta, out + 8);
+        out[12] = record.event;
+        qToLittleEndian<quint16>(record.position, out + 14);
+        out += RecordSize;
+    }
+
+    bool ok = tail.write(bytes) == bytes.size();
+    tail.flush();
+    return ok;
+}
+
+bool ListeningLog::seal()
+{
+    quint32 count = quint32(pending.size());
+    QByteArray bytes(HeaderSize + int(count) * ColumnsSize, '\0');
+    uchar *out = reinterpret_cast<uchar *>(bytes.data());
+    memcpy(out, BlockMagic, 4);
+    qToLittleEndian<quint32>(count, out + 4);
+    qToLittleEndian<qint64>(tailFirst, out + 8);
+    qToLittleEndian<qint64>(tailBase, out + 16);
+
+    uchar *keys = out + HeaderSize;
+    uchar *deltas = keys + 8 * qint64(count);
+    uchar *events = deltas + 4 * qint64(count);
+    uchar *positions = events + qint64(count);
+    long long time = tailBase;
+    for(quint32 i = 0; i < count; i++)
+    {
+        qToLittleEndian<quint64>(pending[i].key, keys + 8 * i);
+        qToLittleEndian<quint32>(pending[i].delta, deltas + 4 * i);
+        events[i] = pending[i].event;
+        qToLittleEndian<quint16>(pending[i].position, positions + 2 * i);
+        time += pending[i].delta;
+    }
+
+    // The block goes in first: if writing it fails the records stay in
+    // the open log, and if the open log is not reset afterwards, loading
+    // skips the records the block already holds.
+    QFile sealed(path);
+    if(!sealed.open(QIODevice::WriteOnly | QIODevice::Append) || sealed.write(bytes) != bytes.size())
+        return false;
+    sealed.close();
+
+    tailFirst += count;
+    tailBase = time;
+    pending.clear();
+    return openTail();
+}
@@ -0,0 +1,135 @@
+#ifndef LISTENINGLOG_H
+#define LISTENINGLOG_H
+
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Everything that happens to a track while listening: starts, skips,
+// completions and seeks, appended to a log file as fixed 16-byte records
+// (location key, seconds since the previous event, event, position).
+// Every BlockSize records the open log is sealed into a block of the main
+// file, stored column by column, and started afresh. Per-track statistics
+// are kept up to date as events come in, so nothing is ever recomputed;
+// at startup they are rebuilt from the key and event columns only.
+//
+// For analytics the whole history is also held in memory as segments of
+// BlockSize events, column by column, with tracks numbered densely. Time
+// only grows, so each segment's zone map (first and last time) tells
+// whether it lies inside, outside or across a queried range; only the
+// segments across it are searched, by binary search on the time column,
+// and the aggregation kernels run over plain contiguous row ranges.
+class ListeningLog
+{
+public:
+    enum Event { Start, Skip, Complete, Seek };
+
+    struct Stats
+    {
+        int starts = 0;
+
+        int skips = 0;
+
+        int completions = 0;
+
+        int seeks = 0;
+
+        long long lastPlayed = 0; // seconds since the epoch
+    };
+
+    static const int BlockSize = 4096;
+
+    ListeningLog(const QString &path);
+
+    ~ListeningLog();
+
+    void load();
+
+    // position in milliseconds.
+    const Stats &record(Event event, uint64_t key, qint64 position);
+
+    const Stats *find(uint64_t key) const;
+
+    long long size() const;
+
+    // Location keys of the tracks events refer to; the track numbers the
+    // analytics use index this.
+    const vector<uint64_t> &getTrackKeys() const;
+
+    // Starts within [from, to) per group, where groupOfTrack maps a track
+    // number to its group, or -1 to leave it out.
+    vector<long long> startsByGroup(long long from, long long to, const vector<int> &groupOfTrack, int groups) const;
+
+    // Seconds listened within [from, to) per day of the week (0 is
+    // Monday), in the time zone utcOffset seconds from UTC. Taken from
+    // where skips and completions happened.
+    vector<long long> secondsByWeekday(long long from, long long to, long long utcOffset) const;
+
+private:
+    struct Segment
+    {
+        uint32_t minTime = 0;
+
+        uint32_t maxTime = 0;
+
+        vector<uint32_t> times;
+
+        vector<uint32_t> tracks;
+
+        vector<uint8_t> events;
+
+        vector<uint16_t> positions;
+    };
+
+    // Row range of segment within [from, to).
+    static void rowsIn(const Segment &segment, long long from, long long to, size_t &begin, size_t &end);
+
+    void store(uint64_t key, uint8_t event, uint16_t position, long long time);
+
+    struct Record
+    {
+        uint64_t key;
+
+        uint32_t delta;
+
+        uint8_t event;
+
+        uint16_t position; // seconds
+    };
+
+    void apply(uint64_t key, uint8_t event, long long time);
+
+    bool openTail();
+
+    bool seal();
+
+    QString path;
+
+    QFile tail;
+
+    // Sequence number of the next event, and of the first one in tail.
+    long long next = 0;
+
+    long long tailFirst = 0;
+
+    // Time of the last event, and of the one before the first in tail.
+    long long lastTime = 0;
+
+    long long tailBase = 0;
+
+    vector<Record> pending;
+
+    unordered_map<uint64_t, Stats> stats;
+
+    vector<Segment> segments;
+
+    vector<uint64_t> trackKeys;
+
+    unordered_map<uint64_t, uint32_t> trackNumbers;
+};
+
+#endif // LISTENINGLOG_H
@@ -1,11 +1,16 @@
-#include "mainwindow.h"
-
-#include <QApplication>
-
-int main(int argc, char *argv[])
-{
-    QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
-    return a.exec();
-}
+#include "mainwindow.h"
+
+#include <QApplication>
+
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    MainWindow w;
+    w.show();
+
+    // Files given on the command line are added and played.
+    QStringList files = a.arguments();
+    files.removeFirst();
+    w.openFiles(files);
+    return a.exec();
+}
@@ -1,340 +1,1816 @@
-#define _HAS_AUTO_PTR_ETC 1
-
-#include "mainwindow.h"
-#include "ui_mainwindow.h"
-#include <QFileDialog>
-#include <QDesktopServices>
-#include <algorithm>
-#include <iostream>
-#include <string>
-
-
-MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent)
-    , ui(new Ui::MainWindow)
-{
-    ui->setupUi(this);
-
-    player = new QMediaPlayer(this);
-
-    audioOutput = new QAudioOutput(this);
-
-    player->setAudioOutput(audioOutput);
-
-    connect(player, SIGNAL(positionChanged(qint64)), this, SLOT(on_positionChanged(qint64)));
-
-    connect(player, SIGNAL(durationChanged(qint64)), this, SLOT(on_durationChanged(qint64)));
-
-    connect(player, SIGNAL(valueChanged(qint64)), this,  SLOT(on_volumeSlider_valueChanged(int)));
-
-    connect(audioOutput, SIGNAL(volumeChanged(float)), this, SLOT(on_volumeChanged(qint64)));
-
-    audioOutput->setVolume(100);
-
-    this->setFixedSize(this->geometry().width(),this->geometry().height());
-
-    updateList();
-
-    connect(updater, SIGNAL(timeout()), this, SLOT(update()));
-
-    ui->listWidget->setCurrentRow(0);
-
-    if(ui->listWidget->count() != 0){
-        loadTrack();
-        player->pause();
-        updater->start();
-
-    }
-
-    this->setWindowTitle("KPlay");
-}
-
-MainWindow::~MainWindow()
-{
-    delete ui;
-}
-
-void MainWindow::on_playButton_clicked()
-{
-    if(ui->listWidget->count() != 0){
-        if(player->playbackState() == QMediaPlayer::PlayingState)
-        {
-            player->pause();
-            ui->playButton->setText(">");
-        }
-        else
-        {
-            player->play();
-            ui->playButton->setText("||");
-            updater->start();
-        }
-   }
-}
-
-void MainWindow::on_nextButton_clicked()
-{
-    if(ui->listWidget->count() != 0)
-    {
-       if(repeat)
-       {
-           repeat = !repeat;
-           next();
-           repeat = !repeat;
-       }
-       else
-       {
-           next();
-       }
-    }
-}
-
-
-void MainWindow::on_backButton_clicked()
-{
-    if(ui->listWidget->count() != 0)
-    {
-       if(player->position() > 3000)
-       {
-          player->setPosition(0);
-       }
-       else
-       {
-           back();
-       }
-    }
-}
-
-
-void MainWindow::on_volumeSlider_valueChanged(int value)
-{
-    audioOutput->setVolume(float(value)/100);
-}
-
-
-void MainWindow::on_progressSlider_sliderMoved(int position)
-{
-    player->setPosition(position);
-}
-
-
-void MainWindow::on_positionChanged(qint64 position)
-{
-    ui->progressSlider->setValue(position);
-}
-
-
-void MainWindow::on_durationChanged(qint64 position)
-{
-    ui->progressSlider->setMaximum(position);
-}
-
-
-void MainWindow::on_volumeChanged(qint64 position)
-{
-    ui->volumeSlider->setMaximum(position);
-}
-
-void MainWindow::on_shuffleButton_clicked()
-{
-    shuffle = !shuffle;
-    if(shuffle)
-        shufflePlaylist();
-}
-
-
-void MainWindow::on_repeatButton_clicked()
-{
-    repeat = !repeat;
-}
-
-void MainWindow::on_listWidget_doubleClicked()
-{
-    lCounter = getIndex();
-
-    ui->playButton->setChecked(false);
-    ui->searchBar->clear();
-
-    loadTrack();
-    player->play();
-    ui->playButton->setText("||");
-}
-
-void MainWindow::update()
-{   if(!ui->progressSlider->isSliderDown())
-        ui->progressSlider->setValue((double)player->position());
-
-    if(player->playbackState() == QMediaPlayer::StoppedState)
-    {
-        next();
-    }
-}
-
-
-void MainWindow::updateList()
-{
-    ui->listWidget->clear();
-    ui->listWidget->addItems(playlist.getTracksNameList());
-}
-
-
-int MainWindow::getIndex()
-{
-    return ui->listWidget->currentIndex().row();
-}
-
-
-void MainWindow::keyPressEvent(QKeyEvent *event)
-{
-    switch (event->key()) {
-    case Qt::Key_Return :
-    {
-        lCounter = getIndex();
-        if(lCounter != -1)
-        {
-            ui->playButton->setChecked(false);
-            ui->searchBar->clear();
-
-           loadTrack();
-           player->play();
-           ui->playButton->setText("||");
-        }
-        break;
-    }
-    case Qt::Key_Up :
-    {
-        int ind = getIndex() - 1;if(ind < 0)ind = ui->listWidget->count() - 1;
-        ui->listWidget->setCurrentRow(ind);
-        break;
-    }
-    case Qt::Key_Down :
-    {
-        int ind = getIndex() + 1;if(ind >= ui->listWidget->count())ind = 0;
-        ui->listWidget->setCurrentRow(ind);
-        break;
-    }
-    case Qt::Key_Space :
-        player->play();
-        ui->playButton->setText("||");
-    default :
-    {
-        ui->searchBar->setFocus();
-
-        break;
-    }
-    }
-}
-
-
-void MainWindow::next()
-{
-    lCounter++;
-
-    if(repeat)
-    {
-        lCounter--;
-    }
-
-    if(lCounter >= ui->listWidget->count())
-        lCounter = 0;
-
-    (!shuffle or repeat) ? ui->listWidget->setCurrentRow(lCounter) : ui->listWidget->setCurrentRow(shuffledPlaylist[lCounter]);
-
-    ui->playButton->setChecked(false);
-    ui->searchBar->clear();
-
-    loadTrack();
-    player->play();
-    ui->playButton->setText("||");
-
-}
-
-
-void MainWindow::back()
-{
-     lCounter--;
-
-     if(lCounter < 0)
-        lCounter = ui->listWidget->count() - 1;
-
-
-     (!shuffle) ? ui->listWidget->setCurrentRow(lCounter) : ui->listWidget->setCurrentRow(shuffledPlaylist[lCounter]);
-
-     ui->playButton->setChecked(false);
-     ui->searchBar->clear();
-
-     loadTrack();
-     player->play();
-     ui->playButton->setText("||");
-}
-
-
-void MainWindow::shufflePlaylist()
-{
-    shuffledPlaylist.resize(0);
-
-    for(int i = 0; i < ui->listWidget->count(); i++)
-    {
-        shuffledPlaylist.push_back(i);
-    }
-
-    random_shuffle(shuffledPlaylist.begin(), shuffledPlaylist.end());
-}
-
-
-void MainWindow::loadTrack()
-{
-     QString qstr = QString::fromStdString(playlist.tracks[getIndex()].getLocation());
-     player->setSource(QUrl::fromLocalFile(qstr));
-     qstr = QString::fromStdString(playlist.tracks[getIndex()].getName());
-     ui->songName->setText(qstr);
-}
-
-
-void MainWindow::on_searchBar_textChanged(const QString &arg1)
-{
-    if(ui->searchBar->text().toStdString() != "")
-    for(int i = 0; i < ui->listWidget->count(); i++)
-    {
-        if(ui->listWidget->item(i)->text().toLower().toStdString().find(arg1.toLower().toStdString()) != string::npos )
-        {
-            ui->listWidget->setCurrentRow(i);
-            break;
-        }
-    }
-}
-
-void MainWindow::on_actionSave_triggered()
-{
-    playlist.save();
-    ui->actionSave->setChecked(true);
-}
-
-
-void MainWindow::on_actionRemove_triggered()
-{
-    int index = getIndex();
-    if(index != -1)
-    {
-       playlist.remove(index);
-       updateList();
-       ui->listWidget->setCurrentRow(index);
-       ui->actionSave->setChecked(false);
-       if(shuffle) shufflePlaylist();
-    }
-}
-
-
-void MainWindow::on_actionAdd_2_triggered()
-{
-    bool startUpdater = false;if(ui->listWidget->count() == 0) startUpdater = true;
-      QStringList files = QFileDialog::getOpenFileNames(this, tr("Select Music Files"));
-      if(!files.empty())
-      {
-          playlist.add(files);
-          updateList();
-          ui->actionSave->setChecked(false);
-          if(shuffle) shufflePlaylist();
-          if(startUpdater) updater->start();
-      }
-}
-
+#include "mainwindow.h"
+#include "ui_mainwindow.h"
+#include <QFileDialog>
+#include <QInputDialog>
+#include <QDateTime>
+#include <QDesktopServices>
+#include <QElapsedTimer>
+#include <QMessageBox>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "cuesheet.h"
+#include "hash.h"
+#include "utils.h"
+
+namespace {
+
+// How far the player may be from where a track starts in the file it has
+// open and still carry on without a seek.
+const qint64 GaplessSlack = 250;
+
+// Positions are reported several times a second, so the first one past the
+// end of a cue sheet track comes within this.
+const qint64 EndWindow = 1000;
+
+}
+
+
+MainWindow::MainWindow(QWidget *parent)
+    : QMainWindow(parent)
+    , ui(new Ui::MainWindow)
+{
+    ui->setupUi(this);
+
+    player = new QMediaPlayer(this);
+
+    audioOutput = new QAudioOutput(this);
+
+    player->setAudioOutput(audioOutput);
+
+    connect(player, SIGNAL(positionChanged(qint64)), this, SLOT(on_positionChanged(qint64)));
+
+    connect(player, SIGNAL(durationChanged(qint64)), this, SLOT(on_durationChanged(qint64)));
+
+    connect(player, SIGNAL(valueChanged(qint64)), this,  SLOT(on_volumeSlider_valueChanged(int)));
+
+    connect(audioOutput, SIGNAL(volumeChanged(float)), this, SLOT(on_volumeChanged(qint64)));
+
+    connect(player, SIGNAL(playbackStateChanged(QMediaPlayer::PlaybackState)), this, SLOT(on_playbackStateChanged()));
+
+    connect(player, SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)), this, SLOT(on_mediaStatusChanged()));
+
+    audioOutput->setVolume(100);
+
+    this->setFixedSize(this->geometry().width(),this->geometry().height());
+
+    model = new TrackListModel(&playlist, this);
+    ui->listView->setModel(model);
+
+    covers = new CoverArt("covers", this);
+    connect(covers, SIGNAL(artReady()), this, SLOT(on_artReady()));
+    model->setCoverArt(covers);
+    ui->listView->setIconSize(QSize(24, 24));
+
+    scanner = new TagScanner(this);
+    folderScanner = new FolderScanner(this);
+    connect(folderScanner, SIGNAL(filesFound()), this, SLOT(on_filesFound()));
+    connect(folderScanner, SIGNAL(finished()), this, SLOT(on_folderScanned()));
+
+    playlistFile = new PlaylistFile(this);
+    connect(playlistFile, SIGNAL(locationsFound()), this, SLOT(on_playlistRead()));
+    connect(playlistFile, SIGNAL(finished()), this, SLOT(on_playlistImported()));
+    connect(playlistFile, SIGNAL(entriesWanted()), this, SLOT(on_exportWanted()));
+    connect(playlistFile, SIGNAL(written(bool)), this, SLOT(on_playlistWritten(bool)));
+
+    // Watches are set up again for the folders added in earlier sessions.
+    libraryWatcher = new LibraryWatcher(&playlist, &cache, this);
+    connect(libraryWatcher, SIGNAL(changed()), this, SLOT(on_libraryChanged()));
+    for(const QString &root : libraryWatcher->getRoots())
+        folderScanner->scan(root, false);
+
+    duplicateFinder = new DuplicateFinder(this);
+    connect(duplicateFinder, SIGNAL(finished()), this, SLOT(on_duplicatesFound()));
+
+    fingerprintScanner = new FingerprintScanner("fingerprints", this);
+    connect(fingerprintScanner, SIGNAL(progress(int,int)), this, SLOT(on_fingerprintProgress(int,int)));
+    connect(fingerprintScanner, SIGNAL(finished()), this, SLOT(on_similarFound()));
+
+    tempoScanner = new TempoScanner(this);
+    connect(tempoScanner, SIGNAL(resultsReady()), this, SLOT(on_tempoFound()));
+
+    connect(scanner, SIGNAL(resultsReady()), this, SLOT(on_tagsRead()));
+    listening.load();
+    scanTags(0);
+    smartPlaylists.load(playlist);
+    namedPlaylists.load(playlist);
+    if(namedPlaylists.getActive() != -1)
+        model->setOrder(&namedPlaylists.getIds(namedPlaylists.getActive()));
+
+    // Files can go away without the watcher seeing it (an unmounted drive,
+    // a folder that was never imported), so the playlist is checked now
+    // and every few minutes.
+    trackChecker = new TrackChecker(this);
+    connect(trackChecker, SIGNAL(resultsReady()), this, SLOT(on_tracksChecked()));
+    connect(checkTimer, SIGNAL(timeout()), this, SLOT(checkTracks()));
+    connect(checkTimer, SIGNAL(timeout()), this, SLOT(checkDay()));
+    checkTimer->start(10 * 60 * 1000);
+    checkTracks();
+
+    connect(updater, SIGNAL(timeout()), this, SLOT(update()));
+
+    connect(ui->menuPlaylists, SIGNAL(aboutToShow()), this, SLOT(updatePlaylistsMenu()));
+
+    selectRow(0);
+
+    // Earlier sessions' history, as far as its tracks are still here.
+    std::vector<uint64_t> keys = history.loadKeys();
+    if(!keys.empty())
+    {
+        std::unordered_map<uint64_t, unsigned int> ids;
+        for(Track &track : playlist.tracks)
+            ids[Hash64::of(track.getLocation())] = track.getId();
+        for(uint64_t key : keys)
+        {
+            auto it = ids.find(key);
+            if(it != ids.end())
+                history.restore(it->second);
+        }
+    }
+
+    // Come back to the track that was playing last time.
+    int current = getIndex();
+    std::ifstream read("playing");
+    string playing;
+    if(getline(read, playing))
+    {
+        int index = playlist.indexOfLocation(playing);
+        if(index != -1)
+        {
+            lCounter = index;
+            selectTrack(index);
+            current = index;
+        }
+    }
+
+    std::ifstream readQueue("queue");
+    string queued;
+    while(getline(readQueue, queued))
+    {
+        int index = playlist.indexOfLocation(queued);
+        if(index != -1)
+            queue.enqueue(playlist.tracks[index].getId());
+    }
+
+    if(current != -1){
+        loadTrack(current);
+        player->pause();
+        updater->start();
+
+    }
+
+    updateTitle();
+}
+
+MainWindow::~MainWindow()
+{
+    int index = playlist.indexOf(unsigned(playingId));
+    if(index != -1)
+    {
+        std::ofstream write("playing");
+        write << playlist.tracks[index].getLocation() << std::endl;
+    }
+
+    // Ids are handed out afresh every session, so the queue is kept as
+    // locations, like the playlist.
+    std::ofstream writeQueue("queue");
+    for(unsigned int id : queue.getIds())
+    {
+        int queued = playlist.indexOf(id);
+        if(queued != -1)
+            writeQueue << playlist.tracks[queued].getLocation() << '\n';
+    }
+
+    namedPlaylists.setState(namedPlaylists.getActive(), lCounter, shuffleOrder.getSeed());
+    namedPlaylists.save(playlist);
+
+    cache.save();
+    delete ui;
+}
+
+void MainWindow::on_playButton_clicked()
+{
+    if(trackCount() != 0){
+        if(player->playbackState() == QMediaPlayer::PlayingState)
+        {
+            player->pause();
+            ui->playButton->setText(">");
+        }
+        else
+        {
+            player->play();
+            ui->playButton->setText("||");
+            updater->start();
+        }
+   }
+}
+
+void MainWindow::on_nextButton_clicked()
+{
+    if(trackCount() != 0)
+    {
+       // Moving on before the middle of a track counts against it, if it
+       // was ever started: the track restored at startup is only loaded.
+       if(startLogged && trackDuration() > 0 && trackPosition() < trackDuration() / 2)
+           logEvent(ListeningLog::Skip);
+
+       if(repeat)
+       {
+           repeat = !repeat;
+           next();
+           repeat = !repeat;
+       }
+       else
+       {
+           next();
+       }
+    }
+}
+
+
+void MainWindow::on_backButton_clicked()
+{
+    if(trackCount() != 0)
+    {
+       if(trackPosition() > 3000)
+       {
+          player->setPosition(segmentStart);
+       }
+       else
+       {
+           back();
+       }
+    }
+}
+
+
+void MainWindow::on_volumeSlider_valueChanged(int value)
+{
+    audioOutput->setVolume(float(value)/100);
+}
+
+
+void MainWindow::on_progressSlider_sliderMoved(int position)
+{
+    player->setPosition(segmentStart + position);
+}
+
+
+void MainWindow::on_progressSlider_sliderReleased()
+{
+    logEvent(ListeningLog::Seek);
+}
+
+
+void MainWindow::on_playbackStateChanged()
+{
+    // A track counts as started the first time it actually plays, not
+    // when it is loaded (at startup it is loaded paused).
+    if(player->playbackState() == QMediaPlayer::PlayingState && !startLogged)
+    {
+        startLogged = true;
+        logEvent(ListeningLog::Start);
+    }
+}
+
+
+void MainWindow::on_mediaStatusChanged()
+{
+    // A seek into a file the player has only just been given waits until
+    // the file is loaded.
+    QMediaPlayer::MediaStatus status = player->mediaStatus();
+    if(pendingSeek != -1 && (status == QMediaPlayer::LoadedMedia || status == QMediaPlayer::BufferedMedia))
+    {
+        player->setPosition(pendingSeek);
+        pendingSeek = -1;
+    }
+
+    // Tempo analysis decodes files too, so it waits while the player is
+    // short of data.
+    tempoScanner->setPaused(status == QMediaPlayer::LoadingMedia || status == QMediaPlayer::StalledMedia);
+}
+
+
+void MainWindow::logEvent(ListeningLog::Event event)
+{
+    int index = playlist.indexOf(unsigned(playingId));
+    if(index == -1)
+        return;
+
+    const ListeningLog::Stats &stats = listening.record(event, Hash64::of(playlist.tracks[index].getLocation()),
+                                                        trackPosition());
+    playlist.setStats(index, stats.starts, stats.skips, stats.lastPlayed);
+    tracksChanged({ index }, TrackColumns::bit(TrackColumns::Plays) | TrackColumns::bit(TrackColumns::Skips)
+                             | TrackColumns::bit(TrackColumns::SkipRate) | TrackColumns::bit(TrackColumns::LastPlayed));
+}
+
+
+void MainWindow::on_positionChanged(qint64 position)
+{
+    // The image of a cue sheet plays on past the end of a track, into the
+    // next one; that is where the next track takes over. Positions from
+    // before a seek can still arrive after it, so one far past the end, or
+    // that the player has left, is not taken for it.
+    if(segmentEnd >= 0 && position >= segmentEnd && position < segmentEnd + EndWindow
+       && player->position() >= segmentEnd && pendingSeek == -1)
+    {
+        logEvent(ListeningLog::Complete);
+        next();
+        return;
+    }
+    ui->progressSlider->setValue(int(trackPosition()));
+}
+
+
+void MainWindow::on_durationChanged(qint64 position)
+{
+    if(position > 0)
+        ui->progressSlider->setMaximum(int(trackDuration()));
+}
+
+
+qint64 MainWindow::trackPosition()
+{
+    return std::max<qint64>(0, player->position() - segmentStart);
+}
+
+
+qint64 MainWindow::trackDuration()
+{
+    qint64 end = segmentEnd >= 0 ? segmentEnd : player->duration();
+    return std::max<qint64>(0, end - segmentStart);
+}
+
+
+void MainWindow::on_volumeChanged(qint64 position)
+{
+    ui->volumeSlider->setMaximum(position);
+}
+
+void MainWindow::on_shuffleButton_clicked()
+{
+    shuffle = !shuffle;
+    if(shuffle)
+    {
+        shufflePlaylist(std::random_device()());
+    }
+    else
+    {
+        shuffleOrder.clear();
+        lCounter = std::max(0, orderIndexOf(playlist.indexOf(unsigned(playingId))));
+    }
+}
+
+
+void MainWindow::on_repeatButton_clicked()
+{
+    repeat = !repeat;
+}
+
+void MainWindow::on_listView_doubleClicked()
+{
+    lCounter = getIndex();
+
+    ui->playButton->setChecked(false);
+    ui->searchBar->clear();
+    selectTrack(lCounter);
+
+    loadTrack(lCounter);
+    player->play();
+    ui->playButton->setText("||");
+}
+
+void MainWindow::update()
+{   if(!ui->progressSlider->isSliderDown())
+        ui->progressSlider->setValue(int(trackPosition()));
+
+    if(player->playbackState() == QMediaPlayer::StoppedState)
+    {
+        if(player->mediaStatus() == QMediaPlayer::EndOfMedia)
+            logEvent(ListeningLog::Complete);
+        next();
+    }
+}
+
+
+void MainWindow::selectRow(int row)
+{
+    ui->listView->setCurrentIndex(model->index(row));
+}
+
+
+void MainWindow::selectTrack(int index)
+{
+    selectRow(model->rowOf(index));
+}
+
+
+int MainWindow::trackCount()
+{
+    return int(playlist.tracks.size());
+}
+
+
+void MainWindow::scanTags(int first)
+{
+    std::vector<int> indexes;
+    for(int i = first; i < trackCount(); i++)
+        indexes.push_back(i);
+    scanTags(indexes);
+}
+
+
+void MainWindow::scanTags(const std::vector<int> &indexes)
+{
+    // Cached metadata is shown right away without touching the files; the
+    // scanner then only re-reads files whose size or mtime changed.
+    std::vector<TagScanner::Job> jobs;
+    std::vector<TempoScanner::Job> unanalysed;
+    std::vector<int> cached;
+    for(int i : indexes)
+    {
+        TagScanner::Job job;
+        job.id = playlist.tracks[i].getId();
+        job.location = playlist.tracks[i].getLocation();
+
+        MetadataCache::Entry entry;
+        if(cache.find(job.location, entry))
+        {
+            playlist.setInfo(i, entry.info);
+            cached.push_back(i);
+            job.size = entry.size;
+            job.modified = entry.modified;
+            if(entry.info.bpm == 0)
+                unanalysed.push_back({ job.id, job.location });
+        }
+
+        const ListeningLog::Stats *stats = listening.find(Hash64::of(job.location));
+        if(stats)
+            playlist.setStats(i, stats->starts, stats->skips, stats->lastPlayed);
+        jobs.push_back(job);
+    }
+
+    model->tracksChanged(cached);
+    updateStatus();
+    scanner->scan(jobs);
+    tempoScanner->add(unanalysed);
+}
+
+
+void MainWindow::updateStatus()
+{
+    long long seconds = playlist.getTotalDuration() / 1000;
+    QString status = QString("%1 tracks, %2:%3:%4").arg(trackCount()).arg(seconds / 3600)
+                     .arg(seconds / 60 % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+    if(!queue.isEmpty())
+        status += QString(", %1 queued").arg(queue.size());
+    if(folderScanner->isScanning() || importList != -1)
+        status += ", importing...";
+    ui->statusbar->showMessage(status);
+}
+
+void MainWindow::updateCover()
+{
+    int index = playlist.indexOf(unsigned(playingId));
+    QImage image;
+    if(index != -1)
+        image = covers->find(unsigned(playingId), playlist.tracks[index].getLocation());
+
+    if(image.isNull())
+        ui->coverArt->clear();
+    else
+        ui->coverArt->setPixmap(QPixmap::fromImage(image));
+}
+
+
+int MainWindow::getIndex()
+{
+    return model->trackIndex(ui->listView->currentIndex().row());
+}
+
+
+void MainWindow::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+    case Qt::Key_Return :
+    {
+        lCounter = getIndex();
+        if(lCounter != -1)
+        {
+            ui->playButton->setChecked(false);
+            ui->searchBar->clear();
+            selectTrack(lCounter);
+
+           loadTrack(lCounter);
+           player->play();
+           ui->playButton->setText("||");
+        }
+        break;
+    }
+    case Qt::Key_Up :
+    {
+        int ind = ui->listView->currentIndex().row() - 1;if(ind < 0)ind = model->rowCount() - 1;
+        selectRow(ind);
+        break;
+    }
+    case Qt::Key_Down :
+    {
+        int ind = ui->listView->currentIndex().row() + 1;if(ind >= model->rowCount())ind = 0;
+        selectRow(ind);
+        break;
+    }
+    case Qt::Key_Space :
+        player->play();
+        ui->playButton->setText("||");
+    default :
+    {
+        ui->searchBar->setFocus();
+
+        break;
+    }
+    }
+}
+
+
+void MainWindow::next()
+{
+    // After going back, next walks forward through the history again.
+    unsigned int played;
+    while(!repeat && history.forward(played))
+    {
+        int index = playlist.indexOf(played);
+        if(index != -1 && isPlayable(index))
+        {
+            playFromHistory(index);
+            return;
+        }
+    }
+
+    // Queued tracks come first; the playlist or shuffle order then carries
+    // on from where it was.
+    unsigned int queued;
+    while(!repeat && queue.dequeue(queued))
+    {
+        int index = playlist.indexOf(queued);
+        if(index == -1 || !isPlayable(index))
+            continue;
+
+        int position = lCounter;
+        ui->playButton->setChecked(false);
+        ui->searchBar->clear();
+        selectTrack(index);
+        loadTrack(index);
+        lCounter = position;
+        player->play();
+        ui->playButton->setText("||");
+        updateStatus();
+        return;
+    }
+
+    // Tracks found missing or unreadable are passed over, unless there is
+    // nothing else left to play.
+    for(int tries = 0; tries < positionCount(); tries++)
+    {
+        lCounter++;
+
+        if(repeat && tries == 0)
+        {
+            lCounter--;
+        }
+
+        if(lCounter >= positionCount())
+            lCounter = 0;
+
+        if(isPlayable(trackAt(lCounter)))
+            break;
+    }
+
+    if(trackAt(lCounter) == -1)
+        return;
+
+    ui->playButton->setChecked(false);
+    ui->searchBar->clear();
+
+    selectTrack(trackAt(lCounter));
+
+    loadTrack(trackAt(lCounter));
+    player->play();
+    ui->playButton->setText("||");
+
+}
+
+
+void MainWindow::back()
+{
+     // Back goes to what was actually played before, whatever the order;
+     // the order is only walked backwards past the start of the history.
+     unsigned int played;
+     while(history.back(played))
+     {
+         int index = playlist.indexOf(played);
+         if(index != -1 && isPlayable(index))
+         {
+             playFromHistory(index);
+             return;
+         }
+     }
+
+     for(int tries = 0; tries < positionCount(); tries++)
+     {
+         lCounter--;
+
+         if(lCounter < 0)
+            lCounter = positionCount() - 1;
+
+         if(isPlayable(trackAt(lCounter)))
+             break;
+     }
+
+     if(trackAt(lCounter) == -1)
+         return;
+
+     ui->playButton->setChecked(false);
+     ui->searchBar->clear();
+
+     selectTrack(trackAt(lCounter));
+
+     loadTrack(trackAt(lCounter));
+     player->play();
+     ui->playButton->setText("||");
+}
+
+
+void MainWindow::playFromHistory(int index)
+{
+    ui->playButton->setChecked(false);
+    ui->searchBar->clear();
+    selectTrack(index);
+
+    walkingHistory = true;
+    loadTrack(index);
+    walkingHistory = false;
+
+    player->play();
+    ui->playButton->setText("||");
+}
+
+
+void MainWindow::shufflePlaylist(uint64_t seed)
+{
+    if(ui->actionBalancedShuffle->isChecked())
+    {
+        shuffleBalanced(seed);
+        return;
+    }
+
+    // The track playing now is where the new order is picked up; the
+    // ones before it come round after the end.
+    shuffleOrder.shuffle(orderSize(), seed);
+    lCounter = std::max(0, shuffleOrder.positionOfIndex(orderIndexOf(playlist.indexOf(unsigned(playingId)))));
+}
+
+
+void MainWindow::shuffleBalanced(uint64_t seed)
+{
+    // Artists and albums are told apart case-insensitively; untagged files
+    // are grouped by the folder they are in.
+    const std::vector<string> &artistNames = playlist.columns.text(TrackColumns::Artist);
+    const std::vector<string> &albumNames = playlist.columns.text(TrackColumns::Album);
+    std::vector<unsigned int> ids;
+    std::vector<uint64_t> artists, albums;
+    for(int position = 0; position < orderSize(); position++)
+    {
+        int i = trackInOrder(position);
+        if(i == -1)
+            continue;
+
+        string directory = getDirectoryFromLocation(playlist.tracks[i].getLocation());
+        string artist = toLowerUtf8(artistNames[i].empty() ? directory : artistNames[i]);
+        uint64_t artistKey = Hash64::of(artist);
+
+        string album = toLowerUtf8(albumNames[i].empty() ? directory : albumNames[i]);
+
+        ids.push_back(playlist.tracks[i].getId());
+        artists.push_back(artistKey);
+        albums.push_back(Hash64::of(album, artistKey));
+    }
+
+    shuffleOrder.shuffleBalanced(ids, artists, albums, seed);
+    lCounter = std::max(0, shuffleOrder.positionOf(unsigned(playingId)));
+}
+
+
+void MainWindow::on_actionStats_triggered()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Event track numbers are mapped to artists through the playlist;
+    // tracks no longer in it are left out.
+    std::unordered_map<uint64_t, int> indexOfKey;
+    for(int i = 0; i < trackCount(); i++)
+        indexOfKey[Hash64::of(playlist.tracks[i].getLocation())] = i;
+
+    const std::vector<string> &artistNames = playlist.columns.text(TrackColumns::Artist);
+    std::unordered_map<string, int> groupOfArtist;
+    std::vector<string> names;
+    std::vector<int> groupOfTrack;
+    for(uint64_t key : listening.getTrackKeys())
+    {
+        auto found = indexOfKey.find(key);
+        if(found == indexOfKey.end())
+        {
+            groupOfTrack.push_back(-1);
+            continue;
+        }
+
+        const string &name = artistNames[found->second];
+        auto inserted = groupOfArtist.emplace(toLowerUtf8(name), int(names.size()));
+        if(inserted.second)
+            names.push_back(name.empty() ? "Unknown artist" : name);
+        groupOfTrack.push_back(inserted.first->second);
+    }
+
+    QDateTime now = QDateTime::currentDateTime();
+    long long to = now.toSecsSinceEpoch() + 1;
+    std::vector<long long> starts = listening.startsByGroup(to - 90 * 86400LL, to, groupOfTrack, int(names.size()));
+    std::vector<long long> seconds = listening.secondsByWeekday(0, to, now.offsetFromUtc());
+    qint64 elapsed = timer.elapsed();
+
+    std::vector<int> order;
+    for(int group = 0; group < int(starts.size()); group++)
+    {
+        if(starts[group] > 0)
+            order.push_back(group);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return starts[a] > starts[b]; });
+    if(order.size() > 100)
+        order.resize(100);
+
+    QString text = "Top artists, last 90 days:\n";
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        text += QString("%1. %2 (%3 plays)\n").arg(int(i) + 1).arg(QString::fromStdString(names[order[i]]))
+                    .arg(starts[order[i]]);
+    }
+    if(order.empty())
+        text += "None\n";
+
+    static const char *const days[] = { "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday",
+                                        "Sunday" };
+    text += "\nHours listened by day of the week:\n";
+    for(int day = 0; day < 7; day++)
+        text += QString("%1: %2\n").arg(days[day]).arg(seconds[day] / 3600.0, 0, 'f', 1);
+
+    text += QString("\n%1 events, queried in %2 ms").arg(listening.size()).arg(elapsed);
+
+    QMessageBox box(QMessageBox::Information, "Listening statistics", text, QMessageBox::Ok, this);
+    box.exec();
+}
+
+
+void MainWindow::on_actionBalancedShuffle_triggered()
+{
+    if(shuffle)
+        shufflePlaylist(std::random_device()());
+}
+
+
+void MainWindow::tracksAdded(int first)
+{
+    smartPlaylists.tracksAppended(playlist, first);
+
+    // New library tracks only go into the named playlist being played when
+    // the user adds them (addChosen()), not from folder scans or the
+    // watcher; its shuffle order is over its own tracks.
+    if(namedPlaylists.getActive() != -1 || !shuffle)
+        return;
+
+    // New tracks get the highest ids, so those before first are the ones
+    // a lazy order was made over.
+    if(shuffleOrder.isLazy())
+    {
+        std::vector<unsigned int> ids;
+        for(int i = 0; i < first; i++)
+            ids.push_back(playlist.tracks[i].getId());
+        shuffleOrder.materialize(ids);
+    }
+
+    for(int i = first; i < trackCount(); i++)
+        shuffleOrder.insert(playlist.tracks[i].getId(), lCounter);
+}
+
+
+void MainWindow::tracksRemoved(std::vector<unsigned int> ids)
+{
+    queue.remove(ids);
+    smartPlaylists.tracksRemoved(ids);
+    if(namedPlaylists.getActive() != -1)
+        removeFromList(namedPlaylists.getActive(), ids);
+    namedPlaylists.tracksRemoved(ids);
+    if(namedPlaylists.getActive() != -1 || !shuffle)
+        return;
+
+    // Ids grow in playlist order, so merging the removed ones back into
+    // the remaining ones gives the playlist a lazy order was made over.
+    if(shuffleOrder.isLazy())
+    {
+        std::vector<unsigned int> remaining;
+        for(Track &track : playlist.tracks)
+            remaining.push_back(track.getId());
+
+        std::vector<unsigned int> before(remaining.size() + ids.size());
+        std::sort(ids.begin(), ids.end());
+        std::merge(remaining.begin(), remaining.end(), ids.begin(), ids.end(), before.begin());
+        shuffleOrder.materialize(before);
+    }
+
+    for(unsigned int id : ids)
+        shuffleOrder.remove(id);
+    lCounter = shuffleOrder.compact(lCounter);
+}
+
+
+void MainWindow::addToList(int list, const std::vector<unsigned int> &ids)
+{
+    // The lazy order was made over the playlist as it was before.
+    bool active = list == namedPlaylists.getActive();
+    if(active && shuffle && shuffleOrder.isLazy())
+        shuffleOrder.materialize(namedPlaylists.getIds(list));
+
+    std::vector<unsigned int> added = namedPlaylists.append(list, ids);
+    if(added.empty())
+        return;
+
+    if(active)
+    {
+        if(shuffle)
+        {
+            for(unsigned int id : added)
+                shuffleOrder.insert(id, lCounter);
+        }
+        model->orderAppended(added);
+    }
+}
+
+
+void MainWindow::addChosen(const std::vector<string> &locations)
+{
+    int active = namedPlaylists.getActive();
+    if(active == -1)
+        return;
+
+    // Files picked while a named playlist is being played go into it,
+    // whether or not the library had them already.
+    std::vector<unsigned int> ids;
+    for(const string &location : locations)
+    {
+        int index = playlist.indexOfLocation(location);
+        if(index != -1)
+            ids.push_back(playlist.tracks[index].getId());
+    }
+    addToList(active, ids);
+}
+
+
+void MainWindow::removeFromList(int list, const std::vector<unsigned int> &ids)
+{
+    bool active = list == namedPlaylists.getActive();
+    if(active && shuffle)
+    {
+        if(shuffleOrder.isLazy())
+            shuffleOrder.materialize(namedPlaylists.getIds(list));
+        for(unsigned int id : ids)
+            shuffleOrder.remove(id);
+        lCounter = shuffleOrder.compact(lCounter);
+    }
+
+    namedPlaylists.removeTracks(list, ids);
+}
+
+
+void MainWindow::tracksChanged(const std::vector<int> &indexes, unsigned int columns)
+{
+    smartPlaylists.tracksChanged(playlist, indexes, columns);
+    model->tracksChanged(indexes);
+}
+
+
+int MainWindow::orderSize()
+{
+    int active = namedPlaylists.getActive();
+    return active == -1 ? trackCount() : int(namedPlaylists.getIds(active).size());
+}
+
+
+int MainWindow::trackInOrder(int position)
+{
+    int active = namedPlaylists.getActive();
+    if(position < 0 || position >= orderSize())
+        return -1;
+
+    return active == -1 ? position : playlist.indexOf(namedPlaylists.getIds(active)[position]);
+}
+
+
+int MainWindow::orderIndexOf(int index)
+{
+    int active = namedPlaylists.getActive();
+    if(active == -1 || index == -1)
+        return index;
+
+    return namedPlaylists.positionOf(active, playlist.tracks[index].getId());
+}
+
+
+int MainWindow::positionCount()
+{
+    return shuffle ? shuffleOrder.size() : orderSize();
+}
+
+
+int MainWindow::trackAt(int position)
+{
+    if(!shuffle)
+        return trackInOrder(position);
+
+    if(shuffleOrder.isLazy())
+        return trackInOrder(shuffleOrder.indexAt(position));
+
+    unsigned int id = shuffleOrder.at(position);
+    return id == ShuffleOrder::Removed ? -1 : playlist.indexOf(id);
+}
+
+
+bool MainWindow::isPlayable(int index)
+{
+    if(index == -1)
+        return false;
+
+    Track::Status status = playlist.tracks[index].getStatus();
+    return status != Track::Missing && status != Track::Unreadable;
+}
+
+
+void MainWindow::loadTrack(int index)
+{
+     if(index == -1)
+         return;
+
+     // A track from outside the order being played (queued, or in the
+     // history) leaves the place in that order as it was.
+     playingId = int(playlist.tracks[index].getId());
+     startLogged = false;
+     int position;
+     if(!shuffle)
+         position = orderIndexOf(index);
+     else if(shuffleOrder.isLazy())
+         position = shuffleOrder.positionOfIndex(orderIndexOf(index));
+     else
+         position = shuffleOrder.positionOf(unsigned(playingId));
+     if(position != -1)
+         lCounter = position;
+     if(!walkingHistory)
+         history.played(unsigned(playingId), Hash64::of(playlist.tracks[index].getLocation()));
+
+     // A track of a cue sheet is part of a disc image. When the player has
+     // the image open already, as it has for the next track of the same
+     // disc, it keeps it, and plays straight on if the track follows on.
+     string file = playlist.tracks[index].getLocation();
+     segmentStart = 0;
+     segmentEnd = -1;
+     string sheetPath;
+     int number;
+     const CueSheet::Track *track = nullptr;
+     if(CueSheet::split(file, sheetPath, number) && playingSheet.readCached(sheetPath))
+         track = playingSheet.find(number);
+     if(track)
+     {
+         file = track->file;
+         segmentStart = track->start;
+         segmentEnd = track->end;
+     }
+
+     QMediaPlayer::MediaStatus status = player->mediaStatus();
+     bool open = file == playingFile && status != QMediaPlayer::NoMedia && status != QMediaPlayer::EndOfMedia
+                 && status != QMediaPlayer::InvalidMedia;
+     if(!open)
+     {
+         playingFile = file;
+         pendingSeek = segmentStart;
+         player->setSource(QUrl::fromLocalFile(QString::fromStdString(file)));
+     }
+     else if(status == QMediaPlayer::LoadingMedia)
+         pendingSeek = segmentStart;
+     else if(std::abs(player->position() - segmentStart) > GaplessSlack)
+         player->setPosition(segmentStart);
+
+     QString qstr = QString::fromStdString(playlist.tracks[index].getName());
+     ui->songName->setText(qstr);
+
+     // Known from the file headers, so the slider is right before the
+     // player reports the duration.
+     int duration = playlist.columns.number(TrackColumns::Duration)[index];
+     if(duration <= 0 && open)
+         duration = int(trackDuration());
+     if(duration > 0)
+         ui->progressSlider->setMaximum(duration);
+
+     updateCover();
+}
+
+
+void MainWindow::on_searchBar_textChanged(const QString &arg1)
+{
+    model->setFilter(arg1);
+
+    if(arg1 != "")
+        selectRow(0);
+    else
+        selectTrack(trackAt(lCounter));
+}
+
+void MainWindow::on_actionSave_triggered()
+{
+    playlist.save();
+    cache.save();
+    ui->actionSave->setChecked(true);
+}
+
+
+void MainWindow::on_actionRemove_triggered()
+{
+    int index = getIndex();
+    if(index != -1 && namedPlaylists.getActive() != -1)
+    {
+        // In a named playlist, Remove takes the track out of it only.
+        int row = ui->listView->currentIndex().row();
+        unsigned int id = playlist.tracks[index].getId();
+        removeFromList(namedPlaylists.getActive(), { id });
+        namedPlaylists.save(playlist);
+        model->trackRemoved(id);
+        selectRow(std::min(row, model->rowCount() - 1));
+    }
+    else if(index != -1)
+    {
+       int row = ui->listView->currentIndex().row();
+       unsigned int id = playlist.tracks[index].getId();
+       playlist.remove(index);
+       model->trackRemoved(id);
+       tracksRemoved({ id });
+       updateStatus();
+       selectRow(std::min(row, model->rowCount() - 1));
+       ui->actionSave->setChecked(false);
+    }
+}
+
+
+void MainWindow::on_actionAdd_2_triggered()
+{
+    bool startUpdater = false;if(trackCount() == 0) startUpdater = true;
+      QStringList files = QFileDialog::getOpenFileNames(this, tr("Select Music Files"));
+      std::vector<string> locations;
+      for(const QString &file : files)
+          locations.push_back(file.toStdString());
+      CueSheet::expand(locations);
+      if(!locations.empty())
+      {
+          int first = trackCount();
+          playlist.add(locations);
+          model->tracksAppended(first);
+          scanTags(first);
+          tracksAdded(first);
+          addChosen(locations);
+          ui->actionSave->setChecked(false);
+          if(startUpdater) updater->start();
+      }
+}
+
+void MainWindow::openFiles(const QStringList &files)
+{
+    if(files.empty())
+        return;
+
+    // A cue sheet opens as its tracks.
+    std::vector<string> locations;
+    for(const QString &file : files)
+        locations.push_back(QFileInfo(file).absoluteFilePath().toStdString());
+    CueSheet::expand(locations);
+    if(locations.empty())
+        return;
+
+    // Files already in the playlist are not added again, only played.
+    bool startUpdater = trackCount() == 0;
+    int first = trackCount();
+    playlist.add(locations);
+    if(trackCount() > first)
+    {
+        model->tracksAppended(first);
+        scanTags(first);
+        tracksAdded(first);
+        ui->actionSave->setChecked(false);
+    }
+    addChosen(locations);
+
+    int index = playlist.indexOfLocation(locations[0]);
+    if(index == -1)
+        return;
+
+    ui->searchBar->clear();
+    lCounter = index;
+    selectTrack(index);
+    loadTrack(index);
+    player->play();
+    ui->playButton->setText("||");
+    if(startUpdater) updater->start();
+}
+
+void MainWindow::on_actionAddFolder_triggered()
+{
+    QString folder = QFileDialog::getExistingDirectory(this, tr("Select Music Folder"));
+    if(folder.isEmpty())
+        return;
+
+    libraryWatcher->addRoot(folder);
+    folderScanner->scan(folder);
+    updateStatus();
+}
+
+void MainWindow::addFound()
+{
+    libraryWatcher->watch(folderScanner->takeDirectories());
+
+    std::vector<string> files = folderScanner->takeFiles();
+    if(files.empty())
+        return;
+
+    bool startUpdater = trackCount() == 0;
+    int first = trackCount();
+    playlist.add(files);
+    model->tracksAppended(first);
+    scanTags(first);
+    tracksAdded(first);
+    ui->actionSave->setChecked(false);
+    if(startUpdater) updater->start();
+}
+
+void MainWindow::on_filesFound()
+{
+    addFound();
+}
+
+void MainWindow::on_folderScanned()
+{
+    addFound();
+    updateStatus();
+}
+
+void MainWindow::on_actionImportPlaylist_triggered()
+{
+    if(playlistFile->isRunning())
+        return;
+
+    QString path = QFileDialog::getOpenFileName(this, tr("Import Playlist"), QString(),
+                                                tr("Playlists (*.m3u *.m3u8 *.pls *.xspf)"));
+    if(path.isEmpty())
+        return;
+
+    // The tracks join the library and, in the file's order, a named
+    // playlist called after the file.
+    importList = namedPlaylists.create(QFileInfo(path).completeBaseName().toStdString(), {});
+    playlistFile->read(path);
+    updateStatus();
+}
+
+void MainWindow::importFound()
+{
+    std::vector<string> locations = playlistFile->takeLocations();
+    if(locations.empty() || importList == -1)
+        return;
+
+    bool startUpdater = trackCount() == 0;
+    int first = trackCount();
+    playlist.add(locations);
+    model->tracksAppended(first);
+    scanTags(first);
+
+    // Tracks already in the library are added to the playlist as well.
+    std::vector<unsigned int> ids;
+    ids.reserve(locations.size());
+    for(const string &location : locations)
+    {
+        int index = playlist.indexOfLocation(location);
+        if(index != -1)
+            ids.push_back(playlist.tracks[index].getId());
+    }
+    addToList(importList, ids);
+    tracksAdded(first);
+    ui->actionSave->setChecked(false);
+    if(startUpdater) updater->start();
+}
+
+void MainWindow::on_playlistRead()
+{
+    importFound();
+}
+
+void MainWindow::on_playlistImported()
+{
+    importFound();
+    importList = -1;
+    namedPlaylists.save(playlist);
+    updateStatus();
+}
+
+void MainWindow::on_actionExportPlaylist_triggered()
+{
+    if(playlistFile->isRunning())
+        return;
+
+    QString path = QFileDialog::getSaveFileName(this, tr("Export Playlist"), QString(),
+                                                tr("Playlists (*.m3u8 *.m3u *.pls *.xspf)"));
+    if(path.isEmpty())
+        return;
+    if(!PlaylistFile::isPlaylist(path))
+        path += ".m3u8";
+
+    // What the list shows, in its order: a playlist, or search results.
+    // Only the ids are taken now; the writer asks for the entries a batch
+    // at a time (on_exportWanted()).
+    exportIds.clear();
+    exportIds.reserve(model->rowCount());
+    for(int row = 0; row < model->rowCount(); row++)
+    {
+        int index = model->trackIndex(row);
+        if(index == -1)
+            continue;
+        exportIds.push_back(playlist.tracks[index].getId());
+    }
+    exported = 0;
+
+    playlistFile->write(path);
+    ui->statusbar->showMessage("Exporting playlist...");
+}
+
+void MainWindow::on_exportWanted()
+{
+    const std::vector<string> &titles = playlist.columns.text(TrackColumns::Title);
+    const std::vector<string> &artists = playlist.columns.text(TrackColumns::Artist);
+    const std::vector<int> &durations = playlist.columns.number(TrackColumns::Duration);
+    std::vector<PlaylistFile::Entry> entries;
+    while(exported < exportIds.size() && entries.size() < PlaylistFile::EntriesPerBatch)
+    {
+        // Tracks removed since the export started are left out.
+        int index = playlist.indexOf(exportIds[exported++]);
+        if(index == -1)
+            continue;
+
+        PlaylistFile::Entry entry;
+        entry.location = playlist.tracks[index].getLocation();
+        if(titles[index].empty())
+            entry.title = playlist.tracks[index].getName();
+        else
+            entry.title = artists[index].empty() ? titles[index] : artists[index] + " - " + titles[index];
+        entry.duration = durations[index];
+        entries.push_back(std::move(entry));
+    }
+
+    if(entries.empty())
+        std::vector<unsigned int>().swap(exportIds);
+    playlistFile->writeEntries(std::move(entries));
+}
+
+void MainWindow::on_playlistWritten(bool ok)
+{
+    updateStatus();
+    if(!ok)
+        QMessageBox::warning(this, "KPlay", "The playlist could not be written.");
+}
+
+void MainWindow::on_libraryChanged()
+{
+    LibraryWatcher::Changes changes = libraryWatcher->takeChanges();
+
+    // Moves first: they are given as indexes from before the removal. The
+    // cache does not know the new locations, so their tags are read again,
+    // which also puts right a move that paired the wrong files.
+    std::vector<int> moved;
+    for(const auto &move : changes.moved)
+    {
+        playlist.setLocation(move.first, move.second);
+        moved.push_back(move.first);
+    }
+    tracksChanged(moved, TrackColumns::bit(TrackColumns::Name));
+    scanTags(moved);
+
+    std::vector<unsigned int> ids;
+    for(int index : changes.removed)
+        ids.push_back(playlist.tracks[index].getId());
+    playlist.remove(changes.removed);
+    model->tracksRemoved(ids);
+    tracksRemoved(ids);
+
+    if(!changes.added.empty())
+    {
+        bool startUpdater = trackCount() == 0;
+        int first = trackCount();
+        playlist.add(changes.added);
+        model->tracksAppended(first);
+        scanTags(first);
+        tracksAdded(first);
+        if(startUpdater) updater->start();
+    }
+
+    for(const QString &directory : changes.newDirectories)
+        folderScanner->scan(directory);
+
+    ui->actionSave->setChecked(false);
+    updateStatus();
+}
+
+
+
+void MainWindow::on_tagsRead()
+{
+    std::vector<TagScanner::Result> results = scanner->takeResults();
+    std::vector<TempoScanner::Job> unanalysed;
+    std::vector<int> changed;
+
+    for(const TagScanner::Result &result : results)
+    {
+        int index = playlist.indexOf(result.id);
+        if(index == -1)
+            continue;
+
+        playlist.setInfo(index, result.info);
+        changed.push_back(index);
+
+        MetadataCache::Entry entry;
+        entry.size = result.size;
+        entry.modified = result.modified;
+        entry.info = result.info;
+        cache.insert(playlist.tracks[index].getLocation(), entry);
+        if(result.info.bpm == 0)
+            unanalysed.push_back({ result.id, playlist.tracks[index].getLocation() });
+
+        if(int(result.id) == playingId)
+            ui->songName->setText(QString::fromStdString(playlist.tracks[index].getName()));
+    }
+
+    // New tags can change any column.
+    tracksChanged(changed, ~0u);
+    updateStatus();
+    tempoScanner->add(unanalysed);
+}
+
+void MainWindow::on_tempoFound()
+{
+    std::vector<TempoScanner::Result> results = tempoScanner->takeResults();
+    std::vector<int> changed;
+
+    for(const TempoScanner::Result &result : results)
+    {
+        // The tempo is kept with the rest of the metadata, so it is only
+        // worked out again when the file changes.
+        MetadataCache::Entry entry;
+        if(cache.find(result.location, entry))
+        {
+            entry.info.bpm = result.bpm;
+            cache.insert(result.location, entry);
+        }
+
+        int index = playlist.indexOf(result.id);
+        if(index == -1)
+            continue;
+        playlist.setTempo(index, result.bpm);
+        changed.push_back(index);
+    }
+
+    tracksChanged(changed, TrackColumns::bit(TrackColumns::Bpm));
+}
+
+void MainWindow::on_artReady()
+{
+    model->coversChanged();
+    updateCover();
+}
+
+void MainWindow::on_actionPlayNext_triggered()
+{
+    int index = getIndex();
+    if(index == -1)
+        return;
+
+    queue.playNext(playlist.tracks[index].getId());
+    updateStatus();
+}
+
+void MainWindow::on_actionAddToQueue_triggered()
+{
+    int index = getIndex();
+    if(index == -1)
+        return;
+
+    queue.enqueue(playlist.tracks[index].getId());
+    updateStatus();
+}
+
+void MainWindow::on_actionQueueShown_triggered()
+{
+    // Everything the search bar lets through, in list order.
+    std::vector<unsigned int> ids;
+    ids.reserve(model->rowCount());
+    for(int row = 0; row < model->rowCount(); row++)
+    {
+        int index = model->trackIndex(row);
+        if(index == -1)
+            continue;
+        ids.push_back(playlist.tracks[index].getId());
+    }
+
+    queue.enqueue(ids);
+    updateStatus();
+}
+
+void MainWindow::on_actionClearQueue_triggered()
+{
+    queue.clear();
+    updateStatus();
+}
+
+void MainWindow::checkTracks()
+{
+    if(trackChecker->isRunning())
+        return;
+
+    std::vector<TrackChecker::Job> jobs;
+    for(Track &track : playlist.tracks)
+        jobs.push_back({ track.getId(), track.getLocation(), track.getStatus(), track.getCheckedSize(),
+                         track.getCheckedModified() });
+
+    trackChecker->check(jobs);
+}
+
+void MainWindow::on_tracksChecked()
+{
+    std::vector<TrackChecker::Result> results = trackChecker->takeResults();
+    std::vector<int> changed;
+
+    for(const TrackChecker::Result &result : results)
+    {
+        int index = playlist.indexOf(result.id);
+        if(index == -1)
+            continue;
+
+        // A file that changed but still plays only needs its size and
+        // mtime remembered.
+        Track &track = playlist.tracks[index];
+        track.setChecked(result.size, result.modified);
+        if(result.status == track.getStatus())
+            continue;
+        track.setStatus(result.status);
+        changed.push_back(index);
+    }
+
+    model->tracksChanged(changed);
+}
+
+void MainWindow::checkDay()
+{
+    // Rules like unplayed>=6m match different tracks from one day to the
+    // next.
+    if(smartPlaylists.dayChanged(playlist) && shownSmart != -1)
+        showSmart(shownSmart);
+}
+
+void MainWindow::switchList(int list)
+{
+    int active = namedPlaylists.getActive();
+    if(list == active)
+        return;
+
+    // Every playlist carries on from its own place in its own order.
+    namedPlaylists.setState(active, lCounter, shuffleOrder.getSeed());
+    namedPlaylists.setActive(list);
+    if(shuffle)
+    {
+        uint64_t seed = namedPlaylists.getSeed(list);
+        shufflePlaylist(seed != 0 ? seed : std::random_device()());
+    }
+    lCounter = std::min(namedPlaylists.getPosition(list), std::max(0, positionCount() - 1));
+}
+
+void MainWindow::showList(int list)
+{
+    switchList(list);
+    shownSmart = -1;
+    model->setOrder(list == -1 ? nullptr : &namedPlaylists.getIds(list));
+    updateTitle();
+
+    int row = model->rowOf(trackAt(lCounter));
+    selectRow(row == -1 ? 0 : row);
+}
+
+void MainWindow::showSmart(int index)
+{
+    if(index == -1)
+    {
+        showList(-1);
+        return;
+    }
+
+    // Smart playlists are views of the library, which is what plays.
+    switchList(-1);
+    shownSmart = index;
+    model->setScope(smartPlaylists.getQuery(index), smartPlaylists.getIds(index));
+    updateTitle();
+
+    int row = model->rowOf(trackAt(lCounter));
+    selectRow(row == -1 ? 0 : row);
+}
+
+void MainWindow::updateTitle()
+{
+    int active = namedPlaylists.getActive();
+    if(shownSmart != -1)
+        setWindowTitle(QString::fromStdString(smartPlaylists.getName(shownSmart)) + " - KPlay");
+    else if(active != -1)
+        setWindowTitle(QString::fromStdString(namedPlaylists.getName(active)) + " - KPlay");
+    else
+        setWindowTitle("KPlay");
+}
+
+void MainWindow::updatePlaylistsMenu()
+{
+    for(QAction *action : playlistActions)
+        delete action;
+    playlistActions.clear();
+    ui->menuAddToPlaylist->clear();
+
+    // Named playlists, then smart ones; data() tells them apart, smart
+    // ones counting down from -2.
+    auto addEntry = [this](const string &name, int count, bool checked, int data) {
+        QAction *action = ui->menuPlaylists->addAction(QString("%1 (%2)").arg(QString::fromStdString(name)).arg(count));
+        action->setCheckable(true);
+        action->setChecked(checked);
+        action->setData(data);
+        connect(action, SIGNAL(triggered()), this, SLOT(on_playlistChosen()));
+        playlistActions.push_back(action);
+        return action;
+    };
+
+    for(int i = 0; i < namedPlaylists.size(); i++)
+    {
+        addEntry(namedPlaylists.getName(i), int(namedPlaylists.getIds(i).size()),
+                 shownSmart == -1 && i == namedPlaylists.getActive(), i);
+
+        QAction *addTo = ui->menuAddToPlaylist->addAction(QString::fromStdString(namedPlaylists.getName(i)));
+        addTo->setData(i);
+        connect(addTo, SIGNAL(triggered()), this, SLOT(on_addToPlaylistChosen()));
+    }
+
+    if(smartPlaylists.size() > 0)
+        playlistActions.push_back(ui->menuPlaylists->addSeparator());
+    for(int i = 0; i < smartPlaylists.size(); i++)
+    {
+        QAction *action = addEntry(smartPlaylists.getName(i), int(smartPlaylists.getIds(i).size()), i == shownSmart, -2 - i);
+        action->setToolTip(QString::fromStdString(smartPlaylists.getRule(i)));
+    }
+
+    ui->actionAllTracks->setChecked(shownSmart == -1 && namedPlaylists.getActive() == -1);
+    ui->actionDeletePlaylist->setEnabled(shownSmart != -1 || namedPlaylists.getActive() != -1);
+    ui->menuAddToPlaylist->setEnabled(namedPlaylists.size() > 0);
+}
+
+void MainWindow::on_playlistChosen()
+{
+    QAction *action = qobject_cast<QAction *>(sender());
+    if(!action)
+        return;
+
+    int data = action->data().toInt();
+    if(data >= 0)
+        showList(data);
+    else
+        showSmart(-2 - data);
+}
+
+void MainWindow::on_addToPlaylistChosen()
+{
+    QAction *action = qobject_cast<QAction *>(sender());
+    int index = getIndex();
+    if(!action || index == -1)
+        return;
+
+    addToList(action->data().toInt(), { playlist.tracks[index].getId() });
+    namedPlaylists.save(playlist);
+}
+
+void MainWindow::on_actionAllTracks_triggered()
+{
+    showList(-1);
+}
+
+void MainWindow::on_actionNewPlaylist_triggered()
+{
+    // Made from what the list shows, so a search (or a smart playlist)
+    // is the quick way to fill it.
+    bool ok;
+    QString name = QInputDialog::getText(this, "New playlist", "Name:", QLineEdit::Normal, "", &ok).trimmed();
+    if(!ok || name.isEmpty())
+        return;
+
+    std::vector<unsigned int> ids;
+    for(int row = 0; row < model->rowCount(); row++)
+    {
+        int track = model->trackIndex(row);
+        if(track == -1)
+            continue;
+        ids.push_back(playlist.tracks[track].getId());
+    }
+
+    int index = namedPlaylists.create(name.toStdString(), ids);
+    namedPlaylists.save(playlist);
+    ui->searchBar->clear();
+    showList(index);
+}
+
+void MainWindow::on_actionNewSmartPlaylist_triggered()
+{
+    // The search being typed is the natural starting point for a rule.
+    bool ok;
+    QString rule = QInputDialog::getText(this, "New smart playlist",
+                                         "Rule (for example: unplayed>=6m genre:jazz plays>=3):",
+                                         QLineEdit::Normal, ui->searchBar->text(), &ok).trimmed();
+    if(!ok || rule.isEmpty())
+        return;
+
+    QString name = QInputDialog::getText(this, "New smart playlist", "Name:", QLineEdit::Normal, rule, &ok).trimmed();
+    if(!ok || name.isEmpty())
+        return;
+
+    int index = smartPlaylists.add(name.toStdString(), rule.toStdString(), playlist);
+    ui->searchBar->clear();
+    showSmart(index);
+}
+
+void MainWindow::on_actionDeletePlaylist_triggered()
+{
+    int active = namedPlaylists.getActive();
+    if(shownSmart == -1 && active == -1)
+        return;
+
+    string name = shownSmart != -1 ? smartPlaylists.getName(shownSmart) : namedPlaylists.getName(active);
+    QString question = QString("Delete the playlist \"%1\"? Its tracks stay in the library.")
+                       .arg(QString::fromStdString(name));
+    if(QMessageBox::question(this, "KPlay", question) != QMessageBox::Yes)
+        return;
+
+    if(shownSmart != -1)
+    {
+        smartPlaylists.remove(shownSmart);
+        showList(-1);
+        return;
+    }
+
+    showList(-1);
+    namedPlaylists.remove(active);
+    if(importList == active)
+        importList = -1;
+    else if(importList > active)
+        importList--;
+    namedPlaylists.save(playlist);
+}
+
+void MainWindow::on_actionFindDuplicates_triggered()
+{
+    if(duplicateFinder->isRunning())
+        return;
+
+    std::vector<DuplicateFinder::Job> jobs;
+    for(Track &track : playlist.tracks)
+        jobs.push_back({ track.getId(), track.getLocation() });
+
+    duplicateFinder->find(jobs);
+    ui->statusbar->showMessage("Looking for duplicates...");
+}
+
+void MainWindow::on_duplicatesFound()
+{
+    std::vector<std::vector<unsigned int>> groups = duplicateFinder->takeGroups();
+    updateStatus();
+
+    // The first copy in playlist order stays, or the playing one.
+    std::vector<int> extra;
+    std::vector<unsigned int> ids;
+    for(std::vector<unsigned int> &group : groups)
+    {
+        auto playing = std::find(group.begin(), group.end(), unsigned(playingId));
+        if(playing != group.end())
+            std::iter_swap(group.begin(), playing);
+
+        for(size_t i = 1; i < group.size(); i++)
+        {
+            int index = playlist.indexOf(group[i]);
+            if(index != -1)
+            {
+                extra.push_back(index);
+                ids.push_back(group[i]);
+            }
+        }
+    }
+
+    if(extra.empty())
+    {
+        QMessageBox::information(this, "KPlay", "No duplicates found.");
+        return;
+    }
+
+    QString question = QString("%1 songs are in the playlist more than once (%2 extra copies).\n"
+                               "Remove the extra copies?").arg(int(groups.size())).arg(int(extra.size()));
+    if(QMessageBox::question(this, "KPlay", question) != QMessageBox::Yes)
+        return;
+
+    int row = ui->listView->currentIndex().row();
+    playlist.remove(extra);
+    model->tracksRemoved(ids);
+    tracksRemoved(ids);
+    selectRow(std::min(row, model->rowCount() - 1));
+    ui->actionSave->setChecked(false);
+    updateStatus();
+}
+
+void MainWindow::on_actionFindSimilar_triggered()
+{
+    if(fingerprintScanner->isRunning())
+        return;
+
+    std::vector<FingerprintScanner::Job> jobs;
+    for(Track &track : playlist.tracks)
+        jobs.push_back({ track.getId(), track.getLocation() });
+
+    fingerprintScanner->scan(jobs);
+    ui->statusbar->showMessage("Looking for similar recordings...");
+}
+
+void MainWindow::on_fingerprintProgress(int done, int total)
+{
+    if(done < total)
+        ui->statusbar->showMessage(QString("Fingerprinting %1/%2...").arg(done + 1).arg(total));
+    else
+        ui->statusbar->showMessage("Looking for similar recordings...");
+}
+
+void MainWindow::on_similarFound()
+{
+    std::vector<std::vector<unsigned int>> groups = fingerprintScanner->takeGroups();
+    updateStatus();
+
+    // The copy with the highest bitrate stays, or the playing one.
+    const std::vector<int> &bitrates = playlist.columns.number(TrackColumns::Bitrate);
+    std::vector<int> extra;
+    std::vector<unsigned int> ids;
+    for(std::vector<unsigned int> &group : groups)
+    {
+        auto keep = std::find(group.begin(), group.end(), unsigned(playingId));
+        if(keep == group.end())
+        {
+            keep = std::max_element(group.begin(), group.end(), [&](unsigned int a, unsigned int b) {
+                int ia = playlist.indexOf(a), ib = playlist.indexOf(b);
+                return (ia == -1 ? -1 : bitrates[ia]) < (ib == -1 ? -1 : bitrates[ib]);
+            });
+        }
+        std::iter_swap(group.begin(), keep);
+
+        for(size_t i = 1; i < group.size(); i++)
+        {
+            int index = playlist.indexOf(group[i]);
+            if(index != -1)
+            {
+                extra.push_back(index);
+                ids.push_back(group[i]);
+            }
+        }
+    }
+
+    if(extra.empty())
+    {
+        QMessageBox::information(this, "KPlay", "No similar recordings found.");
+        return;
+    }
+
+    QString question = QString("%1 songs are in the playlist in more than one encoding (%2 extra copies).\n"
+                               "Remove the copies with the lower bitrate?").arg(int(groups.size())).arg(int(extra.size()));
+    if(QMessageBox::question(this, "KPlay", question) != QMessageBox::Yes)
+        return;
+
+    int row = ui->listView->currentIndex().row();
+    playlist.remove(extra);
+    model->tracksRemoved(ids);
+    tracksRemoved(ids);
+    selectRow(std::min(row, model->rowCount() - 1));
+    ui->actionSave->setChecked(false);
+    updateStatus();
+}
@@ -1,96 +1,322 @@
-#ifndef MAINWINDOW_H
-#define MAINWINDOW_H
-
-#include <QMainWindow>
-#include <QMediaPlayer>
-#include <QAudioOutput>
-#include "playlist.h"
-#include <QTimer>
-#include <QPalette>
-#include <vector>
-#include <QKeyEvent>
-#include <QLineEdit>
-#include <QFileDialog>
-
-QT_BEGIN_NAMESPACE
-namespace Ui { class MainWindow; }
-QT_END_NAMESPACE
-
-class MainWindow : public QMainWindow
-{
-    Q_OBJECT
-
-public:
-    MainWindow(QWidget *parent = nullptr);
-    ~MainWindow();
-
-private slots:
-    void on_playButton_clicked();
-
-    void on_nextButton_clicked();
-
-    void on_progressSlider_sliderMoved(int position);
-
-    void on_positionChanged(qint64 position);
-
-    void on_durationChanged(qint64 position);
-
-    void on_volumeChanged(qint64 position);
-
-    void update();
-
-    void on_shuffleButton_clicked();
-
-    void on_repeatButton_clicked();
-
-    void on_listWidget_doubleClicked();
-
-    void on_volumeSlider_valueChanged(int value);
-
-    void on_backButton_clicked();
-
-    void on_searchBar_textChanged(const QString &arg1);
-
-    void on_actionSave_triggered();
-
-    void on_actionRemove_triggered();
-
-    void on_actionAdd_2_triggered();
-
-private:
-
-    void updateList();
-
-    void loadTrack();
-
-    void next();
-
-    void back();
-
-    void shufflePlaylist();
-
-    int getIndex();
-
-    bool repeat = false;
-
-    bool shuffle = false;
-
-    int lCounter = 0;
-
-    Ui::MainWindow *ui;
-
-    QMediaPlayer* player;
-
-    QAudioOutput* audioOutput;
-
-    Playlist playlist;
-
-    QTimer *updater = new QTimer(this);
-
-    vector<unsigned short int> shuffledPlaylist;
-
-protected:
-    void keyPressEvent(QKeyEvent *event);
-
-};
-#endif // MAINWINDOW_H
+#ifndef MAINWINDOW_H
+#define MAINWINDOW_H
+
+#include <QMainWindow>
+#include <QMediaPlayer>
+#include <QAudioOutput>
+#include "playhistory.h"
+#include "playlist.h"
+#include "playqueue.h"
+#include "shuffleorder.h"
+#include "smartplaylists.h"
+#include "tracklistmodel.h"
+#include "tagscanner.h"
+#include "metadatacache.h"
+#include "namedplaylists.h"
+#include "coverart.h"
+#include "cuesheet.h"
+#include "folderscanner.h"
+#include "playlistfile.h"
+#include "librarywatcher.h"
+#include "listeninglog.h"
+#include "duplicatefinder.h"
+#include "fingerprintscanner.h"
+#include "temposcanner.h"
+#include "trackchecker.h"
+#include <QTimer>
+#include <QPalette>
+#include <vector>
+#include <QKeyEvent>
+#include <QLineEdit>
+#include <QFileDialog>
+
+QT_BEGIN_NAMESPACE
+namespace Ui { class MainWindow; }
+QT_END_NAMESPACE
+
+class MainWindow : public QMainWindow
+{
+    Q_OBJECT
+
+public:
+    MainWindow(QWidget *parent = nullptr);
+    ~MainWindow();
+
+    void openFiles(const QStringList &files);
+
+private slots:
+    void on_playButton_clicked();
+
+    void on_nextButton_clicked();
+
+    void on_progressSlider_sliderMoved(int position);
+
+    void on_progressSlider_sliderReleased();
+
+    void on_playbackStateChanged();
+
+    void on_mediaStatusChanged();
+
+    void on_positionChanged(qint64 position);
+
+    void on_durationChanged(qint64 position);
+
+    void on_volumeChanged(qint64 position);
+
+    void update();
+
+    void on_shuffleButton_clicked();
+
+    void on_repeatButton_clicked();
+
+    void on_listView_doubleClicked();
+
+    void on_volumeSlider_valueChanged(int value);
+
+    void on_backButton_clicked();
+
+    void on_searchBar_textChanged(const QString &arg1);
+
+    void on_actionSave_triggered();
+
+    void on_actionRemove_triggered();
+
+    void on_actionAdd_2_triggered();
+
+    void on_actionAddFolder_triggered();
+
+    void on_filesFound();
+
+    void on_folderScanned();
+
+    void on_libraryChanged();
+
+    void on_actionFindDuplicates_triggered();
+
+    void on_duplicatesFound();
+
+    void on_actionFindSimilar_triggered();
+
+    void on_fingerprintProgress(int done, int total);
+
+    void on_similarFound();
+
+    void on_tagsRead();
+
+    void on_tempoFound();
+
+    void on_artReady();
+
+    void on_actionStats_triggered();
+
+    void on_actionBalancedShuffle_triggered();
+
+    void on_actionPlayNext_triggered();
+
+    void on_actionAddToQueue_triggered();
+
+    void on_actionQueueShown_triggered();
+
+    void on_actionClearQueue_triggered();
+
+    void checkTracks();
+
+    void on_tracksChecked();
+
+    void checkDay();
+
+    void updatePlaylistsMenu();
+
+    void on_playlistChosen();
+
+    void on_addToPlaylistChosen();
+
+    void on_actionAllTracks_triggered();
+
+    void on_actionNewPlaylist_triggered();
+
+    void on_actionNewSmartPlaylist_triggered();
+
+    void on_actionDeletePlaylist_triggered();
+
+    void on_actionImportPlaylist_triggered();
+
+    void on_actionExportPlaylist_triggered();
+
+    void on_playlistRead();
+
+    void on_playlistImported();
+
+    void on_exportWanted();
+
+    void on_playlistWritten(bool ok);
+
+private:
+
+    void selectRow(int row);
+
+    void selectTrack(int index);
+
+    int trackCount();
+
+    void scanTags(int first);
+
+    void scanTags(const std::vector<int> &indexes);
+
+    void addFound();
+
+    void importFound();
+
+    void updateStatus();
+
+    void updateCover();
+
+    void loadTrack(int index);
+
+    // Within the playing track, which for a track of a cue sheet is only
+    // part of the file the player has.
+    qint64 trackPosition();
+
+    qint64 trackDuration();
+
+    void logEvent(ListeningLog::Event event);
+
+    void next();
+
+    void back();
+
+    void playFromHistory(int index);
+
+    void shufflePlaylist(uint64_t seed);
+
+    void shuffleBalanced(uint64_t seed);
+
+    void tracksAdded(int first);
+
+    void tracksRemoved(std::vector<unsigned int> ids);
+
+    void addToList(int list, const std::vector<unsigned int> &ids);
+
+    void addChosen(const std::vector<string> &locations);
+
+    void removeFromList(int list, const std::vector<unsigned int> &ids);
+
+    // columns is a mask of TrackColumns::bit() saying what changed.
+    void tracksChanged(const std::vector<int> &indexes, unsigned int columns);
+
+    void switchList(int list);
+
+    void showList(int list);
+
+    void showSmart(int index);
+
+    void updateTitle();
+
+    // The tracks of the playlist being played (the library or a named
+    // one), in its own order, as playlist indexes.
+    int orderSize();
+
+    int trackInOrder(int position);
+
+    int orderIndexOf(int index);
+
+    int positionCount();
+
+    int trackAt(int position);
+
+    bool isPlayable(int index);
+
+    int getIndex();
+
+    bool repeat = false;
+
+    bool shuffle = false;
+
+    int lCounter = 0;
+
+    int playingId = -1;
+
+    // The file given to the player, and where in it the playing track lies
+    // (segmentEnd -1 for the end of the file).
+    string playingFile;
+
+    qint64 segmentStart = 0;
+
+    qint64 segmentEnd = -1;
+
+    // The sheet of the last cue sheet track played.
+    CueSheet playingSheet;
+
+    // Where to go once the player has loaded the file.
+    qint64 pendingSeek = -1;
+
+    Ui::MainWindow *ui;
+
+    QMediaPlayer* player;
+
+    QAudioOutput* audioOutput;
+
+    Playlist playlist;
+
+    TrackListModel *model;
+
+    TagScanner *scanner;
+
+    CoverArt *covers;
+
+    FolderScanner *folderScanner;
+
+    PlaylistFile *playlistFile;
+
+    // The named playlist an import is filling, or -1.
+    int importList = -1;
+
+    // The tracks an export writes, and how many were handed over so far.
+    std::vector<unsigned int> exportIds;
+
+    size_t exported = 0;
+
+    LibraryWatcher *libraryWatcher;
+
+    DuplicateFinder *duplicateFinder;
+
+    FingerprintScanner *fingerprintScanner;
+
+    TempoScanner *tempoScanner;
+
+    TrackChecker *trackChecker;
+
+    MetadataCache cache{"metadata.cache"};
+
+    ListeningLog listening{"listening"};
+
+    bool startLogged = false;
+
+    QTimer *updater = new QTimer(this);
+
+    QTimer *checkTimer = new QTimer(this);
+
+    // Positions in it are what lCounter counts while shuffling.
+    ShuffleOrder shuffleOrder;
+
+    PlayQueue queue;
+
+    PlayHistory history{"history"};
+
+    bool walkingHistory = false;
+
+    SmartPlaylists smartPlaylists{"smartplaylists"};
+
+    // The smart playlist shown in the list, or -1 for all tracks.
+    int shownSmart = -1;
+
+    NamedPlaylists namedPlaylists{"playlists"};
+
+    // Entries for the named and smart playlists in the Playlists menu.
+    std::vector<QAction *> playlistActions;
+
+protected:
+    void keyPressEvent(QKeyEvent *event);
+
+};
+#endif // MAINWINDOW_H
@@ -0,0 +1,211 @@
+#include "metadatacache.h"
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <vector>
+#include "hash.h"
+
+namespace {
+
+// Layout, little endian:
+//   header  "KPMC", version, record count, reserved         16 bytes
+//   records sorted by key                          count * RecordSize
+//   string pool
+//
+// Record: key u64, size i64, modified i64, year, duration, trackNumber,
+// sampleRate, bitrate (i32 each), then offset and length (u32 each) of
+// title, artist, album and genre in the string pool, then bpm (i32; 0 in
+// caches written before it was kept, which reads as not analysed yet).
+const char Magic[4] = { 'K', 'P', 'M', 'C' };
+const quint32 Version = 1;
+const qint64 HeaderSize = 16;
+const qint64 RecordSize = 80;
+const int TextFields = 4;
+
+string *textField(TrackInfo &info, int field)
+{
+    string *fields[TextFields] = { &info.title, &info.artist, &info.album, &info.genre };
+    return fields[field];
+}
+
+int *numberField(TrackInfo &info, int field)
+{
+    int *fields[5] = { &info.year, &info.duration, &info.trackNumber, &info.sampleRate, &info.bitrate };
+    return fields[field];
+}
+
+unsigned long long keyOf(const string &location)
+{
+    return Hash64::of(location);
+}
+
+}
+
+MetadataCache::MetadataCache(const QString &path)
+    : path(path)
+{
+    open();
+}
+
+MetadataCache::~MetadataCache()
+{
+    close();
+}
+
+void MetadataCache::open()
+{
+    file.setFileName(path);
+    if(!file.open(QIODevice::ReadOnly) || file.size() < HeaderSize)
+        return;
+
+    const uchar *data = file.map(0, file.size());
+    if(!data || memcmp(data, Magic, 4) != 0 || qFromLittleEndian<quint32>(data + 4) != Version)
+    {
+        if(data)
+            file.unmap(const_cast<uchar *>(data));
+        file.close();
+        return;
+    }
+
+    quint32 records = qFromLittleEndian<quint32>(data + 8);
+    if(HeaderSize + qint64(records) * RecordSize > file.size())
+    {
+        file.unmap(const_cast<uchar *>(data));
+        file.close();
+        return;
+    }
+
+    table = data;
+    tableSize = file.size();
+    count = records;
+}
+
+void MetadataCache::close()
+{
+    if(table)
+        file.unmap(const_cast<uchar *>(table));
+    file.close();
+    table = nullptr;
+    tableSize = 0;
+    count = 0;
+}
+
+bool MetadataCache::findMapped(unsigned long long key, Entry &entry) const
+{
+    quint32 low = 0, high = count;
+    while(low < high)
+    {
+        quint32 mid = low + (high - low) / 2;
+        const uchar *record = table + HeaderSize + qint64(mid) * RecordSize;
+        quint64 midKey = qFromLittleEndian<quint64>(record);
+
+        if(midKey < key)
+            low = mid + 1;
+        else if(midKey > key)
+            high = mid;
+        else
+        {
+            entry.size = qFromLittleEndian<qint64>(record + 8);
+            entry.modified = qFromLittleEndian<qint64>(record + 16);
+            for(int f = 0; f < 5; f++)
+                *numberField(entry.info, f) = qFromLittleEndian<qint32>(record + 24 + 4 * f);
+
+            for(int f = 0; f < TextFields; f++)
+            {
+                quint32 offset = qFromLittleEndian<quint32>(record + 44 + 4 * f);
+                quint32 length = qFromLittleEndian<quint32>(record + 60 + 4 * f);
+                if(qint64(offset) + length > tableSize)
+                    return false;
+                textField(entry.info, f)->assign(reinterpret_cast<const char *>(table + offset), length);
+            }
+            entry.info.bpm = qFromLittleEndian<qint32>(record + 76);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MetadataCache::find(const string &location, Entry &entry) const
+{
+    unsigned long long key = keyOf(location);
+
+    auto it = pending.find(key);
+    if(it != pending.end())
+    {
+        entry = it->second;
+        return true;
+    }
+
+    return table && findMapped(key, entry);
+}
+
+void MetadataCache::insert(const string &location, const Entry &entry)
+{
+    pending[keyOf(location)] = entry;
+}
+
+bool MetadataCache::save()
+{
+    if(pending.empty())
+        return true;
+
+    // Merge the mapped table with the new entries; new ones win.
+    std::vector<std::pair<unsigned long long, Entry>> entries;
+    entries.reserve(count + pending.size());
+    for(quint32 i = 0; i < count; i++)
+    {
+        quint64 key = qFromLittleEndian<quint64>(table + HeaderSize + qint64(i) * RecordSize);
+        Entry entry;
+        if(pending.find(key) == pending.end() && findMapped(key, entry))
+            entries.push_back({key, entry});
+    }
+    for(const auto &p : pending)
+        entries.push_back(p);
+
+    std::sort(entries.begin(), entries.end(), [](const std::pair<unsigned long long, Entry> &a,
+                                                 const std::pair<unsigned long long, Entry> &b) {
+        return a.first < b.first;
+    });
+
+    QByteArray records(int(HeaderSize + qint64(entries.size()) * RecordSize), '\0');
+    QByteArray pool;
+    uchar *out = reinterpret_cast<uchar *>(records.data());
+    memcpy(out, Magic, 4);
+    qToLittleEndian<quint32>(Version, out + 4);
+    qToLittleEndian<quint32>(quint32(entries.size()), out + 8);
+
+    const qint64 poolStart = records.size();
+    for(size_t i = 0; i < entries.size(); i++)
+    {
+        uchar *record = out + HeaderSize + qint64(i) * RecordSize;
+        Entry &entry = entries[i].second;
+        qToLittleEndian<quint64>(entries[i].first, record);
+        qToLittleEndian<qint64>(entry.size, record + 8);
+        qToLittleEndian<qint64>(entry.modified, record + 16);
+        for(int f = 0; f < 5; f++)
+            qToLittleEndian<qint32>(*numberField(entry.info, f), record + 24 + 4 * f);
+
+        for(int f = 0; f < TextFields; f++)
+        {
+            const string &text = *textField(entry.info, f);
+            qToLittleEndian<quint32>(quint32(poolStart + pool.size()), record + 44 + 4 * f);
+            qToLittleEndian<quint32>(quint32(text.size()), record + 60 + 4 * f);
+            pool.append(text.data(), int(text.size()));
+        }
+        qToLittleEndian<qint32>(entry.info.bpm, record + 76);
+    }
+
+    // Written next to the old file, which is only replaced once the new
+    // one is complete.
+    QSaveFile temp(path);
+    if(!temp.open(QIODevice::WriteOnly) || temp.write(records) != records.size() || temp.write(pool) != pool.size())
+        return false;
+
+    // The old table has to be unmapped before it can be replaced.
+    close();
+    bool ok = temp.commit();
+    if(ok)
+        pending.clear();
+    open();
+    return ok;
+}
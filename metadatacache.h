@@ -0,0 +1,59 @@
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <QFile>
+#include <QString>
+#include <unordered_map>
+#include "tagreader.h"
+
+// On-disk cache of TrackInfo keyed by a 64-bit hash of the file location.
+// Each entry remembers the file size and modification time it was read
+// from, so callers can tell whether the file changed since.
+//
+// The file is a sorted table of fixed-size records followed by a string
+// pool. It is memory mapped and binary searched in place, so loading the
+// cache costs nothing until entries are looked up. New entries are kept in
+// memory and merged into a fresh table by save().
+class MetadataCache
+{
+public:
+    struct Entry
+    {
+        long long size = -1;
+
+        long long modified = -1; // ms since epoch
+
+        TrackInfo info;
+    };
+
+    MetadataCache(const QString &path);
+
+    ~MetadataCache();
+
+    bool find(const string &location, Entry &entry) const;
+
+    void insert(const string &location, const Entry &entry);
+
+    bool save();
+
+private:
+    void open();
+
+    void close();
+
+    bool findMapped(unsigned long long key, Entry &entry) const;
+
+    QString path;
+
+    QFile file;
+
+    const uchar *table = nullptr;
+
+    qint64 tableSize = 0;
+
+    quint32 count = 0;
+
+    std::unordered_map<unsigned long long, Entry> pending;
+};
+
+#endif // METADATACACHE_H
@@ -0,0 +1,240 @@
+#include "namedplaylists.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include "hash.h"
+
+namespace {
+
+// Layout, little endian:
+//   header  "KPNL", version, playlist count, active playlist (i32),
+//           library position (i32), reserved, library seed (u64)  32 bytes
+// then for every playlist:
+//   name length (u16), name (UTF-8), position (i32), seed (u64),
+//   track count (u32), one location key (u64) per track
+const char Magic[4] = { 'K', 'P', 'N', 'L' };
+const quint32 Version = 1;
+const int HeaderSize = 32;
+
+}
+
+NamedPlaylists::NamedPlaylists(const QString &path)
+    : path(path)
+{
+}
+
+void NamedPlaylists::load(Playlist &library)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+
+    QByteArray bytes = file.readAll();
+    file.close();
+    const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+    const uchar *end = data + bytes.size();
+    if(bytes.size() < HeaderSize || memcmp(data, Magic, 4) != 0 || qFromLittleEndian<quint32>(data + 4) != Version)
+        return;
+
+    std::unordered_map<uint64_t, unsigned int> ids;
+    for(Track &track : library.tracks)
+        ids[Hash64::of(track.getLocation())] = track.getId();
+
+    quint32 count = qFromLittleEndian<quint32>(data + 8);
+    active = qFromLittleEndian<qint32>(data + 12);
+    this->library.position = qFromLittleEndian<qint32>(data + 16);
+    this->library.seed = qFromLittleEndian<quint64>(data + 24);
+
+    // A file cut short keeps the playlists read in full before the cut.
+    const uchar *p = data + HeaderSize;
+    for(quint32 i = 0; i < count; i++)
+    {
+        if(end - p < 2)
+            break;
+        quint16 length = qFromLittleEndian<quint16>(p);
+        if(end - p < 2 + length + 16)
+            break;
+
+        List list;
+        list.name.assign(reinterpret_cast<const char *>(p + 2), length);
+        p += 2 + length;
+        list.position = qFromLittleEndian<qint32>(p);
+        list.seed = qFromLittleEndian<quint64>(p + 4);
+        quint32 tracks = qFromLittleEndian<quint32>(p + 12);
+        p += 16;
+        if(quint64(end - p) < quint64(tracks) * 8)
+            break;
+
+        vector<unsigned int> found;
+        for(quint32 t = 0; t < tracks; t++, p += 8)
+        {
+            auto it = ids.find(qFromLittleEndian<quint64>(p));
+            if(it != ids.end())
+                found.push_back(it->second);
+        }
+        lists.push_back(list);
+        append(int(lists.size()) - 1, found);
+    }
+
+    if(active < -1 || active >= int(lists.size()))
+        active = -1;
+}
+
+bool NamedPlaylists::save(Playlist &library)
+{
+    size_t size = HeaderSize;
+    for(const List &list : lists)
+        size += 2 + std::min(list.name.size(), size_t(0xffff)) + 16 + list.ids.size() * 8;
+
+    QByteArray bytes(int(size), '\0');
+    uchar *out = reinterpret_cast<uchar *>(bytes.data());
+    memcpy(out, Magic, 4);
+    qToLittleEndian<quint32>(Version, out + 4);
+    qToLittleEndian<quint32>(quint32(lists.size()), out + 8);
+    qToLittleEndian<qint32>(active, out + 12);
+    qToLittleEndian<qint32>(this->library.position, out + 16);
+    qToLittleEndian<quint64>(this->library.seed, out + 24);
+    out += HeaderSize;
+
+    for(const List &list : lists)
+    {
+        quint16 length = quint16(std::min(list.name.size(), size_t(0xffff)));
+        qToLittleEndian<quint16>(length, out);
+        memcpy(out + 2, list.name.data(), length);
+        out += 2 + length;
+        qToLittleEndian<qint32>(list.position, out);
+        qToLittleEndian<quint64>(list.seed, out + 4);
+        qToLittleEndian<quint32>(quint32(list.ids.size()), out + 12);
+        out += 16;
+
+        for(unsigned int id : list.ids)
+        {
+            int index = library.indexOf(id);
+            qToLittleEndian<quint64>(index == -1 ? 0 : Hash64::of(library.tracks[index].getLocation()), out);
+            out += 8;
+        }
+    }
+
+    // Written next to the old file, which is only replaced once the new
+    // one is complete, so a crash halfway leaves the old one.
+    QSaveFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size() && file.commit();
+}
+
+int NamedPlaylists::size() const
+{
+    return int(lists.size());
+}
+
+const string &NamedPlaylists::getName(int index) const
+{
+    return lists[index].name;
+}
+
+const vector<unsigned int> &NamedPlaylists::getIds(int index) const
+{
+    return at(index).ids;
+}
+
+int NamedPlaylists::positionOf(int index, unsigned int id) const
+{
+    const List &list = at(index);
+    auto found = list.positions.find(id);
+    return found == list.positions.end() ? -1 : found->second;
+}
+
+int NamedPlaylists::create(string name, const vector<unsigned int> &ids)
+{
+    List list;
+    list.name = name;
+    lists.push_back(list);
+    append(int(lists.size()) - 1, ids);
+    return int(lists.size()) - 1;
+}
+
+void NamedPlaylists::remove(int index)
+{
+    lists.erase(lists.begin() + index);
+    if(active == index)
+        active = -1;
+    else if(active > index)
+        active--;
+}
+
+vector<unsigned int> NamedPlaylists::append(int index, const vector<unsigned int> &ids)
+{
+    // Imports append in batches, so this costs the batch, not a pass over
+    // the whole playlist per track.
+    List &list = lists[index];
+    vector<unsigned int> appended;
+    for(unsigned int id : ids)
+    {
+        if(list.positions.emplace(id, int(list.ids.size())).second)
+        {
+            list.ids.push_back(id);
+            appended.push_back(id);
+        }
+    }
+    return appended;
+}
+
+void NamedPlaylists::removeTracks(int index, vector<unsigned int> ids)
+{
+    std::sort(ids.begin(), ids.end());
+    List &list = lists[index];
+    auto removed = [&ids](unsigned int id) {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    };
+    auto first = std::find_if(list.ids.begin(), list.ids.end(), removed);
+    if(first == list.ids.end())
+        return;
+
+    // Only the tracks after the first removed one move.
+    size_t from = size_t(first - list.ids.begin());
+    for(unsigned int id : ids)
+        list.positions.erase(id);
+    list.ids.erase(std::remove_if(first, list.ids.end(), removed), list.ids.end());
+    for(size_t i = from; i < list.ids.size(); i++)
+        list.positions[list.ids[i]] = int(i);
+}
+
+void NamedPlaylists::tracksRemoved(const vector<unsigned int> &ids)
+{
+    for(int i = 0; i < int(lists.size()); i++)
+        removeTracks(i, ids);
+}
+
+int NamedPlaylists::getPosition(int index) const
+{
+    return at(index).position;
+}
+
+uint64_t NamedPlaylists::getSeed(int index) const
+{
+    return at(index).seed;
+}
+
+void NamedPlaylists::setState(int index, int position, uint64_t seed)
+{
+    List &list = index == -1 ? library : lists[index];
+    list.position = position;
+    list.seed = seed;
+}
+
+int NamedPlaylists::getActive() const
+{
+    return active;
+}
+
+void NamedPlaylists::setActive(int index)
+{
+    active = index;
+}
+
+const NamedPlaylists::List &NamedPlaylists::at(int index) const
+{
+    return index == -1 ? library : lists[index];
+}
@@ -0,0 +1,93 @@
+#ifndef NAMEDPLAYLISTS_H
+#define NAMEDPLAYLISTS_H
+
+#include <QString>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "playlist.h"
+
+using namespace std;
+
+// Playlists made and named by the user. Each one is an ordered list of
+// track ids into the library, the Playlist every track lives in, so a
+// track that is in many playlists is still stored once. Every playlist,
+// and the library itself (index -1), also remembers where playback was and
+// the shuffle seed, so switching back carries on with the same order from
+// the same place.
+//
+// Everything is saved in one file. Tracks are saved as the keys of their
+// locations, because ids are handed out afresh every session.
+class NamedPlaylists
+{
+public:
+    NamedPlaylists(const QString &path);
+
+    // Reads the saved playlists, keeping the tracks that are still in
+    // library.
+    void load(Playlist &library);
+
+    bool save(Playlist &library);
+
+    int size() const;
+
+    const string &getName(int index) const;
+
+    const vector<unsigned int> &getIds(int index) const;
+
+    // Where a track is in playlist index, or -1.
+    int positionOf(int index, unsigned int id) const;
+
+    // Returns the index of the new playlist.
+    int create(string name, const vector<unsigned int> &ids);
+
+    void remove(int index);
+
+    // Appends the tracks that are not in the playlist yet and returns them.
+    vector<unsigned int> append(int index, const vector<unsigned int> &ids);
+
+    void removeTracks(int index, vector<unsigned int> ids);
+
+    // Drops tracks that left the library from every playlist.
+    void tracksRemoved(const vector<unsigned int> &ids);
+
+    int getPosition(int index) const;
+
+    uint64_t getSeed(int index) const;
+
+    void setState(int index, int position, uint64_t seed);
+
+    // The playlist being played, or -1 for the library.
+    int getActive() const;
+
+    void setActive(int index);
+
+private:
+    struct List
+    {
+        string name;
+
+        vector<unsigned int> ids;
+
+        // Where each id is in ids, to tell quickly whether and where a
+        // track is in.
+        unordered_map<unsigned int, int> positions;
+
+        int position = 0;
+
+        uint64_t seed = 0;
+    };
+
+    const List &at(int index) const;
+
+    QString path;
+
+    vector<List> lists;
+
+    List library;
+
+    int active = -1;
+};
+
+#endif // NAMEDPLAYLISTS_H
@@ -0,0 +1,103 @@
+#include "pathindex.h"
+#include "hash.h"
+
+namespace {
+
+const size_t InitialSlots = 1024;
+
+}
+
+void PathIndex::insert(uint64_t key, unsigned int id)
+{
+    // Kept at most 70% full so probe sequences stay short.
+    if((count + 1) * 10 > table.size() * 7)
+        grow();
+
+    size_t i = key & mask;
+    while(table[i].id != Empty)
+        i = (i + 1) & mask;
+
+    table[i].key = key;
+    table[i].id = id;
+    count++;
+}
+
+bool PathIndex::erase(uint64_t key, unsigned int id)
+{
+    if(table.empty())
+        return false;
+
+    size_t i = key & mask;
+    while(table[i].id != Empty && (table[i].key != key || table[i].id != id))
+        i = (i + 1) & mask;
+    if(table[i].id == Empty)
+        return false;
+
+    // Move back every following entry that may no longer be reachable
+    // across the hole: those whose home slot is not between the hole and
+    // their current position.
+    size_t hole = i;
+    for(size_t j = (i + 1) & mask; table[j].id != Empty; j = (j + 1) & mask)
+    {
+        size_t home = table[j].key & mask;
+        if(((j - home) & mask) >= ((j - hole) & mask))
+        {
+            table[hole] = table[j];
+            hole = j;
+        }
+    }
+    table[hole].id = Empty;
+    count--;
+    return true;
+}
+
+void PathIndex::clear()
+{
+    table.clear();
+    mask = 0;
+    count = 0;
+}
+
+size_t PathIndex::size() const
+{
+    return count;
+}
+
+void PathIndex::grow()
+{
+    vector<Slot> old;
+    old.swap(table);
+
+    size_t capacity = old.empty() ? InitialSlots : old.size() * 2;
+    table.assign(capacity, Slot{0, Empty});
+    mask = capacity - 1;
+    count = 0;
+
+    for(const Slot &slot : old)
+    {
+        if(slot.id != Empty)
+            insert(slot.key, slot.id);
+    }
+}
+
+string PathIndex::normalize(const string &path)
+{
+#ifdef _WIN32
+    string normalized = path;
+    for(char &c : normalized)
+    {
+        if(c == '\\')
+            c = '/';
+        else if(c >= 'A' && c <= 'Z')
+            c = char(c + ('a' - 'A'));
+    }
+    return normalized;
+#else
+    return path;
+#endif
+}
+
+uint64_t PathIndex::keyOf(const string &path)
+{
+    return Hash64::of(normalize(path));
+}
@@ -0,0 +1,66 @@
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Hash table from a 64-bit key (the hash of a normalised path) to track
+// ids. Open addressing with linear probing over a flat array of 16-byte
+// slots, so a lookup is normally one cache line; removal shifts the
+// following entries back instead of leaving tombstones, so the table never
+// degrades. A key may hold several ids when paths collide, so callers
+// confirm a match against the real path.
+class PathIndex
+{
+public:
+    void insert(uint64_t key, unsigned int id);
+
+    bool erase(uint64_t key, unsigned int id);
+
+    void clear();
+
+    size_t size() const;
+
+    // Calls visit(id) for every id stored under key until it returns true.
+    template<typename Visit>
+    void forEach(uint64_t key, Visit visit) const
+    {
+        if(table.empty())
+            return;
+
+        for(size_t i = key & mask; table[i].id != Empty; i = (i + 1) & mask)
+        {
+            if(table[i].key == key && visit(table[i].id))
+                return;
+        }
+    }
+
+    // Paths compare equal after normalising: on Windows separators are
+    // unified and case is folded, as the file system does.
+    static string normalize(const string &path);
+
+    static uint64_t keyOf(const string &path);
+
+private:
+    static const unsigned int Empty = 0xffffffffu;
+
+    struct Slot
+    {
+        uint64_t key;
+
+        unsigned int id;
+    };
+
+    void grow();
+
+    vector<Slot> table;
+
+    size_t mask = 0;
+
+    size_t count = 0;
+};
+
+#endif // PATHINDEX_H
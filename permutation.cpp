@@ -0,0 +1,83 @@
+#include "permutation.h"
+#include <random>
+
+namespace {
+
+// splitmix64 finaliser: every input bit reaches every output bit.
+inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+}
+
+Permutation::Permutation(uint64_t size, uint64_t seed)
+    : count(size)
+{
+    while(halfBits < 32 && (uint64_t(1) << (2 * halfBits)) < size)
+        halfBits++;
+    halfMask = (uint64_t(1) << halfBits) - 1;
+
+    std::mt19937_64 random(seed);
+    for(int r = 0; r < Rounds; r++)
+        keys[r] = random();
+}
+
+uint64_t Permutation::size() const
+{
+    return count;
+}
+
+uint64_t Permutation::round(int r, uint64_t half) const
+{
+    return mix(half ^ keys[r]) & halfMask;
+}
+
+uint64_t Permutation::encrypt(uint64_t x) const
+{
+    uint64_t left = x >> halfBits;
+    uint64_t right = x & halfMask;
+    for(int r = 0; r < Rounds; r++)
+    {
+        uint64_t next = left ^ round(r, right);
+        left = right;
+        right = next;
+    }
+    return (left << halfBits) | right;
+}
+
+uint64_t Permutation::decrypt(uint64_t x) const
+{
+    uint64_t left = x >> halfBits;
+    uint64_t right = x & halfMask;
+    for(int r = Rounds - 1; r >= 0; r--)
+    {
+        uint64_t previous = right ^ round(r, left);
+        right = left;
+        left = previous;
+    }
+    return (left << halfBits) | right;
+}
+
+uint64_t Permutation::map(uint64_t position) const
+{
+    // Walking the cycle from a value inside the range always comes back
+    // into it, so this ends.
+    uint64_t x = encrypt(position);
+    while(x >= count)
+        x = encrypt(x);
+    return x;
+}
+
+uint64_t Permutation::unmap(uint64_t value) const
+{
+    uint64_t x = decrypt(value);
+    while(x >= count)
+        x = decrypt(x);
+    return x;
+}
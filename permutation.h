@@ -0,0 +1,41 @@
+#ifndef PERMUTATION_H
+#define PERMUTATION_H
+
+#include <cstdint>
+
+// A random permutation of 0..size-1 that is computed, not stored: a
+// four-round Feistel network over the smallest even number of bits that
+// covers size, with cycle walking to stay inside the range (values that
+// land outside are fed through again; the domain is under 4 * size, so
+// that takes fewer than four rounds on average). Both directions are O(1)
+// time and memory, whatever the size.
+class Permutation
+{
+public:
+    Permutation(uint64_t size = 0, uint64_t seed = 0);
+
+    uint64_t size() const;
+
+    uint64_t map(uint64_t position) const;
+
+    uint64_t unmap(uint64_t value) const;
+
+private:
+    static const int Rounds = 4;
+
+    uint64_t round(int r, uint64_t half) const;
+
+    uint64_t encrypt(uint64_t x) const;
+
+    uint64_t decrypt(uint64_t x) const;
+
+    uint64_t count;
+
+    int halfBits = 1;
+
+    uint64_t halfMask = 1;
+
+    uint64_t keys[Rounds];
+};
+
+#endif // PERMUTATION_H
@@ -0,0 +1,148 @@
+#include "playhistory.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+// Layout: "KPHL", version (u32 LE), then one u64 LE key per play.
+const char Magic[4] = { 'K', 'P', 'H', 'L' };
+const quint32 Version = 1;
+const int HeaderSize = 8;
+const int RecordSize = 8;
+
+// The log is rewritten when it holds this many times the capacity.
+const int CompactFactor = 8;
+
+}
+
+PlayHistory::PlayHistory(const QString &path, int capacity)
+    : path(path)
+    , ring(size_t(capacity > 0 ? capacity : 1))
+{
+}
+
+vector<uint64_t> PlayHistory::loadKeys()
+{
+    vector<uint64_t> keys;
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return keys;
+
+    QByteArray bytes = file.readAll();
+    file.close();
+    const uchar *data = reinterpret_cast<const uchar *>(bytes.constData());
+    if(bytes.size() < HeaderSize || memcmp(data, Magic, 4) != 0 || qFromLittleEndian<quint32>(data + 4) != Version)
+    {
+        QFile::remove(path);
+        return keys;
+    }
+
+    // Only the newest plays fit in the ring anyway.
+    qint64 records = (bytes.size() - HeaderSize) / RecordSize;
+    qint64 from = records > qint64(ring.size()) ? records - qint64(ring.size()) : 0;
+    for(qint64 r = from; r < records; r++)
+        keys.push_back(qFromLittleEndian<quint64>(data + HeaderSize + r * RecordSize));
+
+    if(records > qint64(ring.size()) * CompactFactor)
+        append(keys, true);
+    return keys;
+}
+
+void PlayHistory::restore(unsigned int id)
+{
+    push(id);
+}
+
+void PlayHistory::played(unsigned int id, uint64_t key)
+{
+    if(count > 0 && at(count - 1) == id)
+    {
+        cursor = count - 1;
+        return;
+    }
+
+    push(id);
+    append(vector<uint64_t>(1, key), false);
+}
+
+bool PlayHistory::back(unsigned int &id)
+{
+    if(cursor <= 0)
+        return false;
+
+    id = at(--cursor);
+    return true;
+}
+
+bool PlayHistory::forward(unsigned int &id)
+{
+    if(cursor >= count - 1)
+        return false;
+
+    id = at(++cursor);
+    return true;
+}
+
+bool PlayHistory::isAtNewest() const
+{
+    return cursor >= count - 1;
+}
+
+int PlayHistory::size() const
+{
+    return count;
+}
+
+void PlayHistory::push(unsigned int id)
+{
+    int capacity = int(ring.size());
+    if(count < capacity)
+    {
+        ring[(first + count) % capacity] = id;
+        count++;
+    }
+    else
+    {
+        ring[first] = id;
+        first = (first + 1) % capacity;
+    }
+    cursor = count - 1;
+}
+
+unsigned int PlayHistory::at(int i) const
+{
+    return ring[(first + i) % int(ring.size())];
+}
+
+bool PlayHistory::append(const vector<uint64_t> &keys, bool truncate)
+{
+    bool fresh = truncate || !QFile::exists(path);
+    QByteArray bytes((fresh ? HeaderSize : 0) + int(keys.size()) * RecordSize, '\0');
+    uchar *out = reinterpret_cast<uchar *>(bytes.data());
+    if(fresh)
+    {
+        memcpy(out, Magic, 4);
+        qToLittleEndian<quint32>(Version, out + 4);
+        out += HeaderSize;
+    }
+    for(uint64_t key : keys)
+    {
+        qToLittleEndian<quint64>(key, out);
+        out += RecordSize;
+    }
+
+    if(!truncate)
+    {
+        QFile file(path);
+        if(!file.open(fresh ? (QIODevice::WriteOnly | QIODevice::Truncate) : (QIODevice::WriteOnly | QIODevice::Append)))
+            return false;
+        return file.write(bytes) == bytes.size();
+    }
+
+    // A cut-back log is written next to the old one, which is only replaced
+    // once it is complete, so a crash halfway leaves the old one.
+    QSaveFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(bytes) == bytes.size() && file.commit();
+}
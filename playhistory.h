@@ -0,0 +1,57 @@
+#ifndef PLAYHISTORY_H
+#define PLAYHISTORY_H
+
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// The tracks actually played, newest last, in a ring buffer of fixed
+// capacity, with a cursor that back() and forward() move without
+// recording anything. Every play is also appended to a log file as the
+// 8-byte key of its location (ids do not survive a restart), so the
+// history of earlier sessions can be restored; the log is cut back to
+// the last capacity plays when it has grown well past that.
+class PlayHistory
+{
+public:
+    PlayHistory(const QString &path, int capacity = 1000);
+
+    // Keys logged in earlier sessions, oldest first.
+    vector<uint64_t> loadKeys();
+
+    // Adds a play without logging it, for restoring.
+    void restore(unsigned int id);
+
+    // Records a play and moves the cursor to it. The same track played
+    // again right away (repeat) is one entry.
+    void played(unsigned int id, uint64_t key);
+
+    bool back(unsigned int &id);
+
+    bool forward(unsigned int &id);
+
+    bool isAtNewest() const;
+
+    int size() const;
+
+private:
+    void push(unsigned int id);
+
+    unsigned int at(int i) const;
+
+    bool append(const vector<uint64_t> &keys, bool truncate);
+
+    QString path;
+
+    vector<unsigned int> ring;
+
+    int first = 0;
+
+    int count = 0;
+
+    int cursor = -1;
+};
+
+#endif // PLAYHISTORY_H
@@ -1,50 +1,234 @@
-#include "playlist.h"
-#include <fstream>
-#include "utils.h"
-
-Playlist::Playlist()
-{
-    std::ifstream read("playlist");
-    string loc;
-    while(getline(read, loc)){
-        Track track;
-        track.setLocation(loc);
-        track.setName(getNameFromLocation(loc));
-        tracks.push_back(track);
-    }
-}
-
-void Playlist::add(QStringList files)
-{
-    for(int i = 0; i < files.size(); i++)
-    {
-        Track track;
-        track.setLocation(files[i].toStdString());
-        track.setName(getNameFromLocation(files[i].toStdString()));
-        tracks.push_back(track);
-    }
-}
-
-void Playlist::remove(int index)
-{
-    tracks.erase(tracks.begin() + index);
-}
-
-void Playlist::save()
-{
-    std::ofstream write("playlist");
-    for(int i = 0; i < int(tracks.size()); i++){
-        write << tracks[i].getLocation() << std::endl;
-    }
-}
-
-QStringList Playlist::getTracksNameList()
-{
-    QStringList list;
-    for(int i = 0; i < int(tracks.size()); i++)
-    {
-        QString qstr = QString::fromStdString(tracks[i].getName());
-        list.push_back(qstr);
-    }
-    return list;
-}
+#include "playlist.h"
+#include <algorithm>
+#include <fstream>
+#include "utils.h"
+
+Playlist::Playlist()
+{
+    std::ifstream read("playlist");
+    string loc;
+    while(getline(read, loc)){
+        append(loc);
+    }
+}
+
+void Playlist::add(QStringList files)
+{
+    for(int i = 0; i < files.size(); i++)
+    {
+        append(files[i].toStdString());
+    }
+}
+
+void Playlist::add(const std::vector<string> &locations)
+{
+    for(const string &location : locations)
+    {
+        append(location);
+    }
+}
+
+// Locations already in the playlist are skipped, so adding a file or a
+// folder twice does not duplicate tracks.
+bool Playlist::append(string location)
+{
+    if(indexOfLocation(location) != -1)
+        return false;
+
+    Track track;
+    track.setLocation(location);
+    track.setName(getNameFromLocation(location));
+    track.setId(nextId++);
+    idIndex[track.getId()] = int(tracks.size());
+    tracks.push_back(track);
+    columns.append();
+    columns.setText(TrackColumns::Name, columns.size() - 1, track.getName());
+    indexLocation(int(tracks.size()) - 1);
+    return true;
+}
+
+void Playlist::indexLocation(int index)
+{
+    string location = tracks[index].getLocation();
+    unsigned int id = tracks[index].getId();
+    locationIndex.insert(PathIndex::keyOf(location), id);
+    directoryIndex[PathIndex::keyOf(getDirectoryFromLocation(location))].push_back(id);
+}
+
+void Playlist::unindexLocation(int index)
+{
+    string location = tracks[index].getLocation();
+    unsigned int id = tracks[index].getId();
+    locationIndex.erase(PathIndex::keyOf(location), id);
+
+    auto it = directoryIndex.find(PathIndex::keyOf(getDirectoryFromLocation(location)));
+    if(it != directoryIndex.end())
+    {
+        std::vector<unsigned int> &ids = it->second;
+        auto found = std::find(ids.begin(), ids.end(), id);
+        if(found != ids.end())
+            ids.erase(found);
+        if(ids.empty())
+            directoryIndex.erase(it);
+    }
+}
+
+int Playlist::indexOfLocation(const string &location)
+{
+    string normalized = PathIndex::normalize(location);
+    int found = -1;
+    locationIndex.forEach(PathIndex::keyOf(location), [&](unsigned int id) {
+        int index = indexOf(id);
+        if(index != -1 && PathIndex::normalize(tracks[index].getLocation()) == normalized)
+            found = index;
+        return found != -1;
+    });
+    return found;
+}
+
+std::vector<int> Playlist::tracksIn(const string &directory)
+{
+    std::vector<int> indexes;
+    auto it = directoryIndex.find(PathIndex::keyOf(directory));
+    if(it == directoryIndex.end())
+        return indexes;
+
+    string normalized = PathIndex::normalize(directory);
+    for(unsigned int id : it->second)
+    {
+        int index = indexOf(id);
+        if(index != -1 && PathIndex::normalize(getDirectoryFromLocation(tracks[index].getLocation())) == normalized)
+            indexes.push_back(index);
+    }
+    return indexes;
+}
+
+void Playlist::setInfo(int index, const TrackInfo &info)
+{
+    if(!info.title.empty())
+    {
+        tracks[index].setName(info.artist.empty() ? info.title : info.artist + " - " + info.title);
+        columns.setText(TrackColumns::Name, index, tracks[index].getName());
+    }
+
+    columns.setText(TrackColumns::Title, index, info.title);
+    columns.setText(TrackColumns::Artist, index, info.artist);
+    columns.setText(TrackColumns::Album, index, info.album);
+    columns.setText(TrackColumns::Genre, index, info.genre);
+    columns.setNumber(TrackColumns::Year, index, info.year);
+    totalDuration += info.duration - columns.number(TrackColumns::Duration)[index];
+    columns.setNumber(TrackColumns::Duration, index, info.duration);
+    columns.setNumber(TrackColumns::TrackNumber, index, info.trackNumber);
+    columns.setNumber(TrackColumns::SampleRate, index, info.sampleRate);
+    columns.setNumber(TrackColumns::Bitrate, index, info.bitrate);
+    columns.setNumber(TrackColumns::Bpm, index, std::max(0, info.bpm));
+}
+
+void Playlist::setTempo(int index, int bpm)
+{
+    columns.setNumber(TrackColumns::Bpm, index, std::max(0, bpm));
+}
+
+void Playlist::setStats(int index, int starts, int skips, long long lastPlayed)
+{
+    columns.setNumber(TrackColumns::Plays, index, std::max(0, starts - skips));
+    columns.setNumber(TrackColumns::Skips, index, skips);
+    columns.setNumber(TrackColumns::SkipRate, index, starts > 0 ? skips * 100 / starts : 0);
+    columns.setNumber(TrackColumns::LastPlayed, index, int(lastPlayed / 86400));
+}
+
+void Playlist::remove(int index)
+{
+    unindexLocation(index);
+    idIndex.erase(tracks[index].getId());
+    totalDuration -= columns.number(TrackColumns::Duration)[index];
+    tracks.erase(tracks.begin() + index);
+    columns.erase(index);
+    reindex(index);
+}
+
+void Playlist::remove(std::vector<int> indexes)
+{
+    if(indexes.empty())
+        return;
+
+    // One compaction pass instead of shifting the tail once per track.
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+    const vector<int> &durations = columns.number(TrackColumns::Duration);
+    for(int index : indexes)
+    {
+        unindexLocation(index);
+        idIndex.erase(tracks[index].getId());
+        totalDuration -= durations[index];
+    }
+
+    size_t out = size_t(indexes.front());
+    size_t next = 0;
+    for(size_t i = out; i < tracks.size(); i++)
+    {
+        if(next < indexes.size() && int(i) == indexes[next])
+        {
+            next++;
+            continue;
+        }
+        tracks[out++] = std::move(tracks[i]);
+    }
+    tracks.resize(out);
+    columns.erase(indexes);
+    reindex(indexes.front());
+}
+
+void Playlist::setLocation(int index, string location)
+{
+    // Keep a name that came from tags; one made from the file name follows
+    // the file.
+    if(tracks[index].getName() == getNameFromLocation(tracks[index].getLocation()))
+    {
+        tracks[index].setName(getNameFromLocation(location));
+        columns.setText(TrackColumns::Name, index, tracks[index].getName());
+    }
+    unindexLocation(index);
+    tracks[index].setLocation(location);
+    tracks[index].setStatus(Track::Unchecked);
+    indexLocation(index);
+}
+
+void Playlist::reindex(int from)
+{
+    for(int i = from; i < int(tracks.size()); i++)
+    {
+        idIndex[tracks[i].getId()] = i;
+    }
+}
+
+long long Playlist::getTotalDuration()
+{
+    return totalDuration;
+}
+
+int Playlist::indexOf(unsigned int id)
+{
+    auto it = idIndex.find(id);
+    return it == idIndex.end() ? -1 : it->second;
+}
+
+void Playlist::save()
+{
+    std::ofstream write("playlist");
+    for(int i = 0; i < int(tracks.size()); i++){
+        write << tracks[i].getLocation() << std::endl;
+    }
+}
+
+QStringList Playlist::getTracksNameList()
+{
+    QStringList list;
+    for(int i = 0; i < int(tracks.size()); i++)
+    {
+        QString qstr = QString::fromStdString(tracks[i].getName());
+        list.push_back(qstr);
+    }
+    return list;
+}
@@ -1,27 +1,73 @@
-#ifndef PLAYLIST_H
-#define PLAYLIST_H
-
-#include <QStringList>
-#include <vector>
-#include "track.h"
-
-
-class Playlist
-{
-public:
-    Playlist();
-
-    void add(QStringList files);
-
-    void remove(int index);
-
-    void save();
-
-    QStringList getTracksNameList();
-
-    std::vector<Track> tracks;
-
-private:
-
-};
-#endif // PLAYLIST_H
+#ifndef PLAYLIST_H
+#define PLAYLIST_H
+
+#include <QStringList>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "pathindex.h"
+#include "tagreader.h"
+#include "track.h"
+#include "trackcolumns.h"
+
+
+class Playlist
+{
+public:
+    Playlist();
+
+    void add(QStringList files);
+
+    void add(const std::vector<string> &locations);
+
+    void remove(int index);
+
+    void remove(std::vector<int> indexes);
+
+    void setLocation(int index, string location);
+
+    void save();
+
+    QStringList getTracksNameList();
+
+    int indexOf(unsigned int id);
+
+    int indexOfLocation(const string &location);
+
+    std::vector<int> tracksIn(const string &directory);
+
+    void setInfo(int index, const TrackInfo &info);
+
+    void setStats(int index, int starts, int skips, long long lastPlayed);
+
+    // Beats per minute found by tempo analysis, -1 for no steady beat.
+    void setTempo(int index, int bpm);
+
+    long long getTotalDuration();
+
+    std::vector<Track> tracks;
+
+    TrackColumns columns;
+
+private:
+    bool append(string location);
+
+    void indexLocation(int index);
+
+    void unindexLocation(int index);
+
+    void reindex(int from);
+
+    unsigned int nextId = 0;
+
+    long long totalDuration = 0;
+
+    std::unordered_map<unsigned int, int> idIndex;
+
+    // Track ids by location, and by the directory holding them.
+    PathIndex locationIndex;
+
+    std::unordered_map<uint64_t, std::vector<unsigned int>> directoryIndex;
+
+};
+#endif // PLAYLIST_H
@@ -0,0 +1,316 @@
+#include "playlistfile.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QUrl>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include "utils.h"
+
+namespace {
+
+// Output collected before it is written out.
+const size_t WriteBuffer = 1 << 16;
+
+enum Format { M3u, Pls, Xspf, Unknown };
+
+Format formatOf(const QString &path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if(suffix == "m3u" || suffix == "m3u8")
+        return M3u;
+    if(suffix == "pls")
+        return Pls;
+    if(suffix == "xspf")
+        return Xspf;
+    return Unknown;
+}
+
+QString decode(const QByteArray &line)
+{
+    bool utf8 = isValidUtf8(line.constData(), size_t(line.size()));
+    return utf8 ? QString::fromUtf8(line) : QString::fromLatin1(line);
+}
+
+// A local path for an M3U or PLS entry: file URLs are decoded, Windows
+// separators turned round and relative paths resolved against base. Empty
+// for anything else, such as a web stream.
+QString resolve(QString entry, const QDir &base)
+{
+    if(entry.startsWith(QLatin1String("file:"), Qt::CaseInsensitive))
+        return QUrl(entry).toLocalFile();
+    if(entry.contains(QLatin1String("://")))
+        return QString();
+
+    entry.replace('\\', '/');
+    return QDir::cleanPath(base.absoluteFilePath(entry));
+}
+
+// Tracks under the playlist's folder are written relative to it, so the
+// folder can be moved or shared as a whole.
+string relativeTo(const string &base, const string &location)
+{
+    return location.compare(0, base.size(), base) == 0 ? location.substr(base.size()) : location;
+}
+
+string oneLine(string text)
+{
+    for(char &c : text)
+    {
+        if(c == '\n' || c == '\r')
+            c = ' ';
+    }
+    return text;
+}
+
+}
+
+struct PlaylistFile::Writer
+{
+    QFile file;
+
+    Format format = Unknown;
+
+    std::unique_ptr<QXmlStreamWriter> xml;
+
+    // Tracks under the playlist's folder are written relative to it.
+    string base;
+
+    string buffer;
+
+    size_t count = 0;
+
+    bool ok = true;
+
+    void flush()
+    {
+        ok = ok && file.write(buffer.data(), qint64(buffer.size())) == qint64(buffer.size());
+        buffer.clear();
+    }
+};
+
+PlaylistFile::PlaylistFile(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(1);
+}
+
+PlaylistFile::~PlaylistFile()
+{
+    cancelled = true;
+    pool.waitForDone();
+}
+
+bool PlaylistFile::isPlaylist(const QString &path)
+{
+    return formatOf(path) != Unknown;
+}
+
+void PlaylistFile::read(const QString &path)
+{
+    running++;
+    pool.start([this, path]() { readFile(path); });
+}
+
+void PlaylistFile::write(const QString &path)
+{
+    running++;
+    pool.start([this, path]() {
+        writer.reset(new Writer);
+        writer->file.setFileName(path);
+        writer->format = formatOf(path);
+        writer->ok = writer->file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        writer->base = QFileInfo(path).absolutePath().toStdString() + '/';
+        writer->buffer.reserve(WriteBuffer + 4096);
+
+        if(writer->format == Xspf)
+        {
+            writer->xml.reset(new QXmlStreamWriter(&writer->file));
+            QXmlStreamWriter &xml = *writer->xml;
+            xml.setAutoFormatting(true);
+            xml.writeStartDocument();
+            xml.writeStartElement("playlist");
+            xml.writeDefaultNamespace("http://xspf.org/ns/0/");
+            xml.writeAttribute("version", "1");
+            xml.writeStartElement("trackList");
+        }
+        else
+        {
+            writer->buffer += writer->format == Pls ? "[playlist]\n" : "#EXTM3U\n";
+        }
+        emit entriesWanted();
+    });
+}
+
+void PlaylistFile::writeEntries(vector<Entry> entries)
+{
+    pool.start([this, entries = std::move(entries)]() {
+        if(entries.empty())
+        {
+            finishWrite();
+            return;
+        }
+
+        Writer &out = *writer;
+        for(size_t i = 0; i < entries.size() && out.ok && !cancelled; i++)
+        {
+            const Entry &entry = entries[i];
+            out.count++;
+            if(out.format == Xspf)
+            {
+                QUrl url = QUrl::fromLocalFile(QString::fromStdString(entry.location));
+                out.xml->writeStartElement("track");
+                out.xml->writeTextElement("location", QString::fromUtf8(url.toEncoded()));
+                if(!entry.title.empty())
+                    out.xml->writeTextElement("title", QString::fromStdString(entry.title));
+                if(entry.duration > 0)
+                    out.xml->writeTextElement("duration", QString::number(entry.duration));
+                out.xml->writeEndElement();
+                continue;
+            }
+
+            string location = relativeTo(out.base, entry.location);
+            string title = oneLine(entry.title);
+            string seconds = to_string(entry.duration > 0 ? (entry.duration + 500) / 1000 : -1);
+            if(out.format == Pls)
+            {
+                string n = to_string(out.count);
+                out.buffer += "File" + n + "=" + location + "\nTitle" + n + "=" + title + "\nLength" + n + "="
+                              + seconds + "\n";
+            }
+            else
+            {
+                out.buffer += "#EXTINF:" + seconds + "," + title + "\n" + location + "\n";
+            }
+
+            if(out.buffer.size() >= WriteBuffer)
+                out.flush();
+        }
+        emit entriesWanted();
+    });
+}
+
+void PlaylistFile::finishWrite()
+{
+    Writer &out = *writer;
+    if(out.format == Xspf)
+    {
+        out.xml->writeEndDocument();
+        out.ok = out.ok && !out.xml->hasError();
+    }
+    else
+    {
+        // PLS allows the count anywhere, so it can follow the entries.
+        if(out.format == Pls)
+            out.buffer += "NumberOfEntries=" + to_string(out.count) + "\nVersion=2\n";
+        out.flush();
+    }
+    out.file.close();
+    bool ok = out.ok && out.file.error() == QFileDevice::NoError;
+    writer.reset();
+
+    running--;
+    emit written(ok);
+}
+
+bool PlaylistFile::isRunning() const
+{
+    return running > 0;
+}
+
+void PlaylistFile::readFile(const QString &path)
+{
+    vector<string> batch;
+    QDir base = QFileInfo(path).absoluteDir();
+    auto found = [&](const QString &location) {
+        if(location.isEmpty())
+            return;
+        batch.push_back(location.toStdString());
+        if(batch.size() >= EntriesPerBatch)
+            publish(batch);
+    };
+
+    QFile file(path);
+    if(file.open(QIODevice::ReadOnly) && formatOf(path) == Xspf)
+    {
+        // XSPF locations are URIs, relative ones to the playlist's own.
+        // The playlist element has a location too, so only those inside a
+        // track count.
+        QUrl baseUrl = QUrl::fromLocalFile(base.absolutePath() + '/');
+        QXmlStreamReader xml(&file);
+        bool inTrack = false;
+        while(!xml.atEnd() && !cancelled)
+        {
+            xml.readNext();
+            if(xml.isStartElement() && xml.name() == QLatin1String("track"))
+                inTrack = true;
+            else if(xml.isEndElement() && xml.name() == QLatin1String("track"))
+                inTrack = false;
+            else if(inTrack && xml.isStartElement() && xml.name() == QLatin1String("location"))
+            {
+                QUrl url = baseUrl.resolved(QUrl(xml.readElementText().trimmed()));
+                if(url.isLocalFile())
+                    found(url.toLocalFile());
+            }
+        }
+    }
+    else if(file.isOpen())
+    {
+        // Titles and lengths (#EXTINF, TitleN, LengthN) are not needed:
+        // the tracks' own tags are read once they are in the playlist.
+        bool pls = formatOf(path) == Pls;
+        bool first = true;
+        while(!file.atEnd() && !cancelled)
+        {
+            QByteArray line = file.readLine().trimmed();
+            if(first && line.startsWith("\xEF\xBB\xBF"))
+                line.remove(0, 3);
+            first = false;
+
+            if(pls)
+            {
+                int equals = line.indexOf('=');
+                if(equals < 5 || qstrnicmp(line.constData(), "file", 4) != 0)
+                    continue;
+                line = line.mid(equals + 1).trimmed();
+            }
+            else if(line.startsWith('#'))
+            {
+                continue;
+            }
+
+            if(!line.isEmpty())
+                found(resolve(decode(line), base));
+        }
+    }
+
+    publish(batch);
+    running--;
+    emit finished();
+}
+
+void PlaylistFile::publish(vector<string> &batch)
+{
+    if(batch.empty())
+        return;
+
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&mutex);
+        wasEmpty = locations.empty();
+        locations.insert(locations.end(), batch.begin(), batch.end());
+    }
+    batch.clear();
+
+    if(wasEmpty)
+        emit locationsFound();
+}
+
+vector<string> PlaylistFile::takeLocations()
+{
+    QMutexLocker locker(&mutex);
+    vector<string> taken;
+    taken.swap(locations);
+    return taken;
+}
@@ -0,0 +1,94 @@
+#ifndef PLAYLISTFILE_H
+#define PLAYLISTFILE_H
+
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Reads and writes the playlist files other players use: M3U and M3U8
+// (with #EXTINF durations and titles), PLS and XSPF, told apart by
+// extension. Both directions run on a worker thread and stream: a file is
+// read a line (or, for XSPF, an XML token) at a time and its locations are
+// handed over in batches, so even a 500k-entry playlist is parsed in
+// constant memory. Writing pulls entries a batch at a time in the same
+// way (entriesWanted(), then writeEntries()) and formats them into a large
+// write buffer instead of one write per line. Relative paths are resolved
+// against the playlist's folder; entries that are not local files (web
+// streams) are skipped. locationsFound() is emitted whenever a batch lands
+// in an empty queue and finished() once the whole file has been read.
+class PlaylistFile : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Entry
+    {
+        string location;
+
+        string title;
+
+        int duration = 0; // milliseconds, 0 when unknown
+    };
+
+    // Locations read before publishing them, and entries written per batch.
+    static const size_t EntriesPerBatch = 1024;
+
+    PlaylistFile(QObject *parent = nullptr);
+
+    ~PlaylistFile();
+
+    static bool isPlaylist(const QString &path);
+
+    void read(const QString &path);
+
+    // Starts writing path; entriesWanted() asks for the entries.
+    void write(const QString &path);
+
+    // Up to EntriesPerBatch entries, each batch after an entriesWanted().
+    // An empty batch finishes the file, and written() follows.
+    void writeEntries(vector<Entry> entries);
+
+    bool isRunning() const;
+
+    vector<string> takeLocations();
+
+signals:
+    void locationsFound();
+
+    void finished();
+
+    void entriesWanted();
+
+    void written(bool ok);
+
+private:
+    struct Writer;
+
+    void readFile(const QString &path);
+
+    void finishWrite();
+
+    void publish(vector<string> &batch);
+
+    QThreadPool pool;
+
+    QMutex mutex;
+
+    vector<string> locations;
+
+    // Touched by the pool only.
+    unique_ptr<Writer> writer;
+
+    std::atomic<int> running{0};
+
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // PLAYLISTFILE_H
@@ -0,0 +1,59 @@
+#include "playqueue.h"
+#include <algorithm>
+
+void PlayQueue::enqueue(unsigned int id)
+{
+    ids.push_back(id);
+}
+
+void PlayQueue::enqueue(const vector<unsigned int> &ids)
+{
+    this->ids.insert(this->ids.end(), ids.begin(), ids.end());
+}
+
+void PlayQueue::playNext(unsigned int id)
+{
+    ids.push_front(id);
+}
+
+bool PlayQueue::dequeue(unsigned int &id)
+{
+    if(ids.empty())
+        return false;
+
+    id = ids.front();
+    ids.pop_front();
+    return true;
+}
+
+void PlayQueue::remove(vector<unsigned int> ids)
+{
+    if(this->ids.empty() || ids.empty())
+        return;
+
+    std::sort(ids.begin(), ids.end());
+    auto end = std::remove_if(this->ids.begin(), this->ids.end(), [&ids](unsigned int id) {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    });
+    this->ids.erase(end, this->ids.end());
+}
+
+void PlayQueue::clear()
+{
+    ids.clear();
+}
+
+bool PlayQueue::isEmpty() const
+{
+    return ids.empty();
+}
+
+int PlayQueue::size() const
+{
+    return int(ids.size());
+}
+
+const deque<unsigned int> &PlayQueue::getIds() const
+{
+    return ids;
+}
@@ -0,0 +1,39 @@
+#ifndef PLAYQUEUE_H
+#define PLAYQUEUE_H
+
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+// Tracks the user asked to hear next, by id, played before the playlist
+// or shuffle order carries on. Kept in a deque (a list of fixed-size
+// blocks), so adding at either end and taking from the front are O(1)
+// and never move the ids already queued.
+class PlayQueue
+{
+public:
+    void enqueue(unsigned int id);
+
+    void enqueue(const vector<unsigned int> &ids);
+
+    void playNext(unsigned int id);
+
+    // Takes the id at the front; false when the queue is empty.
+    bool dequeue(unsigned int &id);
+
+    void remove(vector<unsigned int> ids);
+
+    void clear();
+
+    bool isEmpty() const;
+
+    int size() const;
+
+    const deque<unsigned int> &getIds() const;
+
+private:
+    deque<unsigned int> ids;
+};
+
+#endif // PLAYQUEUE_H
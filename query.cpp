@@ -0,0 +1,826 @@
+#include "query.h"
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include "textsearch.h"
+#include "utils.h"
+
+namespace {
+
+const int BatchSize = 1024;
+
+enum Op { Contains, Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+// Any text field; matches name, title, artist or album.
+const int AnyText = -1;
+
+// Days since a track was last played; compiled into a LastPlayed term.
+const int Unplayed = -2;
+
+typedef int (*Kernel)(const Query::Node &node, const TrackColumns &columns,
+                      const unsigned int *in, int n, unsigned int *out);
+
+}
+
+struct Query::Node
+{
+    enum Kind { And, Or, Not, Term };
+
+    Kind kind = Term;
+
+    vector<unique_ptr<Node>> children;
+
+    bool numeric = false;
+
+    int field = AnyText;
+
+    Op op = Contains;
+
+    // Lower-cased, so text kernels can compare it without folding again.
+    string text;
+
+    // text has no byte outside ASCII, so values can be searched in place.
+    bool ascii = true;
+
+    int value = 0;
+
+    // value was worked out from today's date.
+    bool dated = false;
+
+    Kernel kernel = nullptr;
+};
+
+namespace {
+
+typedef Query::Node Node;
+
+// ---------------------------------------------------------------- kernels
+//
+// Every kernel reads n row numbers from in and writes the matching ones to
+// out, preserving order. out may alias in.
+
+bool equalsIgnoreCase(const string &a, const string &b)
+{
+    if(a.size() != b.size())
+        return false;
+
+    for(size_t i = 0; i < a.size(); i++)
+    {
+        if(toLowerAscii(a[i]) != toLowerAscii(b[i]))
+            return false;
+    }
+
+    return true;
+}
+
+bool isAscii(const string &str)
+{
+    for(char c : str)
+    {
+        if(static_cast<unsigned char>(c) >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+// ASCII text is searched for in place. Other text can only be in values
+// that are not ASCII either; those are lowered into scratch first, the way
+// the text itself was.
+bool containsText(const Node &node, const string &value, string &scratch)
+{
+    if(node.ascii)
+        return containsLowered(value.data(), value.size(), node.text.data(), node.text.size());
+    if(isAscii(value))
+        return false;
+    toLowerUtf8(value, scratch);
+    return containsLowered(scratch.data(), scratch.size(), node.text.data(), node.text.size());
+}
+
+bool equalsText(const Node &node, const string &value, string &scratch)
+{
+    if(node.ascii)
+        return equalsIgnoreCase(value, node.text);
+    toLowerUtf8(value, scratch);
+    return scratch == node.text;
+}
+
+int containsKernel(const Node &node, const TrackColumns &columns,
+                   const unsigned int *in, int n, unsigned int *out)
+{
+    const vector<string> &column = columns.text(TrackColumns::Text(node.field));
+    string scratch;
+    int k = 0;
+    for(int i = 0; i < n; i++)
+    {
+        if(containsText(node, column[in[i]], scratch))
+            out[k++] = in[i];
+    }
+    return k;
+}
+
+int anyTextKernel(const Node &node, const TrackColumns &columns,
+                  const unsigned int *in, int n, unsigned int *out)
+{
+    const vector<string> &name = columns.text(TrackColumns::Name);
+    const vector<string> &title = columns.text(TrackColumns::Title);
+    const vector<string> &artist = columns.text(TrackColumns::Artist);
+    const vector<string> &album = columns.text(TrackColumns::Album);
+    string scratch;
+    auto contains = [&node, &scratch](const string &value) {
+        return containsText(node, value, scratch);
+    };
+
+    int k = 0;
+    for(int i = 0; i < n; i++)
+    {
+        unsigned int r = in[i];
+        if(contains(name[r]) || contains(title[r]) || contains(artist[r]) || contains(album[r]))
+            out[k++] = r;
+    }
+    return k;
+}
+
+template<bool Negate>
+int equalsKernel(const Node &node, const TrackColumns &columns,
+                 const unsigned int *in, int n, unsigned int *out)
+{
+    const vector<string> &column = columns.text(TrackColumns::Text(node.field));
+    string scratch;
+    int k = 0;
+    for(int i = 0; i < n; i++)
+    {
+        if(equalsText(node, column[in[i]], scratch) != Negate)
+            out[k++] = in[i];
+    }
+    return k;
+}
+
+template<typename Compare>
+int numberKernel(const Node &node, const TrackColumns &columns,
+                 const unsigned int *in, int n, unsigned int *out)
+{
+    const int *column = columns.number(TrackColumns::Number(node.field)).data();
+    const int value = node.value;
+    Compare compare;
+    int k = 0;
+    for(int i = 0; i < n; i++)
+    {
+        // Branch-free compaction: always store, only advance on a match.
+        out[k] = in[i];
+        k += compare(column[in[i]], value) ? 1 : 0;
+    }
+    return k;
+}
+
+int apply(const Node &node, const TrackColumns &columns,
+          const unsigned int *in, int n, unsigned int *out);
+
+int andKernel(const Node &node, const TrackColumns &columns,
+              const unsigned int *in, int n, unsigned int *out)
+{
+    if(out != in)
+        std::copy(in, in + n, out);
+
+    for(size_t c = 0; c < node.children.size() && n > 0; c++)
+        n = apply(*node.children[c], columns, out, n, out);
+
+    return n;
+}
+
+int orKernel(const Node &node, const TrackColumns &columns,
+             const unsigned int *in, int n, unsigned int *out)
+{
+    unsigned int remaining[BatchSize];
+    unsigned int matched[BatchSize];
+    unsigned int accepted[BatchSize];
+    unsigned int merged[BatchSize];
+
+    std::copy(in, in + n, remaining);
+    int left = n;
+    int taken = 0;
+
+    // Rows accepted by one branch are not offered to the next one.
+    for(size_t c = 0; c < node.children.size() && left > 0; c++)
+    {
+        int m = apply(*node.children[c], columns, remaining, left, matched);
+        if(m == 0)
+            continue;
+
+        taken = int(std::merge(accepted, accepted + taken, matched, matched + m, merged) - merged);
+        std::copy(merged, merged + taken, accepted);
+
+        // set_difference may not write over its input; merged is free
+        // again by now.
+        left = int(std::set_difference(remaining, remaining + left, matched, matched + m, merged) - merged);
+        std::copy(merged, merged + left, remaining);
+    }
+
+    std::copy(accepted, accepted + taken, out);
+    return taken;
+}
+
+int notKernel(const Node &node, const TrackColumns &columns,
+              const unsigned int *in, int n, unsigned int *out)
+{
+    unsigned int source[BatchSize];
+    unsigned int matched[BatchSize];
+
+    std::copy(in, in + n, source);
+    int m = apply(*node.children[0], columns, source, n, matched);
+    return int(std::set_difference(source, source + n, matched, matched + m, out) - out);
+}
+
+int apply(const Node &node, const TrackColumns &columns,
+          const unsigned int *in, int n, unsigned int *out)
+{
+    return node.kernel(node, columns, in, n, out);
+}
+
+// ---------------------------------------------------------------- parsing
+
+struct Token
+{
+    string text;
+
+    // Offset of the first quoted character, or npos when nothing was quoted.
+    size_t quoteAt = string::npos;
+};
+
+vector<Token> tokenize(const string &text)
+{
+    vector<Token> tokens;
+    Token current;
+    bool inQuote = false;
+    bool pending = false;
+
+    auto flush = [&]() {
+        if(pending)
+            tokens.push_back(current);
+        current = Token();
+        pending = false;
+    };
+
+    for(char c : text)
+    {
+        if(c == '"')
+        {
+            if(!inQuote && current.quoteAt == string::npos)
+                current.quoteAt = current.text.size();
+            inQuote = !inQuote;
+            pending = true;
+        }
+        else if(!inQuote && (c == ' ' || c == '\t'))
+        {
+            flush();
+        }
+        else if(!inQuote && (c == '(' || c == ')'))
+        {
+            flush();
+            current.text = string(1, c);
+            pending = true;
+            flush();
+        }
+        else
+        {
+            current.text.push_back(c);
+            pending = true;
+        }
+    }
+    flush();
+
+    return tokens;
+}
+
+bool isOperator(const Token &token, const char *word)
+{
+    return token.quoteAt == string::npos && token.text == word;
+}
+
+bool parseInteger(const string &str, int &value)
+{
+    if(str.empty())
+        return false;
+
+    char *end = nullptr;
+    long v = strtol(str.c_str(), &end, 10);
+    if(*end != '\0')
+        return false;
+
+    value = int(v);
+    return true;
+}
+
+// 300, 300s, 5m, 4m30s, 1h, 4:30 and 1:04:30, in milliseconds.
+bool parseDuration(const string &str, int &ms)
+{
+    if(str.empty())
+        return false;
+
+    if(str.find(':') != string::npos)
+    {
+        long total = 0;
+        size_t start = 0;
+        while(true)
+        {
+            size_t colon = str.find(':', start);
+            int part;
+            if(!parseInteger(str.substr(start, colon - start), part) || part < 0)
+                return false;
+            total = total * 60 + part;
+            if(colon == string::npos)
+                break;
+            start = colon + 1;
+        }
+        ms = int(total * 1000);
+        return true;
+    }
+
+    long total = 0;
+    size_t i = 0;
+    while(i < str.size())
+    {
+        size_t digits = i;
+        while(digits < str.size() && str[digits] >= '0' && str[digits] <= '9')
+            digits++;
+        if(digits == i)
+            return false;
+
+        long part = strtol(str.substr(i, digits - i).c_str(), nullptr, 10);
+        char unit = digits < str.size() ? toLowerAscii(str[digits]) : 's';
+        if(unit == 'h')
+            part *= 3600;
+        else if(unit == 'm')
+            part *= 60;
+        else if(unit != 's')
+            return false;
+
+        total += part;
+        i = digits < str.size() ? digits + 1 : digits;
+    }
+
+    ms = int(total * 1000);
+    return true;
+}
+
+// 90, 90d, 2w, 6m (months of 30 days), 1y and 1y6m, in days.
+bool parseDays(const string &str, int &days)
+{
+    if(str.empty())
+        return false;
+
+    long total = 0;
+    size_t i = 0;
+    while(i < str.size())
+    {
+        size_t digits = i;
+        while(digits < str.size() && str[digits] >= '0' && str[digits] <= '9')
+            digits++;
+        if(digits == i)
+            return false;
+
+        long part = strtol(str.substr(i, digits - i).c_str(), nullptr, 10);
+        char unit = digits < str.size() ? toLowerAscii(str[digits]) : 'd';
+        if(unit == 'y')
+            part *= 365;
+        else if(unit == 'm')
+            part *= 30;
+        else if(unit == 'w')
+            part *= 7;
+        else if(unit != 'd')
+            return false;
+
+        total += part;
+        i = digits < str.size() ? digits + 1 : digits;
+    }
+
+    days = int(total);
+    return true;
+}
+
+bool resolveField(const string &name, bool &numeric, int &field)
+{
+    static const struct { const char *name; bool numeric; int field; } fields[] = {
+        { "name", false, TrackColumns::Name },
+        { "title", false, TrackColumns::Title },
+        { "artist", false, TrackColumns::Artist },
+        { "album", false, TrackColumns::Album },
+        { "genre", false, TrackColumns::Genre },
+        { "year", true, TrackColumns::Year },
+        { "dur", true, TrackColumns::Duration },
+        { "duration", true, TrackColumns::Duration },
+        { "length", true, TrackColumns::Duration },
+        { "track", true, TrackColumns::TrackNumber },
+        { "rate", true, TrackColumns::SampleRate },
+        { "samplerate", true, TrackColumns::SampleRate },
+        { "bitrate", true, TrackColumns::Bitrate },
+        { "plays", true, TrackColumns::Plays },
+        { "skips", true, TrackColumns::Skips },
+        { "skiprate", true, TrackColumns::SkipRate },
+        { "bpm", true, TrackColumns::Bpm },
+        { "tempo", true, TrackColumns::Bpm },
+        { "unplayed", true, Unplayed },
+    };
+
+    for(const auto &f : fields)
+    {
+        if(name == f.name)
+        {
+            numeric = f.numeric;
+            field = f.field;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t parseOperator(const string &str, size_t at, Op &op)
+{
+    static const struct { const char *text; Op op; } operators[] = {
+        { ":>=", GreaterEqual }, { ":<=", LessEqual }, { ":!=", NotEqual },
+        { ":>", Greater }, { ":<", Less }, { ":=", Equal },
+        { ">=", GreaterEqual }, { "<=", LessEqual }, { "!=", NotEqual },
+        { ">", Greater }, { "<", Less }, { "=", Equal }, { ":", Contains },
+    };
+
+    for(const auto &o : operators)
+    {
+        size_t len = string(o.text).size();
+        if(str.compare(at, len, o.text) == 0)
+        {
+            op = o.op;
+            return len;
+        }
+    }
+
+    return 0;
+}
+
+// The operator that gives the same answer with its operands swapped.
+Op mirrored(Op op)
+{
+    switch(op)
+    {
+    case Less: return Greater;
+    case LessEqual: return GreaterEqual;
+    case Greater: return Less;
+    case GreaterEqual: return LessEqual;
+    default: return op;
+    }
+}
+
+template<template<typename> class Compare>
+Kernel numberKernelFor()
+{
+    return numberKernel<Compare<int>>;
+}
+
+Kernel compileNumber(Op op)
+{
+    switch(op)
+    {
+    case Contains:
+    case Equal: return numberKernelFor<std::equal_to>();
+    case NotEqual: return numberKernelFor<std::not_equal_to>();
+    case Less: return numberKernelFor<std::less>();
+    case LessEqual: return numberKernelFor<std::less_equal>();
+    case Greater: return numberKernelFor<std::greater>();
+    case GreaterEqual: return numberKernelFor<std::greater_equal>();
+    }
+    return nullptr;
+}
+
+unique_ptr<Node> freeText(const string &text)
+{
+    unique_ptr<Node> node(new Node);
+    node->text = toLowerUtf8(text);
+    node->ascii = isAscii(node->text);
+    node->kernel = anyTextKernel;
+    return node;
+}
+
+unique_ptr<Node> parseTerm(const Token &token)
+{
+    const string &str = token.text;
+    size_t limit = std::min(token.quoteAt, str.size());
+    size_t at = str.find_first_of(":<>=!");
+    if(at == string::npos || at == 0 || at >= limit)
+        return freeText(str);
+
+    bool numeric;
+    int field;
+    if(!resolveField(toLowerUtf8(str.substr(0, at)), numeric, field))
+        return freeText(str);
+
+    Op op;
+    size_t len = parseOperator(str, at, op);
+    if(len == 0)
+        return freeText(str);
+
+    unique_ptr<Node> node(new Node);
+    node->numeric = numeric;
+    node->field = field;
+    node->op = op;
+    node->text = toLowerUtf8(str.substr(at + len));
+    node->ascii = isAscii(node->text);
+
+    if(numeric)
+    {
+        bool ok = field == TrackColumns::Duration ? parseDuration(node->text, node->value)
+                  : field == Unplayed             ? parseDays(node->text, node->value)
+                                                   : parseInteger(node->text, node->value);
+        if(!ok)
+            return freeText(str);
+
+        // "unplayed>=180" is "last played on or before the day 180 days
+        // ago"; tracks never played have day 0, so they always qualify.
+        if(field == Unplayed)
+        {
+            node->field = TrackColumns::LastPlayed;
+            node->value = int(time(nullptr) / 86400) - node->value;
+            node->op = mirrored(op);
+            node->dated = true;
+        }
+        node->kernel = compileNumber(node->op);
+    }
+    else if(op == Contains)
+        node->kernel = containsKernel;
+    else if(op == Equal)
+        node->kernel = equalsKernel<false>;
+    else if(op == NotEqual)
+        node->kernel = equalsKernel<true>;
+    else
+        return freeText(str);
+
+    return node;
+}
+
+class Parser
+{
+public:
+    Parser(const vector<Token> &tokens) : tokens(tokens) {}
+
+    unique_ptr<Node> parse()
+    {
+        unique_ptr<Node> root;
+        while(pos < tokens.size())
+        {
+            unique_ptr<Node> part = parseOr();
+            if(part)
+                root = root ? combine(Node::And, std::move(root), std::move(part)) : std::move(part);
+            else
+                pos++; // stray ')'
+        }
+        return root;
+    }
+
+private:
+    static unique_ptr<Node> combine(Node::Kind kind, unique_ptr<Node> a, unique_ptr<Node> b)
+    {
+        if(a->kind == kind)
+        {
+            a->children.push_back(std::move(b));
+            return a;
+        }
+
+        unique_ptr<Node> node(new Node);
+        node->kind = kind;
+        node->kernel = kind == Node::And ? andKernel : orKernel;
+        node->children.push_back(std::move(a));
+        node->children.push_back(std::move(b));
+        return node;
+    }
+
+    bool atEnd() const
+    {
+        return pos >= tokens.size() || isOperator(tokens[pos], ")");
+    }
+
+    unique_ptr<Node> parseOr()
+    {
+        unique_ptr<Node> left = parseAnd();
+        while(!atEnd() && (isOperator(tokens[pos], "OR") || isOperator(tokens[pos], "|")))
+        {
+            pos++;
+            unique_ptr<Node> right = parseAnd();
+            if(!left)
+                left = std::move(right);
+            else if(right)
+                left = combine(Node::Or, std::move(left), std::move(right));
+        }
+        return left;
+    }
+
+    unique_ptr<Node> parseAnd()
+    {
+        unique_ptr<Node> left;
+        while(!atEnd() && !isOperator(tokens[pos], "OR") && !isOperator(tokens[pos], "|"))
+        {
+            if(isOperator(tokens[pos], "AND"))
+            {
+                pos++;
+                continue;
+            }
+
+            unique_ptr<Node> right = parseUnary();
+            if(!right)
+                continue;
+            left = left ? combine(Node::And, std::move(left), std::move(right)) : std::move(right);
+        }
+        return left;
+    }
+
+    unique_ptr<Node> parseUnary()
+    {
+        const Token &token = tokens[pos];
+
+        if(isOperator(token, "NOT") || (token.quoteAt != 0 && token.text.size() > 1 && token.text[0] == '-'))
+        {
+            unique_ptr<Node> child;
+            if(token.text[0] == '-')
+            {
+                Token rest = token;
+                rest.text.erase(0, 1);
+                if(rest.quoteAt != string::npos)
+                    rest.quoteAt--;
+                pos++;
+                child = parseTerm(rest);
+            }
+            else
+            {
+                pos++;
+                if(atEnd())
+                    return nullptr;
+                child = parseUnary();
+            }
+
+            if(!child)
+                return nullptr;
+
+            unique_ptr<Node> node(new Node);
+            node->kind = Node::Not;
+            node->kernel = notKernel;
+            node->children.push_back(std::move(child));
+            return node;
+        }
+
+        if(isOperator(token, "("))
+        {
+            pos++;
+            unique_ptr<Node> inner = parseOr();
+            if(pos < tokens.size())
+                pos++; // ')'
+            return inner;
+        }
+
+        pos++;
+        if(token.quoteAt != string::npos && token.quoteAt == 0)
+            return freeText(token.text);
+        return parseTerm(token);
+    }
+
+    const vector<Token> &tokens;
+
+    size_t pos = 0;
+};
+
+unsigned int columnsOf(const Node *node)
+{
+    if(node->kind != Node::Term)
+    {
+        unsigned int columns = 0;
+        for(const auto &child : node->children)
+            columns |= columnsOf(child.get());
+        return columns;
+    }
+
+    if(node->numeric)
+        return TrackColumns::bit(TrackColumns::Number(node->field));
+    if(node->field == AnyText)
+        return TrackColumns::bit(TrackColumns::Name) | TrackColumns::bit(TrackColumns::Title)
+               | TrackColumns::bit(TrackColumns::Artist) | TrackColumns::bit(TrackColumns::Album);
+    return TrackColumns::bit(TrackColumns::Text(node->field));
+}
+
+bool hasDatedTerm(const Node *node)
+{
+    if(node->dated)
+        return true;
+
+    for(const auto &child : node->children)
+    {
+        if(hasDatedTerm(child.get()))
+            return true;
+    }
+    return false;
+}
+
+// Conjunction terms of a query, or nothing when it is not a plain AND.
+vector<const Node *> conjuncts(const Node *root)
+{
+    vector<const Node *> terms;
+    if(!root)
+        return terms;
+
+    if(root->kind == Node::Term)
+        terms.push_back(root);
+    else if(root->kind == Node::And)
+    {
+        for(const auto &child : root->children)
+        {
+            if(child->kind != Node::Term)
+                return vector<const Node *>();
+            terms.push_back(child.get());
+        }
+    }
+
+    return terms;
+}
+
+}
+
+Query Query::parse(const string &text)
+{
+    Query query;
+    query.root = Parser(tokenize(text)).parse();
+    return query;
+}
+
+bool Query::isEmpty() const
+{
+    return !root;
+}
+
+vector<unsigned int> Query::select(const TrackColumns &columns) const
+{
+    vector<unsigned int> rows;
+    unsigned int batch[BatchSize];
+    int size = columns.size();
+
+    for(int first = 0; first < size; first += BatchSize)
+    {
+        int n = std::min(BatchSize, size - first);
+        for(int i = 0; i < n; i++)
+            batch[i] = unsigned(first + i);
+
+        if(root)
+            n = apply(*root, columns, batch, n, batch);
+
+        rows.insert(rows.end(), batch, batch + n);
+    }
+
+    return rows;
+}
+
+void Query::filter(const TrackColumns &columns, vector<unsigned int> &rows) const
+{
+    if(!root)
+        return;
+
+    size_t kept = 0;
+    for(size_t first = 0; first < rows.size(); first += BatchSize)
+    {
+        int n = int(std::min(size_t(BatchSize), rows.size() - first));
+        // Matches never outnumber the rows read so far, so compacting
+        // towards the front of rows cannot overwrite unread entries.
+        n = apply(*root, columns, rows.data() + first, n, rows.data() + first);
+        std::copy(rows.begin() + first, rows.begin() + first + n, rows.begin() + kept);
+        kept += n;
+    }
+    rows.resize(kept);
+}
+
+bool Query::refines(const Query &previous) const
+{
+    if(!previous.root)
+        return true;
+
+    vector<const Node *> now = conjuncts(root.get());
+    vector<const Node *> before = conjuncts(previous.root.get());
+    if(before.empty() || now.size() < before.size())
+        return false;
+
+    for(size_t i = 0; i < before.size(); i++)
+    {
+        const Node *a = now[i];
+        const Node *b = before[i];
+        if(a->numeric != b->numeric || a->field != b->field || a->op != b->op)
+            return false;
+
+        if(a->numeric ? a->value != b->value
+                      : (b->op == Contains ? !containsIgnoreCase(a->text, b->text) : !equalsIgnoreCase(a->text, b->text)))
+            return false;
+    }
+
+    return true;
+}
+
+unsigned int Query::columns() const
+{
+    return root ? columnsOf(root.get()) : 0;
+}
+
+bool Query::isDated() const
+{
+    return root && hasDatedTerm(root.get());
+}
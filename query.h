@@ -0,0 +1,57 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "trackcolumns.h"
+
+using namespace std;
+
+// A search query such as:  artist:radiohead year>=1997 dur<5m "paranoid"
+//
+// Terms are AND-ed implicitly; OR, NOT (or a leading '-') and parentheses
+// are supported. Text fields (name, title, artist, album, genre) take ':'
+// for "contains", '=' and '!=' for whole-value matches. Numeric fields
+// (year, dur, track, rate, bitrate, plays, skips, skiprate, bpm,
+// unplayed) take ':', '=', '!=', '<', '<=', '>', '>='; durations accept
+// 300, 5m, 4m30s, 1h or 4:30. bpm is 0 until a track's tempo is known.
+// unplayed is the number of days since a track was last played (never
+// counts as long ago) and accepts 90, 90d, 2w, 6m or 1y.
+// Bare and quoted words match name, title, artist or album. Parsing never
+// fails: anything that is not a valid field term is searched for as plain
+// text.
+//
+// A parsed query is compiled into predicate kernels that scan TrackColumns
+// in fixed-size batches of row selection vectors.
+class Query
+{
+public:
+    static Query parse(const string &text);
+
+    bool isEmpty() const;
+
+    // Every matching row of columns, in ascending order.
+    vector<unsigned int> select(const TrackColumns &columns) const;
+
+    // Keeps only the matching entries of rows, which must be ascending.
+    void filter(const TrackColumns &columns, vector<unsigned int> &rows) const;
+
+    // True when every row matching this query is known to match previous,
+    // so previous results can be narrowed instead of scanning again.
+    bool refines(const Query &previous) const;
+
+    // The columns the query reads, as a mask of TrackColumns::bit().
+    unsigned int columns() const;
+
+    // True when the query compares with today's date (unplayed), so which
+    // tracks match changes from one day to the next.
+    bool isDated() const;
+
+    struct Node;
+
+private:
+    shared_ptr<const Node> root;
+};
+
+#endif // QUERY_H
@@ -0,0 +1,251 @@
+#include "shuffleorder.h"
+#include <algorithm>
+
+namespace {
+
+// Compacting a short order is not worth doing.
+const int MinRemovedToCompact = 64;
+
+// How far a balanced track may stray from its evenly spaced slot, as a
+// share of the spacing; enough to hide the pattern, not enough to bring
+// two tracks of a group together.
+const double Jitter = 0.2;
+
+struct Placed
+{
+    double position;
+
+    unsigned int row;
+};
+
+// Dithered interleave: the rows of a group of k are given the positions
+// offset + i / k, plus a little jitter, with a random offset per group, so
+// that sorting by position spreads every group across [0, 1).
+void spread(Placed *group, size_t k, std::mt19937_64 &random)
+{
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    double step = 1.0 / double(k);
+    double offset = unit(random) * step;
+    for(size_t i = 0; i < k; i++)
+        group[i].position = offset + (double(i) + (unit(random) - 0.5) * Jitter) * step;
+}
+
+bool byPosition(const Placed &a, const Placed &b)
+{
+    return a.position < b.position;
+}
+
+}
+
+void ShuffleOrder::shuffle(int count, uint64_t seed)
+{
+    this->seed = seed;
+    random.seed(seed);
+    permutation = Permutation(uint64_t(std::max(0, count)), random());
+    lazy = true;
+
+    order.clear();
+    positions.clear();
+    removed = 0;
+}
+
+void ShuffleOrder::shuffleBalanced(const vector<unsigned int> &ids, const vector<uint64_t> &artists,
+                                   const vector<uint64_t> &albums, uint64_t seed)
+{
+    this->seed = seed;
+    random.seed(seed);
+    lazy = false;
+    permutation = Permutation();
+
+    // Group by artist, then album, in random order inside each album.
+    vector<uint64_t> tiebreak(ids.size());
+    for(uint64_t &t : tiebreak)
+        t = random();
+
+    vector<Placed> rows(ids.size());
+    for(size_t r = 0; r < rows.size(); r++)
+        rows[r] = { 0.0, unsigned(r) };
+    std::sort(rows.begin(), rows.end(), [&](const Placed &a, const Placed &b) {
+        if(artists[a.row] != artists[b.row])
+            return artists[a.row] < artists[b.row];
+        if(albums[a.row] != albums[b.row])
+            return albums[a.row] < albums[b.row];
+        return tiebreak[a.row] < tiebreak[b.row];
+    });
+
+    // Albums are spread within their artist, then the artist's tracks,
+    // in that order, over the whole list.
+    size_t first = 0;
+    while(first < rows.size())
+    {
+        size_t end = first;
+        while(end < rows.size() && artists[rows[end].row] == artists[rows[first].row])
+            end++;
+
+        for(size_t album = first; album < end;)
+        {
+            size_t albumEnd = album;
+            while(albumEnd < end && albums[rows[albumEnd].row] == albums[rows[album].row])
+                albumEnd++;
+            spread(&rows[album], albumEnd - album, random);
+            album = albumEnd;
+        }
+        std::sort(rows.begin() + first, rows.begin() + end, byPosition);
+        spread(&rows[first], end - first, random);
+
+        first = end;
+    }
+    std::sort(rows.begin(), rows.end(), byPosition);
+
+    vector<unsigned int> shuffled(rows.size());
+    for(size_t p = 0; p < rows.size(); p++)
+        shuffled[p] = ids[rows[p].row];
+    setOrder(std::move(shuffled));
+}
+
+bool ShuffleOrder::isLazy() const
+{
+    return lazy;
+}
+
+int ShuffleOrder::indexAt(int position) const
+{
+    if(position < 0 || uint64_t(position) >= permutation.size())
+        return -1;
+
+    return int(permutation.map(uint64_t(position)));
+}
+
+int ShuffleOrder::positionOfIndex(int index) const
+{
+    if(index < 0 || uint64_t(index) >= permutation.size())
+        return -1;
+
+    return int(permutation.unmap(uint64_t(index)));
+}
+
+void ShuffleOrder::materialize(const vector<unsigned int> &ids)
+{
+    if(!lazy)
+        return;
+
+    // Should never differ; if it does, a fresh order is better than one
+    // that points at the wrong tracks.
+    if(ids.size() != permutation.size())
+        permutation = Permutation(ids.size(), random());
+
+    vector<unsigned int> shuffled(ids.size());
+    for(size_t p = 0; p < shuffled.size(); p++)
+        shuffled[p] = ids[permutation.map(p)];
+
+    lazy = false;
+    permutation = Permutation();
+    setOrder(std::move(shuffled));
+}
+
+void ShuffleOrder::setOrder(vector<unsigned int> ids)
+{
+    order = std::move(ids);
+    removed = 0;
+    positions.clear();
+    positions.reserve(order.size());
+    for(size_t p = 0; p < order.size(); p++)
+        positions[order[p]] = int(p);
+}
+
+void ShuffleOrder::insert(unsigned int id, int current)
+{
+    if(positions.count(id))
+        return;
+
+    // Pick a slot among those after current, the end included; whatever
+    // was there moves to the end, which is just as unplayed.
+    int first = std::max(0, current + 1);
+    int end = int(order.size());
+    int p = first >= end ? end : int(std::uniform_int_distribution<int>(first, end)(random));
+
+    if(p == end)
+    {
+        order.push_back(id);
+    }
+    else if(order[p] == Removed)
+    {
+        order[p] = id;
+        removed--;
+    }
+    else
+    {
+        unsigned int displaced = order[p];
+        order.push_back(displaced);
+        positions[displaced] = end;
+        order[p] = id;
+    }
+    positions[id] = p;
+}
+
+void ShuffleOrder::remove(unsigned int id)
+{
+    auto it = positions.find(id);
+    if(it == positions.end())
+        return;
+
+    order[it->second] = Removed;
+    positions.erase(it);
+    removed++;
+}
+
+int ShuffleOrder::compact(int current)
+{
+    if(removed < MinRemovedToCompact || removed * 2 < int(order.size()))
+        return current;
+
+    int kept = 0;
+    int moved = -1;
+    for(int p = 0; p < int(order.size()); p++)
+    {
+        if(order[p] != Removed)
+        {
+            order[kept] = order[p];
+            positions[order[kept]] = kept;
+            kept++;
+        }
+        if(p == current)
+            moved = kept - 1;
+    }
+    order.resize(kept);
+    removed = 0;
+    return current < 0 ? current : moved;
+}
+
+void ShuffleOrder::clear()
+{
+    lazy = false;
+    permutation = Permutation();
+    order.clear();
+    positions.clear();
+    removed = 0;
+}
+
+int ShuffleOrder::size() const
+{
+    return lazy ? int(permutation.size()) : int(order.size());
+}
+
+unsigned int ShuffleOrder::at(int position) const
+{
+    if(position < 0 || position >= int(order.size()))
+        return Removed;
+
+    return order[position];
+}
+
+int ShuffleOrder::positionOf(unsigned int id) const
+{
+    auto it = positions.find(id);
+    return it == positions.end() ? -1 : it->second;
+}
+
+uint64_t ShuffleOrder::getSeed() const
+{
+    return seed;
+}
@@ -0,0 +1,87 @@
+#ifndef SHUFFLEORDER_H
+#define SHUFFLEORDER_H
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "permutation.h"
+
+using namespace std;
+
+// The order tracks are played in while shuffling. The same seed always
+// gives the same order.
+//
+// A fresh order is lazy: a Permutation from positions to playlist indexes,
+// so shuffling a million tracks stores nothing and takes no time. The
+// first time tracks are added or removed it is materialized into a list
+// of track ids, which survives such changes: a new track goes to a random
+// position among those not played yet; a removed one leaves an empty slot
+// (at() gives Removed) until more than half the slots are empty and
+// compact() squeezes them out, so both are O(1) amortized and the order
+// of the rest never changes.
+class ShuffleOrder
+{
+public:
+    static const unsigned int Removed = ~0u;
+
+    void shuffle(int count, uint64_t seed);
+
+    bool isLazy() const;
+
+    // Only while lazy.
+    int indexAt(int position) const;
+
+    int positionOfIndex(int index) const;
+
+    // An order that spreads each artist's tracks evenly over the whole
+    // list, and each album's over the artist's share, instead of letting
+    // chance put three songs from one album in a row. Tracks with the same
+    // artists key (and albums key) belong together. Always stored.
+    void shuffleBalanced(const vector<unsigned int> &ids, const vector<uint64_t> &artists,
+                         const vector<uint64_t> &albums, uint64_t seed);
+
+    // Stores a lazy order; ids[i] is the id of the track that had index i
+    // when it was shuffled.
+    void materialize(const vector<unsigned int> &ids);
+
+    // The rest only work on a materialized order.
+
+    // Adds id somewhere after position current.
+    void insert(unsigned int id, int current);
+
+    void remove(unsigned int id);
+
+    // Drops empty slots if there are enough of them; returns where the
+    // slot at current, or the last one before it still in use, went.
+    int compact(int current);
+
+    void clear();
+
+    int size() const;
+
+    unsigned int at(int position) const;
+
+    int positionOf(unsigned int id) const;
+
+    uint64_t getSeed() const;
+
+private:
+    void setOrder(vector<unsigned int> ids);
+
+    std::mt19937_64 random;
+
+    uint64_t seed = 0;
+
+    bool lazy = false;
+
+    Permutation permutation;
+
+    vector<unsigned int> order;
+
+    unordered_map<unsigned int, int> positions;
+
+    int removed = 0;
+};
+
+#endif // SHUFFLEORDER_H
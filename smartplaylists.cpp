@@ -0,0 +1,219 @@
+#include "smartplaylists.h"
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+
+namespace {
+
+long long today()
+{
+    return time(nullptr) / 86400;
+}
+
+}
+
+SmartPlaylists::SmartPlaylists(const string &path)
+    : path(path)
+    , day(today())
+{
+}
+
+void SmartPlaylists::load(Playlist &playlist)
+{
+    std::ifstream read(path);
+    string line;
+    while(getline(read, line))
+    {
+        size_t tab = line.find('\t');
+        if(tab == string::npos)
+            continue;
+
+        Entry entry;
+        entry.name = line.substr(0, tab);
+        entry.rule = line.substr(tab + 1);
+        entry.query = Query::parse(entry.rule);
+        run(entry, playlist);
+        entries.push_back(entry);
+    }
+
+    day = today();
+    index();
+}
+
+int SmartPlaylists::size() const
+{
+    return int(entries.size());
+}
+
+const string &SmartPlaylists::getName(int index) const
+{
+    return entries[index].name;
+}
+
+const string &SmartPlaylists::getRule(int index) const
+{
+    return entries[index].rule;
+}
+
+const Query &SmartPlaylists::getQuery(int index) const
+{
+    return entries[index].query;
+}
+
+const vector<unsigned int> &SmartPlaylists::getIds(int index) const
+{
+    return entries[index].ids;
+}
+
+int SmartPlaylists::add(string name, const string &rule, Playlist &playlist)
+{
+    // A tab or line break in the name would break the file apart.
+    std::replace(name.begin(), name.end(), '\t', ' ');
+    std::replace(name.begin(), name.end(), '\n', ' ');
+
+    Entry entry;
+    entry.name = name;
+    entry.rule = rule;
+    entry.query = Query::parse(rule);
+    run(entry, playlist);
+    entries.push_back(entry);
+
+    index();
+    save();
+    return int(entries.size()) - 1;
+}
+
+void SmartPlaylists::remove(int index)
+{
+    entries.erase(entries.begin() + index);
+    this->index();
+    save();
+}
+
+void SmartPlaylists::tracksAppended(Playlist &playlist, int first)
+{
+    vector<unsigned int> rows;
+    for(Entry &entry : entries)
+    {
+        rows.clear();
+        for(int i = first; i < int(playlist.tracks.size()); i++)
+            rows.push_back(unsigned(i));
+        entry.query.filter(playlist.columns, rows);
+
+        // New tracks have the highest ids, so they normally go on the end;
+        // some may be members already through tracksChanged().
+        for(unsigned int row : rows)
+        {
+            unsigned int id = playlist.tracks[row].getId();
+            auto it = std::lower_bound(entry.ids.begin(), entry.ids.end(), id);
+            if(it == entry.ids.end() || *it != id)
+                entry.ids.insert(it, id);
+        }
+    }
+}
+
+void SmartPlaylists::tracksRemoved(vector<unsigned int> ids)
+{
+    std::sort(ids.begin(), ids.end());
+    auto removed = [&ids](unsigned int id) {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    };
+    for(Entry &entry : entries)
+        entry.ids.erase(std::remove_if(entry.ids.begin(), entry.ids.end(), removed), entry.ids.end());
+}
+
+void SmartPlaylists::tracksChanged(Playlist &playlist, vector<int> indexes, unsigned int columns)
+{
+    if(indexes.empty())
+        return;
+
+    // Only the rules reading a column that changed can change their mind.
+    vector<char> touched(entries.size(), 0);
+    for(int bit = 0; bit < ColumnCount; bit++)
+    {
+        if(columns & (1u << bit))
+        {
+            for(int e : readers[bit])
+                touched[e] = 1;
+        }
+    }
+
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+    vector<unsigned int> matching;
+    for(size_t e = 0; e < entries.size(); e++)
+    {
+        if(!touched[e])
+            continue;
+
+        Entry &entry = entries[e];
+        matching.assign(indexes.begin(), indexes.end());
+        entry.query.filter(playlist.columns, matching);
+
+        for(int i : indexes)
+        {
+            unsigned int id = playlist.tracks[i].getId();
+            auto it = std::lower_bound(entry.ids.begin(), entry.ids.end(), id);
+            bool member = it != entry.ids.end() && *it == id;
+            bool match = std::binary_search(matching.begin(), matching.end(), unsigned(i));
+            if(match && !member)
+                entry.ids.insert(it, id);
+            else if(member && !match)
+                entry.ids.erase(it);
+        }
+    }
+}
+
+bool SmartPlaylists::dayChanged(Playlist &playlist)
+{
+    if(today() == day)
+        return false;
+
+    // Dated rules hold the day they were parsed on, so they are parsed
+    // again rather than just run.
+    day = today();
+    bool changed = false;
+    for(Entry &entry : entries)
+    {
+        if(!entry.query.isDated())
+            continue;
+
+        entry.query = Query::parse(entry.rule);
+        run(entry, playlist);
+        changed = true;
+    }
+    return changed;
+}
+
+void SmartPlaylists::run(Entry &entry, Playlist &playlist)
+{
+    // Ids are handed out in playlist order, so selected rows map to
+    // sorted ids.
+    vector<unsigned int> rows = entry.query.select(playlist.columns);
+    entry.ids.resize(rows.size());
+    for(size_t r = 0; r < rows.size(); r++)
+        entry.ids[r] = playlist.tracks[rows[r]].getId();
+}
+
+void SmartPlaylists::index()
+{
+    for(vector<int> &column : readers)
+        column.clear();
+
+    for(size_t e = 0; e < entries.size(); e++)
+    {
+        unsigned int columns = entries[e].query.columns();
+        for(int bit = 0; bit < ColumnCount; bit++)
+        {
+            if(columns & (1u << bit))
+                readers[bit].push_back(int(e));
+        }
+    }
+}
+
+void SmartPlaylists::save()
+{
+    std::ofstream write(path);
+    for(const Entry &entry : entries)
+        write << entry.name << '\t' << entry.rule << '\n';
+}
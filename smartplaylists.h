@@ -0,0 +1,85 @@
+#ifndef SMARTPLAYLISTS_H
+#define SMARTPLAYLISTS_H
+
+#include <string>
+#include <vector>
+#include "playlist.h"
+#include "query.h"
+
+using namespace std;
+
+// Saved playlists made of the tracks matching a rule, a Query such as
+//   unplayed>=6m genre:jazz bitrate>=256
+// Members are kept as sorted track ids (which is playlist order) and are
+// updated as the playlist changes instead of being searched for again.
+// Every rule is indexed under the columns it reads, so a change to some
+// columns of a few tracks runs only the rules reading those columns, and
+// only over those tracks. Rules that depend on the date are run over the
+// whole playlist again once a day.
+//
+// Saved as lines of name, tab, rule.
+class SmartPlaylists
+{
+public:
+    SmartPlaylists(const string &path);
+
+    // Reads the saved rules and runs them over playlist.
+    void load(Playlist &playlist);
+
+    int size() const;
+
+    const string &getName(int index) const;
+
+    const string &getRule(int index) const;
+
+    const Query &getQuery(int index) const;
+
+    const vector<unsigned int> &getIds(int index) const;
+
+    // Returns the index of the new smart playlist.
+    int add(string name, const string &rule, Playlist &playlist);
+
+    void remove(int index);
+
+    void tracksAppended(Playlist &playlist, int first);
+
+    void tracksRemoved(vector<unsigned int> ids);
+
+    // columns is a mask of TrackColumns::bit() saying what changed.
+    void tracksChanged(Playlist &playlist, vector<int> indexes, unsigned int columns);
+
+    // Runs the rules that depend on the date again if the day changed
+    // since they last ran. Returns whether any did.
+    bool dayChanged(Playlist &playlist);
+
+private:
+    struct Entry
+    {
+        string name;
+
+        string rule;
+
+        Query query;
+
+        vector<unsigned int> ids;
+    };
+
+    static const int ColumnCount = TrackColumns::TextCount + TrackColumns::NumberCount;
+
+    void run(Entry &entry, Playlist &playlist);
+
+    void index();
+
+    void save();
+
+    string path;
+
+    vector<Entry> entries;
+
+    // The entries reading each column, by bit number.
+    vector<int> readers[ColumnCount];
+
+    long long day;
+};
+
+#endif // SMARTPLAYLISTS_H
@@ -0,0 +1,1328 @@
+#include "tagreader.h"
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+typedef unsigned char uchar;
+
+// ---------------------------------------------------------------- helpers
+
+unsigned int be16(const uchar *p)
+{
+    return (unsigned(p[0]) << 8) | p[1];
+}
+
+unsigned int be24(const uchar *p)
+{
+    return (unsigned(p[0]) << 16) | (unsigned(p[1]) << 8) | p[2];
+}
+
+unsigned int be32(const uchar *p)
+{
+    return (unsigned(p[0]) << 24) | (unsigned(p[1]) << 16) | (unsigned(p[2]) << 8) | p[3];
+}
+
+unsigned long long be64(const uchar *p)
+{
+    return (static_cast<unsigned long long>(be32(p)) << 32) | be32(p + 4);
+}
+
+unsigned int le32(const uchar *p)
+{
+    return unsigned(p[0]) | (unsigned(p[1]) << 8) | (unsigned(p[2]) << 16) | (unsigned(p[3]) << 24);
+}
+
+unsigned int syncsafe32(const uchar *p)
+{
+    return ((p[0] & 0x7f) << 21) | ((p[1] & 0x7f) << 14) | ((p[2] & 0x7f) << 7) | (p[3] & 0x7f);
+}
+
+void appendUtf8(string &out, unsigned int cp)
+{
+    if(cp < 0x80)
+        out.push_back(char(cp));
+    else if(cp < 0x800)
+    {
+        out.push_back(char(0xc0 | (cp >> 6)));
+        out.push_back(char(0x80 | (cp & 0x3f)));
+    }
+    else if(cp < 0x10000)
+    {
+        out.push_back(char(0xe0 | (cp >> 12)));
+        out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back(char(0x80 | (cp & 0x3f)));
+    }
+    else
+    {
+        out.push_back(char(0xf0 | (cp >> 18)));
+        out.push_back(char(0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back(char(0x80 | (cp & 0x3f)));
+    }
+}
+
+// Strings stop at the first NUL; trailing blanks are dropped.
+string trimmed(string str)
+{
+    size_t nul = str.find('\0');
+    if(nul != string::npos)
+        str.resize(nul);
+    while(!str.empty() && (str.back() == ' ' || str.back() == '\0'))
+        str.pop_back();
+    return str;
+}
+
+string fromLatin1(const uchar *p, size_t n)
+{
+    string out;
+    out.reserve(n);
+    for(size_t i = 0; i < n && p[i]; i++)
+        appendUtf8(out, p[i]);
+    return trimmed(out);
+}
+
+string fromUtf8(const uchar *p, size_t n)
+{
+    return trimmed(string(reinterpret_cast<const char *>(p), n));
+}
+
+string fromUtf16(const uchar *p, size_t n, bool bigEndian)
+{
+    if(n >= 2 && ((p[0] == 0xff && p[1] == 0xfe) || (p[0] == 0xfe && p[1] == 0xff)))
+    {
+        bigEndian = p[0] == 0xfe;
+        p += 2;
+        n -= 2;
+    }
+
+    string out;
+    for(size_t i = 0; i + 1 < n; i += 2)
+    {
+        unsigned int unit = bigEndian ? be16(p + i) : unsigned(p[i] | (p[i + 1] << 8));
+        if(unit == 0)
+            break;
+
+        if(unit >= 0xd800 && unit < 0xdc00 && i + 3 < n)
+        {
+            unsigned int low = bigEndian ? be16(p + i + 2) : unsigned(p[i + 2] | (p[i + 3] << 8));
+            if(low >= 0xdc00 && low < 0xe000)
+            {
+                appendUtf8(out, 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00));
+                i += 2;
+                continue;
+            }
+        }
+        appendUtf8(out, unit);
+    }
+    return trimmed(out);
+}
+
+int leadingNumber(const string &str)
+{
+    return atoi(str.c_str());
+}
+
+// Years come as "1997", "1997-05-21" or "1997-05-21T00:00:00Z".
+int yearOf(const string &str)
+{
+    return str.size() >= 4 ? atoi(str.substr(0, 4).c_str()) : 0;
+}
+
+const char *const id3Genres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop",
+    "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock",
+    "Techno", "Industrial", "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack",
+    "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance",
+    "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop",
+    "Instrumental Rock", "Ethnic", "Gothic", "Darkwave", "Techno-Industrial", "Electronic",
+    "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta",
+    "Top 40", "Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret",
+    "New Wave", "Psychedelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+    "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock",
+};
+
+string genreName(int index)
+{
+    if(index >= 0 && index < int(sizeof(id3Genres) / sizeof(id3Genres[0])))
+        return id3Genres[index];
+    return "";
+}
+
+// ID3v2 genres may be "Rock", "17", "(17)" or "(17)Rock".
+string id3Genre(const string &str)
+{
+    if(!str.empty() && str[0] == '(')
+    {
+        size_t close = str.find(')');
+        if(close != string::npos)
+        {
+            if(close + 1 < str.size())
+                return str.substr(close + 1);
+            return genreName(atoi(str.c_str() + 1));
+        }
+    }
+
+    if(!str.empty() && str.find_first_not_of("0123456789") == string::npos)
+        return genreName(atoi(str.c_str()));
+
+    return str;
+}
+
+void setIfEmpty(string &field, const string &value)
+{
+    if(field.empty())
+        field = value;
+}
+
+void setIfZero(int &field, int value)
+{
+    if(field == 0)
+        field = value;
+}
+
+// Average bitrate for formats that do not store one.
+void estimateBitrate(TrackInfo &info, size_t audioBytes)
+{
+    if(info.bitrate == 0 && info.duration > 0)
+        info.bitrate = int(static_cast<unsigned long long>(audioBytes) * 8 / info.duration);
+}
+
+// ---------------------------------------------------------------- ID3
+
+string id3Text(const uchar *p, size_t n)
+{
+    if(n < 1)
+        return "";
+
+    switch(p[0])
+    {
+    case 1: return fromUtf16(p + 1, n - 1, false);
+    case 2: return fromUtf16(p + 1, n - 1, true);
+    case 3: return fromUtf8(p + 1, n - 1);
+    default: return fromLatin1(p + 1, n - 1);
+    }
+}
+
+// Undoes ID3 unsynchronisation (0xFF 0x00 -> 0xFF). Rare, so a copy is fine.
+vector<uchar> resync(const uchar *p, size_t n)
+{
+    vector<uchar> out;
+    out.reserve(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        out.push_back(p[i]);
+        if(p[i] == 0xff && i + 1 < n && p[i + 1] == 0)
+            i++;
+    }
+    return out;
+}
+
+void id3Frame(const char *id, const uchar *p, size_t n, TrackInfo &info)
+{
+    if(!strcmp(id, "TIT2") || !strcmp(id, "TT2"))
+        setIfEmpty(info.title, id3Text(p, n));
+    else if(!strcmp(id, "TPE1") || !strcmp(id, "TP1"))
+        setIfEmpty(info.artist, id3Text(p, n));
+    else if(!strcmp(id, "TALB") || !strcmp(id, "TAL"))
+        setIfEmpty(info.album, id3Text(p, n));
+    else if(!strcmp(id, "TCON") || !strcmp(id, "TCO"))
+        setIfEmpty(info.genre, id3Genre(id3Text(p, n)));
+    else if(!strcmp(id, "TRCK") || !strcmp(id, "TRK"))
+        setIfZero(info.trackNumber, leadingNumber(id3Text(p, n)));
+    else if(!strcmp(id, "TYER") || !strcmp(id, "TYE") || !strcmp(id, "TDRC"))
+        setIfZero(info.year, yearOf(id3Text(p, n)));
+    else if(!strcmp(id, "TBPM") || !strcmp(id, "TBP"))
+        setIfZero(info.bpm, leadingNumber(id3Text(p, n)));
+}
+
+// Calls visit(id, body, length) for every readable frame.
+template<typename Visit>
+void id3Frames(const uchar *p, size_t n, int version, Visit visit)
+{
+    const size_t header = version == 2 ? 6 : 10;
+    size_t pos = 0;
+
+    while(pos + header <= n && p[pos] != 0)
+    {
+        char id[5] = { 0, 0, 0, 0, 0 };
+        size_t size;
+        unsigned int flags = 0;
+
+        if(version == 2)
+        {
+            memcpy(id, p + pos, 3);
+            size = be24(p + pos + 3);
+        }
+        else
+        {
+            memcpy(id, p + pos, 4);
+            size = version == 4 ? syncsafe32(p + pos + 4) : be32(p + pos + 4);
+            flags = be16(p + pos + 8);
+        }
+
+        pos += header;
+        if(size > n - pos)
+            break;
+
+        const uchar *body = p + pos;
+        size_t length = size;
+        vector<uchar> copy;
+
+        if(version == 3)
+        {
+            if(flags & 0x00c0) // compressed or encrypted
+                length = 0;
+            else if((flags & 0x0020) && length > 0) // grouping identity
+                body++, length--;
+        }
+        else if(version == 4)
+        {
+            if(flags & 0x000c) // compressed or encrypted
+                length = 0;
+            else
+            {
+                if((flags & 0x0040) && length > 0) // grouping identity
+                    body++, length--;
+                if((flags & 0x0001) && length >= 4) // data length indicator
+                    body += 4, length -= 4;
+                if(flags & 0x0002)
+                {
+                    copy = resync(body, length);
+                    body = copy.data();
+                    length = copy.size();
+                }
+            }
+        }
+
+        if(length > 0)
+            visit(id, body, length);
+
+        pos += size;
+    }
+}
+
+// Total size of the ID3v2 tag at p, or 0 when there is none.
+size_t id3v2Size(const uchar *p, size_t n)
+{
+    if(n < 10 || memcmp(p, "ID3", 3) != 0 || p[3] < 2 || p[3] > 4)
+        return 0;
+
+    size_t total = 10 + size_t(syncsafe32(p + 6)) + ((p[5] & 0x10) ? 10 : 0);
+    return total < n ? total : n;
+}
+
+// Visits the frames of the ID3v2 tag at p and returns the tag size, or 0
+// when there is none.
+template<typename Visit>
+size_t id3v2Frames(const uchar *p, size_t n, Visit visit)
+{
+    size_t total = id3v2Size(p, n);
+    if(total == 0)
+        return 0;
+
+    const int version = p[3];
+    const uchar flags = p[5];
+    size_t size = syncsafe32(p + 6);
+    if(size > n - 10)
+        size = n - 10;
+
+    const uchar *body = p + 10;
+    vector<uchar> copy;
+    if(version < 4 && (flags & 0x80))
+    {
+        copy = resync(body, size);
+        body = copy.data();
+        size = copy.size();
+    }
+
+    if(version > 2 && (flags & 0x40) && size >= 4)
+    {
+        size_t extended = version == 3 ? be32(body) + 4 : syncsafe32(body);
+        if(extended > size)
+            extended = size;
+        body += extended;
+        size -= extended;
+    }
+
+    id3Frames(body, size, version, visit);
+    return total;
+}
+
+size_t id3v2(const uchar *p, size_t n, TrackInfo &info)
+{
+    return id3v2Frames(p, n, [&info](const char *id, const uchar *body, size_t length) {
+        if(id[0] == 'T')
+            id3Frame(id, body, length, info);
+    });
+}
+
+bool id3v1(const uchar *p, size_t n, TrackInfo &info)
+{
+    if(n < 128)
+        return false;
+
+    const uchar *tag = p + n - 128;
+    if(memcmp(tag, "TAG", 3) != 0)
+        return false;
+
+    setIfEmpty(info.title, fromLatin1(tag + 3, 30));
+    setIfEmpty(info.artist, fromLatin1(tag + 33, 30));
+    setIfEmpty(info.album, fromLatin1(tag + 63, 30));
+    setIfZero(info.year, yearOf(fromLatin1(tag + 93, 4)));
+    if(tag[125] == 0 && tag[126] != 0)
+        setIfZero(info.trackNumber, tag[126]);
+    setIfEmpty(info.genre, genreName(tag[127]));
+    return true;
+}
+
+// Duration from the first MPEG audio frame: the Xing/Info or VBRI header
+// gives the exact frame count of VBR files (minus the LAME encoder delay
+// and padding when present); otherwise it is estimated from the constant
+// bitrate.
+void mpegStream(const uchar *p, size_t n, size_t audioBytes, TrackInfo &info)
+{
+    static const int bitrates[2][3][16] = {
+        { // MPEG-1: layer I, II, III
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+        },
+        { // MPEG-2/2.5: layer I, II, III
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+        },
+    };
+    static const int rates[3] = { 44100, 48000, 32000 };
+
+    // Junk between the tag and the first frame is common; look a little.
+    size_t limit = n < 64 * 1024 ? n : 64 * 1024;
+    for(size_t i = 0; i + 4 <= limit; i++)
+    {
+        if(p[i] != 0xff || (p[i + 1] & 0xe0) != 0xe0)
+            continue;
+
+        int versionBits = (p[i + 1] >> 3) & 3; // 0: 2.5, 2: 2, 3: 1
+        int layerBits = (p[i + 1] >> 1) & 3;   // 1: III, 2: II, 3: I
+        int bitrateIndex = p[i + 2] >> 4;
+        int rateIndex = (p[i + 2] >> 2) & 3;
+        if(versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3)
+            continue;
+
+        bool mpeg1 = versionBits == 3;
+        bool mono = (p[i + 3] >> 6) == 3;
+        int kbps = bitrates[mpeg1 ? 0 : 1][3 - layerBits][bitrateIndex];
+        int rate = rates[rateIndex] >> (mpeg1 ? 0 : versionBits == 2 ? 1 : 2);
+        int samplesPerFrame = layerBits == 3 ? 384 : (layerBits == 1 && !mpeg1) ? 576 : 1152;
+        setIfZero(info.sampleRate, rate);
+
+        const uchar *frame = p + i;
+        size_t available = n - i;
+        size_t sideInfo = mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+
+        unsigned long long frames = 0;
+        unsigned long long bytes = 0;
+        int trimmed = 0;
+
+        const uchar *xing = frame + 4 + sideInfo;
+        const uchar *vbri = frame + 4 + 32;
+        if(available >= 4 + sideInfo + 8 && (!memcmp(xing, "Xing", 4) || !memcmp(xing, "Info", 4)))
+        {
+            unsigned int flags = be32(xing + 4);
+            size_t pos = 8;
+            if((flags & 1) && available >= 4 + sideInfo + pos + 4)
+            {
+                frames = be32(xing + pos);
+                pos += 4;
+            }
+            if((flags & 2) && available >= 4 + sideInfo + pos + 4)
+            {
+                bytes = be32(xing + pos);
+                pos += 4;
+            }
+            if(flags & 4)
+                pos += 100; // seek table
+            if(flags & 8)
+                pos += 4; // quality
+
+            // LAME extension: 12-bit encoder delay and padding at +21.
+            if(available >= 4 + sideInfo + pos + 24 && !memcmp(xing + pos, "LAME", 4))
+            {
+                const uchar *gap = xing + pos + 21;
+                trimmed = int((unsigned(gap[0]) << 4) | (gap[1] >> 4)) + int(((gap[1] & 0x0f) << 8) | gap[2]);
+            }
+        }
+        else if(available >= 4 + 32 + 18 && !memcmp(vbri, "VBRI", 4))
+        {
+            bytes = be32(vbri + 10);
+            frames = be32(vbri + 14);
+        }
+
+        if(frames > 0)
+        {
+            long long samples = static_cast<long long>(frames) * samplesPerFrame - trimmed;
+            if(info.duration == 0 && samples > 0)
+                info.duration = int(samples * 1000 / rate);
+            estimateBitrate(info, bytes > 0 ? size_t(bytes) : audioBytes);
+        }
+        else
+        {
+            setIfZero(info.bitrate, kbps);
+            if(info.duration == 0)
+                info.duration = int(static_cast<unsigned long long>(audioBytes) * 8 / kbps);
+        }
+        return;
+    }
+}
+
+bool readMpeg(const uchar *p, size_t n, TrackInfo &info)
+{
+    size_t tag = id3v2(p, n, info);
+    bool found = tag > 0;
+    if(id3v1(p, n, info))
+        found = true;
+
+    if(tag < n)
+    {
+        size_t audioBytes = n - tag - (n >= 128 && !memcmp(p + n - 128, "TAG", 3) ? 128 : 0);
+        mpegStream(p + tag, n - tag, audioBytes, info);
+    }
+
+    return found || info.sampleRate != 0;
+}
+
+// ---------------------------------------------------------------- Vorbis comments
+
+// Calls visit(key, value, length) for every comment; keys are upper-cased.
+template<typename Visit>
+void forEachComment(const uchar *p, size_t n, Visit visit)
+{
+    if(n < 8)
+        return;
+
+    size_t pos = 4 + size_t(le32(p)); // vendor string
+    if(pos + 4 > n)
+        return;
+
+    unsigned int count = le32(p + pos);
+    pos += 4;
+
+    for(unsigned int i = 0; i < count && pos + 4 <= n; i++)
+    {
+        size_t length = le32(p + pos);
+        pos += 4;
+        if(length > n - pos)
+            break;
+
+        const char *entry = reinterpret_cast<const char *>(p + pos);
+        const char *eq = static_cast<const char *>(memchr(entry, '=', length));
+        pos += length;
+        if(!eq)
+            continue;
+
+        string key(entry, eq - entry);
+        for(char &c : key)
+            c = (c >= 'a' && c <= 'z') ? char(c - 32) : c;
+
+        visit(key, reinterpret_cast<const uchar *>(eq + 1), length - (eq + 1 - entry));
+    }
+}
+
+void vorbisComments(const uchar *p, size_t n, TrackInfo &info)
+{
+    forEachComment(p, n, [&info](const string &key, const uchar *value, size_t valueLength) {
+        if(key == "TITLE")
+            setIfEmpty(info.title, fromUtf8(value, valueLength));
+        else if(key == "ARTIST")
+            setIfEmpty(info.artist, fromUtf8(value, valueLength));
+        else if(key == "ALBUM")
+            setIfEmpty(info.album, fromUtf8(value, valueLength));
+        else if(key == "GENRE")
+            setIfEmpty(info.genre, fromUtf8(value, valueLength));
+        else if(key == "TRACKNUMBER")
+            setIfZero(info.trackNumber, leadingNumber(fromUtf8(value, valueLength)));
+        else if(key == "DATE" || key == "YEAR")
+            setIfZero(info.year, yearOf(fromUtf8(value, valueLength)));
+        else if(key == "BPM")
+            setIfZero(info.bpm, leadingNumber(fromUtf8(value, valueLength)));
+    });
+}
+
+// ---------------------------------------------------------------- FLAC
+
+bool readFlac(const uchar *p, size_t n, TrackInfo &info)
+{
+    size_t start = id3v2Size(p, n);
+    if(start + 4 > n || memcmp(p + start, "fLaC", 4) != 0)
+        return false;
+
+    size_t pos = start + 4;
+    bool last = false;
+    while(!last && pos + 4 <= n)
+    {
+        last = (p[pos] & 0x80) != 0;
+        int type = p[pos] & 0x7f;
+        size_t length = be24(p + pos + 1);
+        pos += 4;
+        if(length > n - pos)
+            break;
+
+        const uchar *block = p + pos;
+        if(type == 0 && length >= 18) // STREAMINFO
+        {
+            int rate = int((unsigned(block[10]) << 12) | (unsigned(block[11]) << 4) | (block[12] >> 4));
+            unsigned long long samples = (static_cast<unsigned long long>(block[13] & 0x0f) << 32) | be32(block + 14);
+            setIfZero(info.sampleRate, rate);
+            if(rate > 0 && info.duration == 0)
+                info.duration = int(samples * 1000 / rate);
+        }
+        else if(type == 4) // VORBIS_COMMENT
+            vorbisComments(block, length, info);
+
+        pos += length;
+    }
+
+    // Vorbis comments win; an ID3 tag in front of the stream fills the gaps.
+    id3v2(p, n, info);
+    estimateBitrate(info, pos < n ? n - pos : 0);
+    return true;
+}
+
+// ---------------------------------------------------------------- Ogg
+
+// Reassembles the first packets of the first logical stream. A packet that
+// fits in one page is returned in place; only packets spanning pages (big
+// comment headers) are copied.
+class OggPackets
+{
+public:
+    OggPackets(const uchar *p, size_t n) : p(p), n(n) {}
+
+    bool next(const uchar *&packet, size_t &length)
+    {
+        buffer.clear();
+        bool spanning = false;
+
+        while(true)
+        {
+            if(segment >= segments && !nextPage())
+                return false;
+
+            size_t start = body;
+            size_t size = 0;
+            bool complete = false;
+            while(segment < segments)
+            {
+                uchar lace = p[page + 27 + segment++];
+                size += lace;
+                if(lace < 255)
+                {
+                    complete = true;
+                    break;
+                }
+            }
+
+            if(start + size > n)
+                return false;
+            body += size;
+
+            if(complete && !spanning)
+            {
+                packet = p + start;
+                length = size;
+                return true;
+            }
+
+            buffer.insert(buffer.end(), p + start, p + start + size);
+            spanning = true;
+            if(complete)
+            {
+                packet = buffer.data();
+                length = buffer.size();
+                return true;
+            }
+        }
+    }
+
+private:
+    bool nextPage()
+    {
+        size_t at = page == npos ? 0 : body;
+        if(at + 27 > n || memcmp(p + at, "OggS", 4) != 0)
+            return false;
+
+        unsigned int pageSerial = le32(p + at + 14);
+        if(page == npos)
+            serial = pageSerial;
+        else if(pageSerial != serial)
+            return false;
+
+        page = at;
+        segments = p[at + 26];
+        segment = 0;
+        body = at + 27 + segments;
+        return body <= n;
+    }
+
+    static const size_t npos = size_t(-1);
+
+    const uchar *p;
+
+    size_t n;
+
+    size_t page = npos;
+
+    size_t body = 0;
+
+    unsigned int serial = 0;
+
+    int segments = 0;
+
+    int segment = 0;
+
+    vector<uchar> buffer;
+};
+
+// Scans back from the end for the last page of the given stream; pages are
+// at most about 64 KiB, so only the tail of the file is touched.
+long long oggLastGranule(const uchar *p, size_t n, unsigned int serial)
+{
+    const size_t window = 128 * 1024;
+    if(n < 27)
+        return 0;
+
+    size_t stop = n > window ? n - window : 0;
+    for(size_t i = n - 26; i-- > stop; )
+    {
+        if(p[i] == 'O' && !memcmp(p + i, "OggS", 4) && le32(p + i + 14) == serial)
+            return static_cast<long long>((static_cast<unsigned long long>(le32(p + i + 10)) << 32) | le32(p + i + 6));
+    }
+    return 0;
+}
+
+bool readOgg(const uchar *p, size_t n, TrackInfo &info)
+{
+    if(n < 4 || memcmp(p, "OggS", 4) != 0)
+        return false;
+
+    OggPackets packets(p, n);
+    const uchar *packet;
+    size_t length;
+
+    if(!packets.next(packet, length))
+        return true;
+
+    bool opus = false;
+    int preSkip = 0;
+    if(length >= 30 && !memcmp(packet, "\x01vorbis", 7))
+    {
+        setIfZero(info.sampleRate, int(le32(packet + 12)));
+        int nominal = int(le32(packet + 20));
+        if(nominal > 0)
+            setIfZero(info.bitrate, nominal / 1000);
+    }
+    else if(length >= 19 && !memcmp(packet, "OpusHead", 8))
+    {
+        opus = true;
+        preSkip = packet[10] | (packet[11] << 8);
+        setIfZero(info.sampleRate, int(le32(packet + 12)));
+    }
+    else
+        return true;
+
+    if(!packets.next(packet, length))
+        return true;
+
+    if(!opus && length > 7 && !memcmp(packet, "\x03vorbis", 7))
+        vorbisComments(packet + 7, length - 7, info);
+    else if(opus && length > 8 && !memcmp(packet, "OpusTags", 8))
+        vorbisComments(packet + 8, length - 8, info);
+
+    // The granule position of the last page is the total sample count
+    // (at 48 kHz, including the pre-skip, for Opus).
+    long long samples = oggLastGranule(p, n, le32(p + 14));
+    int clock = opus ? 48000 : info.sampleRate;
+    if(opus)
+        samples -= preSkip;
+    if(info.duration == 0 && samples > 0 && clock > 0)
+        info.duration = int(samples * 1000 / clock);
+    estimateBitrate(info, n);
+
+    return true;
+}
+
+// ---------------------------------------------------------------- MP4
+
+struct Atom
+{
+    char type[5];
+
+    const uchar *body;
+
+    size_t length;
+};
+
+// Iterates the child atoms in [p, p + n).
+class Atoms
+{
+public:
+    Atoms(const uchar *p, size_t n) : p(p), n(n) {}
+
+    bool next(Atom &atom)
+    {
+        if(pos + 8 > n)
+            return false;
+
+        unsigned long long size = be32(p + pos);
+        size_t header = 8;
+        if(size == 1)
+        {
+            if(pos + 16 > n)
+                return false;
+            size = be64(p + pos + 8);
+            header = 16;
+        }
+        else if(size == 0)
+            size = n - pos;
+
+        if(size < header || size > n - pos)
+            return false;
+
+        memcpy(atom.type, p + pos + 4, 4);
+        atom.type[4] = 0;
+        atom.body = p + pos + header;
+        atom.length = size_t(size) - header;
+        pos += size_t(size);
+        return true;
+    }
+
+private:
+    const uchar *p;
+
+    size_t n;
+
+    size_t pos = 0;
+};
+
+bool findAtom(const uchar *p, size_t n, const char *type, Atom &atom)
+{
+    Atoms atoms(p, n);
+    while(atoms.next(atom))
+    {
+        if(!memcmp(atom.type, type, 4))
+            return true;
+    }
+    return false;
+}
+
+void mp4Item(const Atom &item, TrackInfo &info)
+{
+    Atom data;
+    if(!findAtom(item.body, item.length, "data", data) || data.length < 8)
+        return;
+
+    const uchar *value = data.body + 8; // type indicator and locale
+    size_t length = data.length - 8;
+    const char *type = item.type;
+
+    if(!memcmp(type, "\xa9nam", 4))
+        setIfEmpty(info.title, fromUtf8(value, length));
+    else if(!memcmp(type, "\xa9" "ART", 4))
+        setIfEmpty(info.artist, fromUtf8(value, length));
+    else if(!memcmp(type, "\xa9" "alb", 4))
+        setIfEmpty(info.album, fromUtf8(value, length));
+    else if(!memcmp(type, "\xa9gen", 4))
+        setIfEmpty(info.genre, fromUtf8(value, length));
+    else if(!memcmp(type, "gnre", 4) && length >= 2)
+        setIfEmpty(info.genre, genreName(int(be16(value)) - 1));
+    else if(!memcmp(type, "\xa9" "day", 4))
+        setIfZero(info.year, yearOf(fromUtf8(value, length)));
+    else if(!memcmp(type, "trkn", 4) && length >= 4)
+        setIfZero(info.trackNumber, int(be16(value + 2)));
+    else if(!memcmp(type, "tmpo", 4) && length >= 2)
+        setIfZero(info.bpm, int(be16(value)));
+}
+
+void mp4Track(const Atom &trak, TrackInfo &info)
+{
+    Atom mdia, minf, stbl, stsd;
+    if(!findAtom(trak.body, trak.length, "mdia", mdia) || !findAtom(mdia.body, mdia.length, "minf", minf)
+       || !findAtom(minf.body, minf.length, "stbl", stbl) || !findAtom(stbl.body, stbl.length, "stsd", stsd))
+        return;
+
+    // Full box header and entry count, then the first sample entry.
+    if(stsd.length < 8)
+        return;
+
+    Atom entry;
+    if(!Atoms(stsd.body + 8, stsd.length - 8).next(entry) || entry.length < 28)
+        return;
+
+    if(!memcmp(entry.type, "mp4a", 4) || !memcmp(entry.type, "alac", 4))
+        setIfZero(info.sampleRate, int(be16(entry.body + 24)));
+}
+
+bool readMp4(const uchar *p, size_t n, TrackInfo &info)
+{
+    if(n < 8 || memcmp(p + 4, "ftyp", 4) != 0)
+        return false;
+
+    Atom moov;
+    if(!findAtom(p, n, "moov", moov))
+        return true;
+
+    Atoms children(moov.body, moov.length);
+    Atom atom;
+    while(children.next(atom))
+    {
+        if(!memcmp(atom.type, "mvhd", 4) && atom.length >= 32)
+        {
+            const uchar *b = atom.body;
+            unsigned int timescale;
+            unsigned long long duration;
+            if(b[0] == 1)
+            {
+                timescale = be32(b + 20);
+                duration = be64(b + 24);
+            }
+            else
+            {
+                timescale = be32(b + 12);
+                duration = be32(b + 16);
+            }
+            if(timescale > 0 && info.duration == 0)
+                info.duration = int(duration * 1000 / timescale);
+        }
+        else if(!memcmp(atom.type, "trak", 4) && info.sampleRate == 0)
+            mp4Track(atom, info);
+        else if(!memcmp(atom.type, "udta", 4))
+        {
+            Atom meta, ilst;
+            if(findAtom(atom.body, atom.length, "meta", meta) && meta.length > 4
+               && findAtom(meta.body + 4, meta.length - 4, "ilst", ilst))
+            {
+                Atoms items(ilst.body, ilst.length);
+                Atom item;
+                while(items.next(item))
+                    mp4Item(item, info);
+            }
+        }
+    }
+
+    estimateBitrate(info, n);
+    return true;
+}
+
+// ---------------------------------------------------------------- WAV
+
+bool readWav(const uchar *p, size_t n, TrackInfo &info)
+{
+    if(n < 12 || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0)
+        return false;
+
+    unsigned int byteRate = 0;
+    size_t pos = 12;
+    while(pos + 8 <= n)
+    {
+        size_t length = le32(p + pos + 4);
+        const uchar *chunk = p + pos + 8;
+
+        if(!memcmp(p + pos, "fmt ", 4) && length >= 16 && pos + 8 + 16 <= n)
+        {
+            setIfZero(info.sampleRate, int(le32(chunk + 4)));
+            byteRate = le32(chunk + 8);
+        }
+        else if(!memcmp(p + pos, "data", 4))
+        {
+            // Streams that were never finalised leave the size at 0 or -1.
+            if(length == 0 || length > n - pos - 8)
+                length = n - pos - 8;
+            if(byteRate > 0)
+            {
+                if(info.duration == 0)
+                    info.duration = int(static_cast<unsigned long long>(length) * 1000 / byteRate);
+                setIfZero(info.bitrate, int(byteRate * 8 / 1000));
+            }
+            break;
+        }
+
+        pos += 8 + length + (length & 1);
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------- cover art
+
+// The best picture seen so far: a front cover wins over any other type.
+// Pictures that were decoded or reassembled live in scratch, everything
+// else points straight into the file image.
+struct Picture
+{
+    const uchar *base;
+
+    size_t n;
+
+    string &scratch;
+
+    const uchar *data = nullptr;
+
+    size_t size = 0;
+
+    bool front = false;
+
+    Picture(const uchar *base, size_t n, string &scratch) : base(base), n(n), scratch(scratch) {}
+
+    void offer(const uchar *candidate, size_t length, bool isFront)
+    {
+        if(length == 0 || (data && (front || !isFront)))
+            return;
+
+        if(candidate >= base && candidate + length <= base + n)
+            data = candidate;
+        else
+        {
+            scratch.assign(reinterpret_cast<const char *>(candidate), length);
+            data = reinterpret_cast<const uchar *>(scratch.data());
+        }
+        size = length;
+        front = isFront;
+    }
+};
+
+// ID3v2.3/2.4 APIC and ID3v2.2 PIC frames.
+void id3Picture(const char *id, const uchar *b, size_t length, Picture &picture)
+{
+    size_t pos;
+    if(!strcmp(id, "APIC"))
+    {
+        const uchar *nul = static_cast<const uchar *>(memchr(b + 1, 0, length - 1));
+        if(!nul)
+            return;
+        pos = size_t(nul - b) + 1;
+    }
+    else if(!strcmp(id, "PIC"))
+        pos = 4;
+    else
+        return;
+
+    if(pos >= length)
+        return;
+
+    bool front = b[pos++] == 3;
+    bool wide = b[0] == 1 || b[0] == 2;
+    if(wide)
+    {
+        while(pos + 1 < length && (b[pos] || b[pos + 1]))
+            pos += 2;
+        pos += 2;
+    }
+    else
+    {
+        while(pos < length && b[pos])
+            pos++;
+        pos++;
+    }
+
+    if(pos < length)
+        picture.offer(b + pos, length - pos, front);
+}
+
+// FLAC PICTURE block, also found base64-encoded in Vorbis comments.
+void flacPicture(const uchar *b, size_t length, Picture &picture)
+{
+    if(length < 32)
+        return;
+
+    bool front = be32(b) == 3;
+    size_t pos = 4;
+    size_t mime = be32(b + pos);
+    if(mime > length - pos - 4)
+        return;
+    pos += 4 + mime;
+
+    if(pos + 4 > length)
+        return;
+    size_t description = be32(b + pos);
+    if(description > length - pos - 4)
+        return;
+    pos += 4 + description + 16; // width, height, depth, colours
+
+    if(pos + 4 > length)
+        return;
+    size_t size = be32(b + pos);
+    pos += 4;
+    if(size <= length - pos)
+        picture.offer(b + pos, size, front);
+}
+
+string fromBase64(const uchar *p, size_t n)
+{
+    static const string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    out.reserve(n / 4 * 3);
+
+    unsigned int bits = 0;
+    int count = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        size_t v = alphabet.find(char(p[i]));
+        if(v == string::npos)
+            continue;
+        bits = (bits << 6) | unsigned(v);
+        count += 6;
+        if(count >= 8)
+        {
+            count -= 8;
+            out.push_back(char((bits >> count) & 0xff));
+        }
+    }
+    return out;
+}
+
+void commentPictures(const uchar *p, size_t n, Picture &picture)
+{
+    forEachComment(p, n, [&picture](const string &key, const uchar *value, size_t length) {
+        if(key == "METADATA_BLOCK_PICTURE")
+        {
+            string block = fromBase64(value, length);
+            flacPicture(reinterpret_cast<const uchar *>(block.data()), block.size(), picture);
+        }
+        else if(key == "COVERART")
+        {
+            string image = fromBase64(value, length);
+            picture.offer(reinterpret_cast<const uchar *>(image.data()), image.size(), false);
+        }
+    });
+}
+
+void mp4Picture(const uchar *p, size_t n, Picture &picture)
+{
+    Atom moov, udta, meta, ilst, covr, data;
+    if(!findAtom(p, n, "moov", moov) || !findAtom(moov.body, moov.length, "udta", udta)
+       || !findAtom(udta.body, udta.length, "meta", meta) || meta.length <= 4
+       || !findAtom(meta.body + 4, meta.length - 4, "ilst", ilst)
+       || !findAtom(ilst.body, ilst.length, "covr", covr)
+       || !findAtom(covr.body, covr.length, "data", data) || data.length <= 8)
+        return;
+
+    picture.offer(data.body + 8, data.length - 8, true);
+}
+
+void oggPicture(const uchar *p, size_t n, Picture &picture)
+{
+    OggPackets packets(p, n);
+    const uchar *packet;
+    size_t length;
+    if(!packets.next(packet, length) || !packets.next(packet, length))
+        return;
+
+    if(length > 7 && !memcmp(packet, "\x03vorbis", 7))
+        commentPictures(packet + 7, length - 7, picture);
+    else if(length > 8 && !memcmp(packet, "OpusTags", 8))
+        commentPictures(packet + 8, length - 8, picture);
+}
+
+void flacPictures(const uchar *p, size_t n, size_t pos, Picture &picture)
+{
+    bool last = false;
+    while(!last && pos + 4 <= n)
+    {
+        last = (p[pos] & 0x80) != 0;
+        int type = p[pos] & 0x7f;
+        size_t length = be24(p + pos + 1);
+        pos += 4;
+        if(length > n - pos)
+            break;
+
+        if(type == 6)
+            flacPicture(p + pos, length, picture);
+        else if(type == 4)
+            commentPictures(p + pos, length, picture);
+        pos += length;
+    }
+}
+
+}
+
+bool readTags(const unsigned char *data, size_t size, TrackInfo &info)
+{
+    if(readMp4(data, size, info) || readOgg(data, size, info) || readFlac(data, size, info)
+       || readWav(data, size, info))
+        return true;
+
+    return readMpeg(data, size, info);
+}
+
+bool findCoverArt(const unsigned char *data, size_t size, const unsigned char *&art, size_t &artSize, string &scratch)
+{
+    Picture picture(data, size, scratch);
+
+    if(size >= 8 && !memcmp(data + 4, "ftyp", 4))
+        mp4Picture(data, size, picture);
+    else if(size >= 4 && !memcmp(data, "OggS", 4))
+        oggPicture(data, size, picture);
+    else
+    {
+        size_t tag = id3v2Frames(data, size, [&picture](const char *id, const uchar *body, size_t length) {
+            id3Picture(id, body, length, picture);
+        });
+        if(tag + 4 <= size && !memcmp(data + tag, "fLaC", 4))
+            flacPictures(data, size, tag + 4, picture);
+    }
+
+    art = picture.data;
+    artSize = picture.size;
+    return art != nullptr;
+}
+
+bool looksLikeAudio(const unsigned char *data, size_t size)
+{
+    if(size >= 4 && (!memcmp(data, "ID3", 3) || !memcmp(data, "fLaC", 4) || !memcmp(data, "OggS", 4)))
+        return true;
+    if(size >= 12 && !memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WAVE", 4))
+        return true;
+    if(size >= 8 && !memcmp(data + 4, "ftyp", 4))
+        return true;
+
+    // A bare MPEG audio frame header: sync, a valid layer, bitrate and
+    // sample rate index.
+    return size >= 4 && data[0] == 0xff && (data[1] & 0xe0) == 0xe0 && (data[1] & 0x06) != 0
+           && (data[2] & 0xf0) != 0xf0 && (data[2] & 0x0c) != 0x0c;
+}
+
+bool findAudioPayload(const unsigned char *data, size_t size, AudioPayload &payload)
+{
+    const uchar *p = data;
+    size_t n = size;
+    payload = AudioPayload();
+
+    if(n >= 8 && !memcmp(p + 4, "ftyp", 4))
+    {
+        Atom mdat;
+        if(!findAtom(p, n, "mdat", mdat))
+            return false;
+        payload.begin = size_t(mdat.body - p);
+        payload.end = payload.begin + mdat.length;
+        return mdat.length > 0;
+    }
+
+    if(n >= 4 && !memcmp(p, "OggS", 4))
+    {
+        // Header pages carry granule position 0 (or -1 while a big comment
+        // packet continues); audio starts on the first page after them.
+        size_t at = 0;
+        while(at + 27 <= n && !memcmp(p + at, "OggS", 4))
+        {
+            unsigned long long granule = (static_cast<unsigned long long>(le32(p + at + 10)) << 32) | le32(p + at + 6);
+            if(granule != 0 && granule != ~0ULL)
+            {
+                payload.begin = at;
+                payload.end = n;
+                payload.ogg = true;
+                return true;
+            }
+
+            size_t body = at + 27 + p[at + 26];
+            if(body > n)
+                return false;
+            size_t length = 0;
+            for(int i = 0; i < p[at + 26]; i++)
+                length += p[at + 27 + i];
+            at = body + length;
+        }
+        return false;
+    }
+
+    if(n >= 12 && !memcmp(p, "RIFF", 4) && !memcmp(p + 8, "WAVE", 4))
+    {
+        size_t pos = 12;
+        while(pos + 8 <= n)
+        {
+            size_t length = le32(p + pos + 4);
+            if(!memcmp(p + pos, "data", 4))
+            {
+                if(length == 0 || length > n - pos - 8)
+                    length = n - pos - 8;
+                payload.begin = pos + 8;
+                payload.end = pos + 8 + length;
+                return length > 0;
+            }
+            pos += 8 + length + (length & 1);
+        }
+        return false;
+    }
+
+    // MPEG and FLAC streams: drop an ID3v2 tag in front, FLAC metadata
+    // blocks, and ID3v1/APEv2 tags at the end.
+    size_t begin = id3v2Size(p, n);
+    if(begin + 4 <= n && !memcmp(p + begin, "fLaC", 4))
+    {
+        size_t pos = begin + 4;
+        bool last = false;
+        while(!last && pos + 4 <= n)
+        {
+            last = (p[pos] & 0x80) != 0;
+            pos += 4 + be24(p + pos + 1);
+        }
+        begin = pos < n ? pos : n;
+    }
+
+    size_t end = n;
+    if(end - begin >= 128 && !memcmp(p + end - 128, "TAG", 3))
+        end -= 128;
+    if(end - begin >= 32 && !memcmp(p + end - 32, "APETAGEX", 8))
+    {
+        size_t tag = le32(p + end - 32 + 12) + ((le32(p + end - 32 + 20) & 0x80000000u) ? 32 : 0);
+        if(tag <= end - begin)
+            end -= tag;
+    }
+
+    payload.begin = begin;
+    payload.end = end;
+    return end > begin;
+}
+
+void forEachAudioChunk(const unsigned char *data, const AudioPayload &payload, size_t from, size_t to,
+                       const function<void(const unsigned char *, size_t)> &visit)
+{
+    from = from < payload.begin ? payload.begin : from;
+    to = to > payload.end ? payload.end : to;
+    if(from >= to)
+        return;
+
+    if(!payload.ogg)
+    {
+        visit(data + from, to - from);
+        return;
+    }
+
+    // Find the first real page at or after from: the capture pattern,
+    // version 0 and the serial number of the stream.
+    const uchar *p = data;
+    size_t n = payload.end;
+    unsigned int serial = le32(p + payload.begin + 14);
+    size_t at = from;
+    while(at + 27 <= n && !(p[at] == 'O' && !memcmp(p + at, "OggS", 4) && p[at + 4] == 0 && le32(p + at + 14) == serial))
+        at++;
+
+    while(at < to && at + 27 <= n && !memcmp(p + at, "OggS", 4))
+    {
+        int segments = p[at + 26];
+        size_t body = at + 27 + segments;
+        if(body > n)
+            return;
+        size_t length = 0;
+        for(int i = 0; i < segments; i++)
+            length += p[at + 27 + i];
+        if(length > n - body)
+            length = n - body;
+
+        if(le32(p + at + 14) == serial)
+            visit(p + body, length);
+        at = body + length;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef TAGREADER_H
+#define TAGREADER_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+using namespace std;
+
+// Metadata of one audio file. Text is UTF-8; numbers are 0 when unknown.
+struct TrackInfo
+{
+    string title;
+
+    string artist;
+
+    string album;
+
+    string genre;
+
+    int trackNumber = 0;
+
+    int year = 0;
+
+    int duration = 0; // milliseconds
+
+    int sampleRate = 0; // Hz
+
+    int bitrate = 0; // kbit/s
+
+    int bpm = 0; // beats per minute, -1 when analysis found no steady beat
+};
+
+// Reads ID3v2/ID3v1 (MP3), FLAC metadata blocks, Ogg Vorbis/Opus comments
+// and MP4/M4A atoms straight out of a file image, normally a memory map of
+// the whole file: only the pages holding headers are ever touched, and
+// nothing is copied except the values that end up in info.
+// Returns false when no known container or tag was recognised.
+bool readTags(const unsigned char *data, size_t size, TrackInfo &info);
+
+// Finds embedded cover art: ID3 APIC/PIC frames, FLAC PICTURE blocks,
+// Vorbis METADATA_BLOCK_PICTURE comments or the MP4 covr atom, preferring
+// a front cover. On success art points at the encoded image, inside data
+// or, if it had to be decoded or reassembled first, inside scratch.
+bool findCoverArt(const unsigned char *data, size_t size, const unsigned char *&art, size_t &artSize,
+                  string &scratch);
+
+// Where the encoded audio of a file lies, with tags and container metadata
+// left out: two files that differ only in their tags have payloads of the
+// same length and content. For Ogg the range still holds page headers,
+// which embed the page sequence number; forEachAudioChunk() skips them.
+struct AudioPayload
+{
+    size_t begin = 0;
+
+    size_t end = 0;
+
+    bool ogg = false;
+};
+
+bool findAudioPayload(const unsigned char *data, size_t size, AudioPayload &payload);
+
+// Calls visit with the audio bytes between the file offsets from and to
+// (inside the payload). For Ogg, visiting starts at the first page at or
+// after from, and only page bodies are visited.
+void forEachAudioChunk(const unsigned char *data, const AudioPayload &payload, size_t from, size_t to,
+                       const function<void(const unsigned char *, size_t)> &visit);
+
+// Whether data starts like a file readTags() understands. Used to pick up
+// audio files that have no recognised extension.
+bool looksLikeAudio(const unsigned char *data, size_t size);
+
+#endif // TAGREADER_H
@@ -0,0 +1,135 @@
+#include "tagscanner.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include "cuesheet.h"
+
+namespace {
+
+// Files handed to one pool task, and how many are read before publishing.
+const int FilesPerTask = 32;
+const int FilesPerBatch = 8;
+
+// Headers are expected near the start; this much is read when a file
+// cannot be memory mapped.
+const qint64 FallbackReadSize = 1024 * 1024;
+
+}
+
+TagScanner::TagScanner(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+TagScanner::~TagScanner()
+{
+    cancelled = true;
+    pool.waitForDone();
+}
+
+void TagScanner::scan(const std::vector<Job> &jobs)
+{
+    for(size_t first = 0; first < jobs.size(); first += FilesPerTask)
+    {
+        size_t last = std::min(jobs.size(), first + FilesPerTask);
+        std::vector<Job> chunk(jobs.begin() + first, jobs.begin() + last);
+
+        pool.start([this, chunk]() {
+            std::vector<Result> batch;
+            CueSheet sheet;
+            for(const Job &job : chunk)
+            {
+                if(cancelled)
+                    return;
+
+                // A cue sheet's tracks change with the sheet.
+                string sheetPath;
+                int number;
+                QFileInfo file(QString::fromStdString(CueSheet::split(job.location, sheetPath, number) ? sheetPath : job.location));
+                if(!file.exists())
+                    continue;
+
+                Result result;
+                result.id = job.id;
+                result.size = file.size();
+                result.modified = file.lastModified().toMSecsSinceEpoch();
+                if(result.size == job.size && result.modified == job.modified)
+                    continue;
+
+                // Files without recognisable tags are reported too, so that
+                // they get cached and are not read again next time.
+                readFile(job.location, result.info, sheet);
+                batch.push_back(result);
+
+                if(int(batch.size()) >= FilesPerBatch)
+                    publish(batch);
+            }
+            publish(batch);
+        });
+    }
+}
+
+bool TagScanner::readFile(const string &location, TrackInfo &info, CueSheet &sheet)
+{
+    // A track of a cue sheet takes its names from the sheet, and the rest
+    // from the file it is cut from.
+    string path;
+    int number;
+    if(CueSheet::split(location, path, number))
+    {
+        const CueSheet::Track *track = sheet.readCached(path) ? sheet.find(number) : nullptr;
+        if(!track)
+            return false;
+
+        readFile(track->file, info, sheet);
+        sheet.describe(*track, info);
+        return true;
+    }
+
+    QFile file(QString::fromStdString(location));
+    if(!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return false;
+
+    // Mapping the whole file costs nothing up front; only the pages the
+    // parser actually reads (headers, the ID3v1 trailer) are paged in.
+    qint64 size = file.size();
+    uchar *data = file.map(0, size);
+    if(data)
+    {
+        bool ok = readTags(data, size_t(size), info);
+        file.unmap(data);
+        return ok;
+    }
+
+    QByteArray head = file.read(FallbackReadSize);
+    return readTags(reinterpret_cast<const unsigned char *>(head.constData()), size_t(head.size()), info);
+}
+
+void TagScanner::publish(std::vector<Result> &batch)
+{
+    if(batch.empty())
+        return;
+
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&mutex);
+        wasEmpty = results.empty();
+        results.insert(results.end(), batch.begin(), batch.end());
+    }
+    batch.clear();
+
+    if(wasEmpty)
+        emit resultsReady();
+}
+
+std::vector<TagScanner::Result> TagScanner::takeResults()
+{
+    QMutexLocker locker(&mutex);
+    std::vector<Result> taken;
+    taken.swap(results);
+    return taken;
+}
@@ -0,0 +1,71 @@
+#ifndef TAGSCANNER_H
+#define TAGSCANNER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
+#include <vector>
+#include "cuesheet.h"
+#include "tagreader.h"
+
+// Reads tags of many files at once on a thread pool. Results are collected
+// in small batches; resultsReady() is emitted (queued to the receiver's
+// thread) whenever a batch lands in an empty queue, and takeResults()
+// hands over everything collected so far.
+class TagScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        unsigned int id;
+
+        string location;
+
+        // Size and modification time the cached metadata was read from;
+        // files that still match are not opened again.
+        long long size = -1;
+
+        long long modified = -1;
+    };
+
+    struct Result
+    {
+        unsigned int id;
+
+        long long size;
+
+        long long modified;
+
+        TrackInfo info;
+    };
+
+    TagScanner(QObject *parent = nullptr);
+
+    ~TagScanner();
+
+    void scan(const std::vector<Job> &jobs);
+
+    std::vector<Result> takeResults();
+
+    // sheet keeps the last cue sheet read, for the next track of the disc.
+    static bool readFile(const string &location, TrackInfo &info, CueSheet &sheet);
+
+signals:
+    void resultsReady();
+
+private:
+    void publish(std::vector<Result> &batch);
+
+    QThreadPool pool;
+
+    QMutex mutex;
+
+    std::vector<Result> results;
+
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // TAGSCANNER_H
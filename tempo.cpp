@@ -0,0 +1,202 @@
+#include "tempo.h"
+#include <algorithm>
+#include <cmath>
+#include "fft.h"
+
+namespace {
+
+const double Pi = 3.14159265358979323846;
+
+// Input below this level before the first sound is skipped (about -60 dB).
+const float SilenceLevel = 0.001f;
+
+// Magnitudes are log-compressed before differencing, so a quiet hi-hat
+// counts next to a loud kick drum.
+const float Compression = 100.0f;
+
+// Envelope frames in a second.
+const double FrameRate = double(TempoDetector::SampleRate) / TempoDetector::Hop;
+
+// Frames on either side averaged into the local level onsets have to rise
+// above; about a third of a second.
+const int LevelFrames = 16;
+
+// Less than this much audio gives no tempo.
+const int MinFrames = int(FrameRate * 10);
+
+// Tempos considered, the step between them, and the multiples of the
+// period each is scored over.
+const double MinBpm = 50;
+const double MaxBpm = 220;
+const double BpmStep = 0.25;
+const int Multiples = 4;
+
+// The lean towards moderate tempos: a log-normal weight centred here, with
+// this spread in octaves.
+const double PreferredBpm = 120;
+const double Spread = 1.0;
+
+// Less spectral flux than this per frame, on average, is a held sound
+// rather than one with onsets to count.
+const double MinFlux = 4;
+
+// The mean autocorrelation the best comb needs for the beat to count as
+// steady.
+const double MinCorrelation = 0.1;
+
+const Fft &fft()
+{
+    static const Fft instance(TempoDetector::FrameSize);
+    return instance;
+}
+
+// Linear interpolation between whole lags.
+double at(const vector<double> &values, double lag)
+{
+    int whole = int(lag);
+    if(whole + 1 >= int(values.size()))
+        return 0;
+    double fraction = lag - whole;
+    return values[whole] * (1 - fraction) + values[whole + 1] * fraction;
+}
+
+}
+
+TempoDetector::TempoDetector(int sampleRate)
+    : step(double(sampleRate) / SampleRate)
+    , window(FrameSize)
+{
+    for(int i = 0; i < FrameSize; i++)
+        window[i] = float(0.5 - 0.5 * std::cos(2 * Pi * i / (FrameSize - 1)));
+    envelope.reserve(Frames);
+}
+
+void TempoDetector::feed(const float *input, size_t n)
+{
+    // Box-filter decimation to SampleRate, as in Fingerprinter: onsets
+    // show in the low and middle bands, where the box filter leaves little
+    // aliasing.
+    for(size_t i = 0; i < n && !isFull(); i++)
+    {
+        if(!started)
+        {
+            if(std::fabs(input[i]) < SilenceLevel)
+                continue;
+            started = true;
+        }
+
+        accumulated += input[i];
+        accumulatedCount++;
+        position += 1;
+        if(position < step)
+            continue;
+
+        float sample = accumulated / float(accumulatedCount);
+        accumulated = 0;
+        accumulatedCount = 0;
+        for(; position >= step && !isFull(); position -= step)
+        {
+            samples.push_back(sample);
+            if(int(samples.size()) == FrameSize)
+                frame();
+        }
+    }
+}
+
+bool TempoDetector::isFull() const
+{
+    return int(envelope.size()) >= Frames;
+}
+
+void TempoDetector::frame()
+{
+    vector<float> re(FrameSize), im(FrameSize, 0.0f);
+    for(int i = 0; i < FrameSize; i++)
+        re[i] = samples[i] * window[i];
+    fft().transform(re, im);
+
+    const int bins = FrameSize / 2;
+    bool first = spectrum.empty();
+    spectrum.resize(bins);
+    float flux = 0;
+    for(int k = 1; k < bins; k++)
+    {
+        float magnitude = std::log1p(Compression * std::sqrt(re[k] * re[k] + im[k] * im[k]));
+        flux += std::max(0.0f, magnitude - spectrum[k]);
+        spectrum[k] = magnitude;
+    }
+    envelope.push_back(first ? 0.0f : flux);
+
+    samples.erase(samples.begin(), samples.begin() + Hop);
+}
+
+double TempoDetector::result() const
+{
+    const int n = int(envelope.size());
+    if(n < MinFrames)
+        return 0;
+
+    // Onsets are what rises above the local level; the rest counts as 0.
+    vector<double> sums(n + 1, 0.0);
+    for(int t = 0; t < n; t++)
+        sums[t + 1] = sums[t] + envelope[t];
+    if(sums[n] / n < MinFlux)
+        return 0;
+
+    vector<double> onsets(n);
+    for(int t = 0; t < n; t++)
+    {
+        int from = std::max(0, t - LevelFrames), to = std::min(n, t + LevelFrames + 1);
+        double level = (sums[to] - sums[from]) / (to - from);
+        onsets[t] = std::max(0.0, envelope[t] - level);
+    }
+
+    double average = 0;
+    for(double onset : onsets)
+        average += onset;
+    average /= n;
+    for(double &onset : onsets)
+        onset -= average;
+
+    // Autocorrelation over every lag the combs reach, as a mean per frame
+    // so long lags are not penalised for their shorter overlap, and
+    // relative to lag 0: 1 for a perfectly periodic envelope, around 0 for
+    // one without a beat.
+    const int minLag = int(FrameRate * 60 / MaxBpm);
+    const int maxLag = std::min(n / 2, int(std::ceil(FrameRate * 60 / MinBpm * Multiples)) + 1);
+    vector<double> correlation(maxLag + 1, 0.0);
+    double energy = 0;
+    for(double onset : onsets)
+        energy += onset * onset;
+    if(energy <= 0)
+        return 0;
+    energy /= n;
+    for(int lag = minLag; lag <= maxLag; lag++)
+    {
+        double sum = 0;
+        for(int t = 0; t + lag < n; t++)
+            sum += onsets[t] * onsets[t + lag];
+        correlation[lag] = sum / (n - lag) / energy;
+    }
+
+    double best = 0, bestScore = 0, bestComb = 0;
+    for(double bpm = MinBpm; bpm <= MaxBpm; bpm += BpmStep)
+    {
+        double period = FrameRate * 60 / bpm;
+        double comb = 0;
+        for(int k = 1; k <= Multiples; k++)
+            comb += at(correlation, k * period);
+        comb /= Multiples;
+
+        double octaves = std::log2(bpm / PreferredBpm);
+        double score = comb * std::exp(-0.5 * octaves * octaves / (Spread * Spread));
+        if(score > bestScore)
+        {
+            bestScore = score;
+            bestComb = comb;
+            best = bpm;
+        }
+    }
+
+    return bestComb >= MinCorrelation ? best : 0;
+}
@@ -0,0 +1,62 @@
+#ifndef TEMPO_H
+#define TEMPO_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Tempo of a recording in beats per minute, from about a minute of it.
+// An onset strength envelope (spectral flux: how much louder each
+// frequency band got since the frame before, summed over the bands) is
+// autocorrelated. Beats recur once per period, so the envelope matches
+// itself best at a lag of one beat and its multiples; every candidate
+// tempo is scored by a comb over the first multiples of its period. Half
+// and double the felt tempo score alike, so the score leans towards
+// moderate tempos, as a listener tapping along would.
+class TempoDetector
+{
+public:
+    static const int SampleRate = 11025;
+
+    static const int FrameSize = 512;
+
+    static const int Hop = 128;
+
+    // About a minute of audio.
+    static const int Frames = 5168;
+
+    TempoDetector(int sampleRate);
+
+    // Mono samples at the rate given to the constructor, in [-1, 1].
+    void feed(const float *samples, size_t n);
+
+    bool isFull() const;
+
+    // Beats per minute, or 0 when there is no steady beat (or too little
+    // audio to tell).
+    double result() const;
+
+private:
+    void frame();
+
+    double step;
+
+    double position = 0;
+
+    float accumulated = 0;
+
+    int accumulatedCount = 0;
+
+    vector<float> window;
+
+    vector<float> samples;
+
+    vector<float> spectrum; // of the frame before
+
+    vector<float> envelope; // one per frame
+
+    bool started = false;
+};
+
+#endif // TEMPO_H
@@ -0,0 +1,193 @@
+#include "temposcanner.h"
+#include <QAudioBuffer>
+#include <QAudioFormat>
+#include <QMutexLocker>
+#include <QThread>
+#include <QUrl>
+#include "fingerprintscanner.h"
+
+TempoScanner::TempoScanner(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(1);
+    pool.setThreadPriority(QThread::LowestPriority);
+
+    // Ask for what the detector analyses, so the decoder does the
+    // downmixing and most of the decimation.
+    decoder = new QAudioDecoder(this);
+    QAudioFormat format;
+    format.setSampleRate(TempoDetector::SampleRate);
+    format.setChannelCount(1);
+    format.setSampleFormat(QAudioFormat::Float);
+    decoder->setAudioFormat(format);
+
+    connect(decoder, SIGNAL(bufferReady()), this, SLOT(on_bufferReady()));
+    connect(decoder, SIGNAL(finished()), this, SLOT(on_decoderFinished()));
+    connect(decoder, SIGNAL(error(QAudioDecoder::Error)), this, SLOT(on_decoderError()));
+    connect(this, SIGNAL(analysed()), this, SLOT(on_analysed()));
+}
+
+TempoScanner::~TempoScanner()
+{
+    decoder->stop();
+    pool.waitForDone();
+}
+
+void TempoScanner::add(const vector<Job> &jobs)
+{
+    for(const Job &job : jobs)
+    {
+        if(queued.insert(job.id).second)
+            queue.push_back(job);
+    }
+    decodeNext();
+}
+
+void TempoScanner::setPaused(bool paused)
+{
+    if(paused == this->paused)
+        return;
+    this->paused = paused;
+
+    if(!paused)
+    {
+        decodeNext();
+        return;
+    }
+
+    // What was decoded so far is dropped; the track starts over once
+    // playback has what it needs.
+    if(decoding)
+    {
+        decoding = false;
+        decoder->stop();
+        detector.reset();
+        queue.push_front(current);
+    }
+}
+
+vector<TempoScanner::Result> TempoScanner::takeResults()
+{
+    QMutexLocker locker(&mutex);
+    vector<Result> taken;
+    taken.swap(results);
+    return taken;
+}
+
+void TempoScanner::decodeNext()
+{
+    if(decoding || analysing || paused || queue.empty())
+        return;
+
+    current = queue.front();
+    queue.pop_front();
+
+    // A cue sheet track is the stretch of its image between its start and
+    // the next track's.
+    string file = current.location;
+    start = 0;
+    end = -1;
+    string sheetPath;
+    int number;
+    const CueSheet::Track *track = nullptr;
+    if(CueSheet::split(current.location, sheetPath, number) && sheet.readCached(sheetPath))
+        track = sheet.find(number);
+    if(track)
+    {
+        file = track->file;
+        start = track->start * 1000;
+        end = track->end >= 0 ? track->end * 1000 : -1;
+    }
+
+    detector.reset();
+    full = std::make_shared<atomic<bool>>(false);
+    decoding = true;
+    decoder->setSource(QUrl::fromLocalFile(QString::fromStdString(file)));
+    decoder->start();
+}
+
+void TempoScanner::on_bufferReady()
+{
+    QAudioBuffer buffer = decoder->read();
+    if(!decoding || !buffer.isValid())
+        return;
+
+    long long time = buffer.startTime();
+    if(end >= 0 && time >= end)
+    {
+        finishTrack();
+        return;
+    }
+
+    vector<float> mono = FingerprintScanner::monoSamples(buffer);
+    int rate = buffer.format().sampleRate();
+    if(time < start)
+    {
+        long long skip = (start - time) * rate / 1000000;
+        if(skip >= (long long)mono.size())
+            return;
+        mono.erase(mono.begin(), mono.begin() + skip);
+    }
+
+    if(!detector)
+        detector = std::make_shared<TempoDetector>(rate);
+    pool.start([detector = detector, full = full, mono = std::move(mono)]() {
+        detector->feed(mono.data(), mono.size());
+        if(detector->isFull())
+            *full = true;
+    });
+
+    // Only the first minute or so is needed; the rest is never decoded.
+    if(*full)
+        finishTrack();
+}
+
+void TempoScanner::on_decoderFinished()
+{
+    if(decoding)
+        finishTrack();
+}
+
+void TempoScanner::on_decoderError()
+{
+    if(decoding)
+        finishTrack();
+}
+
+void TempoScanner::finishTrack()
+{
+    decoding = false;
+    decoder->stop();
+
+    // Files that cannot be decoded count as having no steady beat, so they
+    // are not tried again until they change.
+    analysing = true;
+    pool.start([this, job = current, detector = detector]() {
+        double bpm = detector ? detector->result() : 0;
+        publish({ job.id, job.location, bpm > 0 ? int(bpm + 0.5) : -1 });
+        emit analysed();
+    });
+    detector.reset();
+}
+
+void TempoScanner::on_analysed()
+{
+    // Starting the next file from inside a decoder signal is not safe;
+    // analysed() is always delivered through the event loop.
+    analysing = false;
+    queued.erase(current.id);
+    decodeNext();
+}
+
+void TempoScanner::publish(const Result &result)
+{
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&mutex);
+        wasEmpty = results.empty();
+        results.push_back(result);
+    }
+
+    if(wasEmpty)
+        emit resultsReady();
+}
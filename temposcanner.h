@@ -0,0 +1,114 @@
+#ifndef TEMPOSCANNER_H
+#define TEMPOSCANNER_H
+
+#include <QAudioDecoder>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "cuesheet.h"
+#include "tempo.h"
+
+using namespace std;
+
+// Works out the tempo of queued tracks in the background, one track at a
+// time: about a minute of each is decoded to low-rate mono (see
+// TempoDetector) and analysed on a low-priority thread, so a library
+// takes a few seconds of CPU per track at most. Results are published the
+// way TagScanner publishes tags. Playback comes first: while paused (the
+// player waiting for data, say) nothing is decoded, and the track being
+// analysed starts over afterwards.
+class TempoScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        unsigned int id;
+
+        string location;
+    };
+
+    struct Result
+    {
+        unsigned int id;
+
+        string location;
+
+        int bpm; // -1 when there is no steady beat or the file cannot be decoded
+    };
+
+    TempoScanner(QObject *parent = nullptr);
+
+    ~TempoScanner();
+
+    // Tracks already queued are not queued again.
+    void add(const vector<Job> &jobs);
+
+    void setPaused(bool paused);
+
+    vector<Result> takeResults();
+
+signals:
+    // Emitted when results become available after takeResults() emptied
+    // the queue.
+    void resultsReady();
+
+    void analysed();
+
+private slots:
+    void on_bufferReady();
+
+    void on_decoderFinished();
+
+    void on_decoderError();
+
+    void on_analysed();
+
+    void decodeNext();
+
+private:
+    void finishTrack();
+
+    void publish(const Result &result);
+
+    QThreadPool pool;
+
+    QAudioDecoder *decoder;
+
+    // Fed on the pool, which runs one task at a time in order.
+    shared_ptr<TempoDetector> detector;
+
+    shared_ptr<atomic<bool>> full;
+
+    deque<Job> queue;
+
+    unordered_set<unsigned int> queued;
+
+    Job current;
+
+    // The sheet of the last cue sheet track decoded.
+    CueSheet sheet;
+
+    long long start = 0; // microseconds into the file where the track starts
+
+    long long end = -1; // microseconds into the file, -1 for the end of it
+
+    bool decoding = false;
+
+    bool analysing = false;
+
+    bool paused = false;
+
+    QMutex mutex;
+
+    vector<Result> results;
+};
+
+#endif // TEMPOSCANNER_H
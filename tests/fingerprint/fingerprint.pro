@@ -0,0 +1,17 @@
+# Checks that SimilarityIndex finds fingerprints that differ in 10-20% of
+# their bits and leaves unrelated ones apart. "make check" runs it.
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle qt
+
+TARGET = fingerprintcheck
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../fingerprint.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../fft.h \
+    ../../fingerprint.h
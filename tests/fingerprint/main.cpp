@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "fingerprint.h"
+
+using namespace std;
+
+namespace {
+
+const int Frames = Fingerprinter::Frames;
+
+// Unrelated fingerprints the pairs have to be told apart from.
+const int Unrelated = 5000;
+
+const int PairsPerLevel = 50;
+
+struct Level
+{
+    double flipped; // share of bits flipped in the copy
+
+    int required; // pairs out of PairsPerLevel that must be found
+};
+
+// Up to 0.15 every pair must be found. At 0.2, right on the cut-off, about
+// 94% are expected; 80% leaves room for chance.
+const Level Levels[] = { { 0.10, PairsPerLevel }, { 0.15, PairsPerLevel }, { 0.20, PairsPerLevel * 4 / 5 } };
+
+vector<uint32_t> randomFingerprint(std::mt19937_64 &random)
+{
+    vector<uint32_t> words(Frames);
+    for(uint32_t &word : words)
+        word = uint32_t(random());
+    return words;
+}
+
+// A copy with exactly share of its bits flipped.
+vector<uint32_t> perturbed(vector<uint32_t> words, double share, std::mt19937_64 &random)
+{
+    vector<int> bits(Frames * 32);
+    for(int b = 0; b < int(bits.size()); b++)
+        bits[b] = b;
+    int flips = int(share * bits.size());
+    for(int i = 0; i < flips; i++)
+    {
+        int j = i + int(random() % (bits.size() - i));
+        std::swap(bits[i], bits[j]);
+        words[bits[i] >> 5] ^= 1u << (bits[i] & 31);
+    }
+    return words;
+}
+
+}
+
+int main()
+{
+    std::mt19937_64 random(37);
+    SimilarityIndex index;
+    unsigned int id = 0;
+
+    for(int i = 0; i < Unrelated; i++)
+    {
+        vector<uint32_t> words = randomFingerprint(random);
+        index.add(id++, words.data(), words.size());
+    }
+
+    // Pairs get ids 2k and 2k + 1 past the unrelated ones; level of each.
+    unordered_map<unsigned int, int> levelOf;
+    const int levels = int(sizeof(Levels) / sizeof(Levels[0]));
+    for(int level = 0; level < levels; level++)
+    {
+        for(int p = 0; p < PairsPerLevel; p++)
+        {
+            vector<uint32_t> words = randomFingerprint(random);
+            vector<uint32_t> copy = perturbed(words, Levels[level].flipped, random);
+            double distance = fingerprintDistance(words.data(), words.size(), copy.data(), copy.size());
+            if(distance > 0.2)
+            {
+                printf("FAIL: a copy with %.0f%% of bits flipped is at distance %.3f\n", Levels[level].flipped * 100, distance);
+                return 1;
+            }
+            levelOf[id] = level;
+            index.add(id++, words.data(), words.size());
+            index.add(id++, copy.data(), copy.size());
+        }
+    }
+
+    vector<int> found(levels, 0);
+    bool ok = true;
+    for(const vector<unsigned int> &group : index.groups())
+    {
+        auto it = levelOf.find(group[0]);
+        if(group.size() != 2 || it == levelOf.end() || group[1] != group[0] + 1)
+        {
+            printf("FAIL: unrelated fingerprints grouped:");
+            for(unsigned int member : group)
+                printf(" %u", member);
+            printf("\n");
+            ok = false;
+            continue;
+        }
+        found[it->second]++;
+    }
+
+    for(int level = 0; level < levels; level++)
+    {
+        bool passed = found[level] >= Levels[level].required;
+        printf("%s: %.0f%% of bits flipped, %d of %d pairs found (%d required)\n", passed ? "PASS" : "FAIL",
+               Levels[level].flipped * 100, found[level], PairsPerLevel, Levels[level].required);
+        ok = ok && passed;
+    }
+    return ok ? 0 : 1;
+}
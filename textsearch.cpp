@@ -0,0 +1,234 @@
+#include "textsearch.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TEXTSEARCH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTSEARCH_SSE2 1
+#endif
+
+namespace {
+
+inline char fold(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+inline bool matchesAt(const char *haystack, const char *needle, size_t m)
+{
+    for(size_t j = 0; j < m; j++)
+    {
+        if(fold(haystack[j]) != needle[j])
+            return false;
+    }
+    return true;
+}
+
+bool scalarContains(const char *haystack, size_t n, const char *needle, size_t m)
+{
+    if(m == 0)
+        return true;
+    if(n < m)
+        return false;
+
+    const char first = needle[0];
+    for(size_t i = 0; i + m <= n; i++)
+    {
+        if(fold(haystack[i]) == first && matchesAt(haystack + i + 1, needle + 1, m - 1))
+            return true;
+    }
+    return false;
+}
+
+#ifdef TEXTSEARCH_X86
+
+inline unsigned lowestBit(unsigned mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return unsigned(index);
+#else
+    return unsigned(__builtin_ctz(mask));
+#endif
+}
+
+// Checks the candidate positions in mask; the first and last needle bytes
+// are already known to match there.
+inline bool verify(const char *block, unsigned mask, const char *needle, size_t m)
+{
+    while(mask)
+    {
+        unsigned bit = lowestBit(mask);
+        if(m <= 2 || matchesAt(block + bit + 1, needle + 1, m - 2))
+            return true;
+        mask &= mask - 1;
+    }
+    return false;
+}
+
+// Haystack tails shorter than a full vector step are copied into a zero
+// padded stack buffer so the vector loop never reads past the string.
+const size_t TailBuffer = 256;
+
+#ifdef TEXTSEARCH_SSE2
+
+inline __m128i fold16(__m128i v)
+{
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+    __m128i upper = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+inline unsigned candidates16(const char *p, size_t m, __m128i first, __m128i last)
+{
+    __m128i a = fold16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    __m128i b = fold16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + m - 1)));
+    return unsigned(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+}
+
+bool sse2Contains(const char *haystack, size_t n, const char *needle, size_t m)
+{
+    if(m == 0)
+        return true;
+    if(n < m)
+        return false;
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[m - 1]);
+
+    size_t i = 0;
+    for(; i + m - 1 + 16 <= n; i += 16)
+    {
+        if(verify(haystack + i, candidates16(haystack + i, m, first, last), needle, m))
+            return true;
+    }
+
+    size_t rest = n - i;
+    if(rest < m)
+        return false;
+    if(rest + 16 > TailBuffer)
+        return scalarContains(haystack + i, rest, needle, m);
+
+    char buffer[TailBuffer];
+    memcpy(buffer, haystack + i, rest);
+    memset(buffer + rest, 0, 16);
+    unsigned mask = candidates16(buffer, m, first, last) & ((1u << (rest - m + 1)) - 1);
+    return verify(buffer, mask, needle, m);
+}
+
+#endif
+
+TARGET_AVX2 inline __m256i fold32(__m256i v)
+{
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+    __m256i upper = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+TARGET_AVX2 inline unsigned candidates32(const char *p, size_t m, __m256i first, __m256i last)
+{
+    __m256i a = fold32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+    __m256i b = fold32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + m - 1)));
+    return unsigned(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+}
+
+TARGET_AVX2 bool avx2Contains(const char *haystack, size_t n, const char *needle, size_t m)
+{
+    if(m == 0)
+        return true;
+    if(n < m)
+        return false;
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+
+    size_t i = 0;
+    for(; i + m - 1 + 32 <= n; i += 32)
+    {
+        if(verify(haystack + i, candidates32(haystack + i, m, first, last), needle, m))
+            return true;
+    }
+
+    size_t rest = n - i;
+    if(rest < m)
+        return false;
+    if(rest + 32 > TailBuffer)
+        return scalarContains(haystack + i, rest, needle, m);
+
+    char buffer[TailBuffer];
+    memcpy(buffer, haystack + i, rest);
+    memset(buffer + rest, 0, 32);
+    // rest - m < 31 here, so the shift below stays in range.
+    unsigned mask = candidates32(buffer, m, first, last) & ((1u << (rest - m + 1)) - 1);
+    return verify(buffer, mask, needle, m);
+}
+
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if(!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+typedef bool (*Kernel)(const char *, size_t, const char *, size_t);
+
+struct Dispatch
+{
+    Kernel kernel;
+
+    const char *name;
+};
+
+Dispatch pick()
+{
+#ifdef TEXTSEARCH_X86
+    if(cpuHasAvx2())
+        return { avx2Contains, "avx2" };
+#endif
+#ifdef TEXTSEARCH_SSE2
+    return { sse2Contains, "sse2" };
+#else
+    return { scalarContains, "scalar" };
+#endif
+}
+
+const Dispatch dispatch = pick();
+
+}
+
+bool containsLowered(const char *haystack, size_t n, const char *needle, size_t m)
+{
+    return dispatch.kernel(haystack, n, needle, m);
+}
+
+const char *textSearchKernel()
+{
+    return dispatch.name;
+}
@@ -0,0 +1,20 @@
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <cstddef>
+
+// Case-insensitive substring search used when filtering tracks without an
+// index. Letters are folded as ASCII; other bytes (including UTF-8
+// sequences) must match exactly. needle must already be lower case, so
+// text with other letters only matches when both went through
+// toLowerUtf8() (Query does this for text that is not ASCII).
+//
+// Candidates are found by comparing the first and last needle byte against
+// a whole vector of haystack positions at once (AVX2 or SSE2, picked at
+// runtime from the CPU), and only those are verified byte by byte.
+bool containsLowered(const char *haystack, size_t n, const char *needle, size_t m);
+
+// Name of the implementation picked for this CPU ("avx2", "sse2", "scalar").
+const char *textSearchKernel();
+
+#endif // TEXTSEARCH_H
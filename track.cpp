@@ -1,25 +1,57 @@
-#include "track.h"
-
-Track::Track()
-{
-
-}
-
-string Track::getName()
-{
-    return name;
-}
-string Track::getLocation()
-{
-    return location;
-}
-
-void Track::setName(string name)
-{
-    this->name = name;
-}
-
-void Track::setLocation(string location)
-{
-    this->location = location;
-}
+#include "track.h"
+
+Track::Track()
+{
+
+}
+
+string Track::getName()
+{
+    return name;
+}
+string Track::getLocation()
+{
+    return location;
+}
+unsigned int Track::getId()
+{
+    return id;
+}
+Track::Status Track::getStatus()
+{
+    return status;
+}
+long long Track::getCheckedSize()
+{
+    return checkedSize;
+}
+long long Track::getCheckedModified()
+{
+    return checkedModified;
+}
+
+void Track::setName(string name)
+{
+    this->name = name;
+}
+
+void Track::setLocation(string location)
+{
+    this->location = location;
+}
+
+void Track::setId(unsigned int id)
+{
+    this->id = id;
+}
+
+void Track::setStatus(Status status)
+{
+    this->status = status;
+}
+
+void Track::setChecked(long long size, long long modified)
+{
+    checkedSize = size;
+    checkedModified = modified;
+}
@@ -1,27 +1,54 @@
-#ifndef TRACK_H
-#define TRACK_H
-
-#include <string>
-
-using namespace std;
-
-class Track
-{
-public:
-    Track();
-
-    string getName();
-
-    string getLocation();
-
-    void setName(string name);
-
-    void setLocation(string location);
-
-private:
-    string name = "";
-
-    string location = "";
-};
-
-#endif // TRACK_H
+#ifndef TRACK_H
+#define TRACK_H
+
+#include <string>
+
+using namespace std;
+
+class Track
+{
+public:
+    // Whether the file was there and looked playable when last checked.
+    enum Status { Unchecked, Available, Missing, Unreadable };
+
+    Track();
+
+    string getName();
+
+    string getLocation();
+
+    unsigned int getId();
+
+    Status getStatus();
+
+    // Size and mtime (ms since epoch) the file had when its status was
+    // last worked out, -1 before.
+    long long getCheckedSize();
+
+    long long getCheckedModified();
+
+    void setName(string name);
+
+    void setLocation(string location);
+
+    void setId(unsigned int id);
+
+    void setStatus(Status status);
+
+    void setChecked(long long size, long long modified);
+
+private:
+    string name = "";
+
+    string location = "";
+
+    unsigned int id = 0;
+
+    Status status = Unchecked;
+
+    long long checkedSize = -1;
+
+    long long checkedModified = -1;
+};
+
+#endif // TRACK_H
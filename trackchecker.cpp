@@ -0,0 +1,179 @@
+#include "trackchecker.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include "tagreader.h"
+
+namespace {
+
+// Files handed to one pool task, and how many changes are collected
+// before publishing.
+const size_t FilesPerTask = 256;
+const size_t ChangesPerBatch = 64;
+
+// Formats whose first bytes readTags() knows; anything else is only
+// checked for being there and readable.
+const char *const knownSuffixes[] = { "mp3", "flac", "ogg", "oga", "opus", "m4a", "m4b", "mp4", "wav" };
+
+// MP3 files without an ID3 tag may start with a little junk before the
+// first frame.
+const qint64 HeadSize = 4096;
+
+bool looksLikeAudioHead(const QByteArray &head)
+{
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(head.constData());
+    size_t size = size_t(head.size());
+    for(size_t i = 0; i + 4 <= size; i++)
+    {
+        if((i == 0 || data[i] == 0xff) && looksLikeAudio(data + i, size - i))
+            return true;
+    }
+    return false;
+}
+
+}
+
+TrackChecker::TrackChecker(QObject *parent)
+    : QObject(parent)
+{
+    // One file at a time is plenty; the point is to never get in the way
+    // of playback or of the tag scanner.
+    pool.setMaxThreadCount(1);
+    pool.setThreadPriority(QThread::LowestPriority);
+}
+
+TrackChecker::~TrackChecker()
+{
+    cancelled = true;
+    pool.waitForDone();
+}
+
+void TrackChecker::check(const vector<Job> &jobs)
+{
+    for(size_t first = 0; first < jobs.size(); first += FilesPerTask)
+    {
+        size_t last = std::min(jobs.size(), first + FilesPerTask);
+        vector<Job> chunk(jobs.begin() + first, jobs.begin() + last);
+
+        pending++;
+        pool.start([this, chunk]() {
+            vector<Result> batch;
+            CueSheet sheet;
+            string sheetPath;
+            for(const Job &job : chunk)
+            {
+                if(cancelled)
+                    break;
+
+                Result result = { job.id, Track::Unchecked, -1, -1 };
+                checkFile(job, result, sheet, sheetPath);
+                if(result.status != job.status || result.size != job.size || result.modified != job.modified)
+                    batch.push_back(result);
+
+                if(batch.size() >= ChangesPerBatch)
+                    publish(batch);
+            }
+            publish(batch);
+
+            if(--pending == 0)
+                emit finished();
+        });
+    }
+}
+
+bool TrackChecker::isRunning() const
+{
+    return pending > 0;
+}
+
+void TrackChecker::checkFile(const Job &job, Result &result, CueSheet &sheet, string &sheetPath)
+{
+    // A track of a cue sheet is there when the sheet and the file it is
+    // cut from are.
+    string location = job.location;
+    string path;
+    int number;
+    if(CueSheet::split(job.location, path, number))
+    {
+        if(!QFileInfo::exists(QString::fromStdString(path)))
+        {
+            result.status = Track::Missing;
+            return;
+        }
+        if(path != sheetPath)
+        {
+            sheetPath = path;
+            if(!sheet.read(path))
+                sheet = CueSheet();
+        }
+
+        const CueSheet::Track *track = sheet.find(number);
+        if(!track)
+        {
+            result.status = Track::Unreadable;
+            return;
+        }
+        location = track->file;
+    }
+
+    QFileInfo info(QString::fromStdString(location));
+    if(!info.exists())
+    {
+        result.status = Track::Missing;
+        return;
+    }
+
+    // A file that is as it was when last checked keeps its status without
+    // being opened, so a pass does not read every file again (or wake
+    // every drive).
+    result.size = info.size();
+    result.modified = info.lastModified().toMSecsSinceEpoch();
+    if(job.status != Track::Unchecked && job.status != Track::Missing && result.size == job.size
+       && result.modified == job.modified)
+    {
+        result.status = job.status;
+        return;
+    }
+
+    QFile file(info.filePath());
+    if(info.size() == 0 || !file.open(QIODevice::ReadOnly))
+    {
+        result.status = Track::Unreadable;
+        return;
+    }
+
+    const char *const *end = knownSuffixes + std::size(knownSuffixes);
+    bool known = std::find_if(knownSuffixes, end, [&info](const char *suffix) {
+        return info.suffix().compare(QLatin1String(suffix), Qt::CaseInsensitive) == 0;
+    }) != end;
+
+    result.status = known && !looksLikeAudioHead(file.read(HeadSize)) ? Track::Unreadable : Track::Available;
+}
+
+void TrackChecker::publish(vector<Result> &batch)
+{
+    if(batch.empty())
+        return;
+
+    bool wasEmpty;
+    {
+        QMutexLocker locker(&mutex);
+        wasEmpty = results.empty();
+        results.insert(results.end(), batch.begin(), batch.end());
+    }
+    batch.clear();
+
+    if(wasEmpty)
+        emit resultsReady();
+}
+
+vector<TrackChecker::Result> TrackChecker::takeResults()
+{
+    QMutexLocker locker(&mutex);
+    vector<Result> taken;
+    taken.swap(results);
+    return taken;
+}
@@ -0,0 +1,85 @@
+#ifndef TRACKCHECKER_H
+#define TRACKCHECKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "cuesheet.h"
+#include "track.h"
+
+using namespace std;
+
+// Checks in the background that the files of the playlist are still there
+// and still look like audio, so that next() can pass over the ones that
+// are not instead of handing them to the player. A pass only stats the
+// files: the head of a file is read only when it was never checked or its
+// size or mtime changed since. Runs on a single low-priority thread; only
+// tracks whose status, size or mtime changed are reported, in batches,
+// with resultsReady() emitted whenever a batch lands in an empty queue and
+// finished() at the end of a pass.
+class TrackChecker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        unsigned int id;
+
+        string location;
+
+        Track::Status status;
+
+        long long size; // as last checked, -1 for never
+
+        long long modified; // ms since epoch, as last checked
+    };
+
+    struct Result
+    {
+        unsigned int id;
+
+        Track::Status status;
+
+        long long size; // -1 when missing
+
+        long long modified;
+    };
+
+    TrackChecker(QObject *parent = nullptr);
+
+    ~TrackChecker();
+
+    void check(const vector<Job> &jobs);
+
+    bool isRunning() const;
+
+    vector<Result> takeResults();
+
+signals:
+    void resultsReady();
+
+    void finished();
+
+private:
+    // Fills in result for job. The tracks of one cue sheet come one after
+    // another, so the sheet last read is kept in sheet.
+    static void checkFile(const Job &job, Result &result, CueSheet &sheet, string &sheetPath);
+
+    void publish(vector<Result> &batch);
+
+    QThreadPool pool;
+
+    QMutex mutex;
+
+    vector<Result> results;
+
+    std::atomic<int> pending{0};
+
+    std::atomic<bool> cancelled{false};
+};
+
+#endif // TRACKCHECKER_H
@@ -0,0 +1,97 @@
+#include "trackcolumns.h"
+
+unsigned int TrackColumns::bit(Text column)
+{
+    return 1u << column;
+}
+
+unsigned int TrackColumns::bit(Number column)
+{
+    return 1u << (TextCount + column);
+}
+
+int TrackColumns::size() const
+{
+    return int(texts[Name].size());
+}
+
+void TrackColumns::append()
+{
+    for(int c = 0; c < TextCount; c++)
+        texts[c].emplace_back();
+
+    for(int c = 0; c < NumberCount; c++)
+        numbers[c].push_back(0);
+}
+
+void TrackColumns::erase(int row)
+{
+    for(int c = 0; c < TextCount; c++)
+        texts[c].erase(texts[c].begin() + row);
+
+    for(int c = 0; c < NumberCount; c++)
+        numbers[c].erase(numbers[c].begin() + row);
+}
+
+namespace {
+
+// Removes the given rows (ascending) in one pass over the vector.
+template<typename T>
+void eraseRows(vector<T> &column, const vector<int> &rows)
+{
+    size_t out = size_t(rows.front());
+    size_t next = 0;
+    for(size_t i = out; i < column.size(); i++)
+    {
+        if(next < rows.size() && int(i) == rows[next])
+        {
+            next++;
+            continue;
+        }
+        column[out++] = std::move(column[i]);
+    }
+    column.resize(out);
+}
+
+}
+
+void TrackColumns::erase(const vector<int> &rows)
+{
+    if(rows.empty())
+        return;
+
+    for(int c = 0; c < TextCount; c++)
+        eraseRows(texts[c], rows);
+
+    for(int c = 0; c < NumberCount; c++)
+        eraseRows(numbers[c], rows);
+}
+
+void TrackColumns::clear()
+{
+    for(int c = 0; c < TextCount; c++)
+        texts[c].clear();
+
+    for(int c = 0; c < NumberCount; c++)
+        numbers[c].clear();
+}
+
+const vector<string> &TrackColumns::text(Text column) const
+{
+    return texts[column];
+}
+
+const vector<int> &TrackColumns::number(Number column) const
+{
+    return numbers[column];
+}
+
+void TrackColumns::setText(Text column, int row, string value)
+{
+    texts[column][row] = std::move(value);
+}
+
+void TrackColumns::setNumber(Number column, int row, int value)
+{
+    numbers[column][row] = value;
+}
@@ -0,0 +1,53 @@
+#ifndef TRACKCOLUMNS_H
+#define TRACKCOLUMNS_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Column-wise copy of the searchable track metadata, one vector per field,
+// kept row-aligned with Playlist::tracks. Scans that only look at one or two
+// fields touch nothing else.
+class TrackColumns
+{
+public:
+    enum Text { Name, Title, Artist, Album, Genre, TextCount };
+
+    // Plays counts starts that were not skipped; SkipRate is a percentage
+    // of starts and LastPlayed is in days since the epoch. Bpm is 0 until
+    // the tempo is known, and stays 0 for tracks without a steady beat.
+    enum Number { Year, Duration, TrackNumber, SampleRate, Bitrate, Plays, Skips, SkipRate, LastPlayed, Bpm,
+                  NumberCount };
+
+    // One-bit masks naming a column, so a change can say which columns it
+    // touched.
+    static unsigned int bit(Text column);
+
+    static unsigned int bit(Number column);
+
+    int size() const;
+
+    void append();
+
+    void erase(int row);
+
+    void erase(const vector<int> &rows);
+
+    void clear();
+
+    const vector<string> &text(Text column) const;
+
+    const vector<int> &number(Number column) const;
+
+    void setText(Text column, int row, string value);
+
+    void setNumber(Number column, int row, int value);
+
+private:
+    vector<string> texts[TextCount];
+
+    vector<int> numbers[NumberCount];
+};
+
+#endif // TRACKCOLUMNS_H
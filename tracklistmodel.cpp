@@ -0,0 +1,399 @@
+#include "tracklistmodel.h"
+#include <QColor>
+#include <algorithm>
+
+TrackListModel::TrackListModel(Playlist *playlist, QObject *parent)
+    : QAbstractListModel(parent)
+    , playlist(playlist)
+{
+    refresh();
+}
+
+int TrackListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(rows.size());
+}
+
+QVariant TrackListModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid())
+        return QVariant();
+
+    int i = trackIndex(index.row());
+    if(i == -1)
+        return QVariant();
+
+    // Tracks the checker could not find or read are greyed out.
+    Track::Status status = playlist->tracks[i].getStatus();
+    bool unplayable = status == Track::Missing || status == Track::Unreadable;
+    if(role == Qt::ForegroundRole)
+        return unplayable ? QVariant(QColor(Qt::gray)) : QVariant();
+    if(role == Qt::ToolTipRole)
+    {
+        if(status == Track::Missing)
+            return QString("File not found");
+        if(status == Track::Unreadable)
+            return QString("File cannot be read");
+        return QVariant();
+    }
+    if(role != Qt::DisplayRole && role != Qt::DecorationRole)
+        return QVariant();
+
+    // Only rows the view paints ask for art, so thumbnails are looked up
+    // lazily as the list scrolls.
+    if(role == Qt::DecorationRole)
+    {
+        if(!covers)
+            return QVariant();
+
+        QImage image = covers->find(playlist->tracks[i].getId(), playlist->tracks[i].getLocation());
+        return image.isNull() ? QVariant() : QVariant(image);
+    }
+
+    return QString::fromStdString(playlist->tracks[i].getName());
+}
+
+void TrackListModel::setCoverArt(CoverArt *covers)
+{
+    this->covers = covers;
+}
+
+void TrackListModel::coversChanged()
+{
+    if(!rows.empty())
+        emit dataChanged(index(0), index(int(rows.size()) - 1), {Qt::DecorationRole});
+}
+
+vector<unsigned int> TrackListModel::select() const
+{
+    if(ordered)
+    {
+        vector<unsigned int> indexes;
+        for(unsigned int id : order)
+        {
+            int i = playlist->indexOf(id);
+            if(i != -1)
+                indexes.push_back(unsigned(i));
+        }
+        if(query.isEmpty())
+            return indexes;
+
+        // The filter wants ascending rows; the matches then keep the named
+        // playlist's order.
+        vector<unsigned int> matching = indexes;
+        std::sort(matching.begin(), matching.end());
+        query.filter(playlist->columns, matching);
+        indexes.erase(std::remove_if(indexes.begin(), indexes.end(), [&matching](unsigned int i) {
+            return !std::binary_search(matching.begin(), matching.end(), i);
+        }), indexes.end());
+        return indexes;
+    }
+
+    if(scope.isEmpty())
+        return query.select(playlist->columns);
+
+    vector<unsigned int> indexes = scope.select(playlist->columns);
+    query.filter(playlist->columns, indexes);
+    return indexes;
+}
+
+void TrackListModel::setRows(const vector<unsigned int> &indexes)
+{
+    rows.resize(indexes.size());
+    for(size_t r = 0; r < indexes.size(); r++)
+        rows[r] = playlist->tracks[indexes[r]].getId();
+
+    positions.clear();
+    indexRows(0);
+}
+
+void TrackListModel::indexRows(size_t from)
+{
+    if(!ordered)
+        return;
+
+    for(size_t r = from; r < rows.size(); r++)
+        positions[rows[r]] = int(r);
+}
+
+void TrackListModel::setFilter(const QString &text)
+{
+    if(text.toStdString() == filterText)
+        return;
+
+    filterText = text.toStdString();
+    Query previous = query;
+    query = Query::parse(filterText);
+
+    beginResetModel();
+
+    // A query that only narrows the previous one can filter the rows we
+    // already have instead of scanning the whole playlist again.
+    if(!ordered && !previous.isEmpty() && query.refines(previous))
+    {
+        vector<unsigned int> indexes(rows.size());
+        for(size_t r = 0; r < rows.size(); r++)
+            indexes[r] = unsigned(playlist->indexOf(rows[r]));
+        query.filter(playlist->columns, indexes);
+        setRows(indexes);
+    }
+    else
+    {
+        setRows(select());
+    }
+
+    endResetModel();
+}
+
+void TrackListModel::setScope(const Query &scope, const vector<unsigned int> &ids)
+{
+    this->scope = scope;
+    ordered = false;
+    order.clear();
+
+    beginResetModel();
+    if(scope.isEmpty())
+    {
+        setRows(query.select(playlist->columns));
+    }
+    else
+    {
+        vector<unsigned int> indexes(ids.size());
+        for(size_t r = 0; r < ids.size(); r++)
+            indexes[r] = unsigned(playlist->indexOf(ids[r]));
+        query.filter(playlist->columns, indexes);
+        setRows(indexes);
+    }
+    endResetModel();
+}
+
+void TrackListModel::setOrder(const vector<unsigned int> *ids)
+{
+    scope = Query();
+    ordered = ids != nullptr;
+    order = ordered ? *ids : vector<unsigned int>();
+
+    beginResetModel();
+    setRows(select());
+    endResetModel();
+}
+
+void TrackListModel::refresh()
+{
+    beginResetModel();
+    setRows(select());
+    endResetModel();
+}
+
+void TrackListModel::tracksAppended(int first)
+{
+    // New tracks are not in a named playlist until added to it.
+    if(ordered)
+        return;
+
+    vector<unsigned int> added;
+    for(int i = first; i < int(playlist->tracks.size()); i++)
+        added.push_back(unsigned(i));
+    scope.filter(playlist->columns, added);
+    query.filter(playlist->columns, added);
+
+    if(added.empty())
+        return;
+
+    beginInsertRows(QModelIndex(), int(rows.size()), int(rows.size() + added.size()) - 1);
+    for(unsigned int i : added)
+        rows.push_back(playlist->tracks[i].getId());
+    endInsertRows();
+}
+
+void TrackListModel::orderAppended(const vector<unsigned int> &ids)
+{
+    if(!ordered)
+        return;
+
+    order.insert(order.end(), ids.begin(), ids.end());
+
+    // Rows go after the last one, in the playlist's order, as far as they
+    // pass the filter.
+    vector<unsigned int> indexes;
+    for(unsigned int id : ids)
+    {
+        int i = playlist->indexOf(id);
+        if(i != -1)
+            indexes.push_back(unsigned(i));
+    }
+    vector<unsigned int> matching = indexes;
+    std::sort(matching.begin(), matching.end());
+    query.filter(playlist->columns, matching);
+
+    vector<unsigned int> added;
+    for(unsigned int i : indexes)
+    {
+        if(std::binary_search(matching.begin(), matching.end(), i))
+            added.push_back(playlist->tracks[i].getId());
+    }
+    if(added.empty())
+        return;
+
+    size_t from = rows.size();
+    beginInsertRows(QModelIndex(), int(from), int(from + added.size()) - 1);
+    rows.insert(rows.end(), added.begin(), added.end());
+    indexRows(from);
+    endInsertRows();
+}
+
+void TrackListModel::trackRemoved(unsigned int id)
+{
+    if(ordered)
+    {
+        order.erase(std::remove(order.begin(), order.end(), id), order.end());
+        auto found = positions.find(id);
+        if(found == positions.end())
+            return;
+
+        int row = found->second;
+        positions.erase(found);
+        beginRemoveRows(QModelIndex(), row, row);
+        rows.erase(rows.begin() + row);
+        indexRows(size_t(row));
+        endRemoveRows();
+        return;
+    }
+
+    // Ids are handed out in playlist order, so the row vector stays sorted.
+    auto it = std::lower_bound(rows.begin(), rows.end(), id);
+    if(it == rows.end() || *it != id)
+        return;
+
+    int row = int(it - rows.begin());
+    beginRemoveRows(QModelIndex(), row, row);
+    rows.erase(it);
+    endRemoveRows();
+}
+
+void TrackListModel::tracksRemoved(vector<unsigned int> ids)
+{
+    // A handful of rows are removed one by one so the view keeps its
+    // selection; for more, resetting is cheaper than a signal per row.
+    if(ids.size() <= 16)
+    {
+        for(unsigned int id : ids)
+            trackRemoved(id);
+        return;
+    }
+
+    std::sort(ids.begin(), ids.end());
+    auto removed = [&ids](unsigned int id) {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    };
+    beginResetModel();
+    rows.erase(std::remove_if(rows.begin(), rows.end(), removed), rows.end());
+    if(ordered)
+    {
+        order.erase(std::remove_if(order.begin(), order.end(), removed), order.end());
+        positions.clear();
+        indexRows(0);
+    }
+    endResetModel();
+}
+
+void TrackListModel::tracksChanged(vector<int> indexes)
+{
+    std::sort(indexes.begin(), indexes.end());
+    vector<unsigned int> matching(indexes.begin(), indexes.end());
+    scope.filter(playlist->columns, matching);
+    query.filter(playlist->columns, matching);
+
+    if(ordered)
+    {
+        orderedTracksChanged(indexes, matching);
+        return;
+    }
+
+    // New metadata can make a track enter or leave the current filter.
+    for(int i : indexes)
+    {
+        unsigned int id = playlist->tracks[i].getId();
+        auto it = std::lower_bound(rows.begin(), rows.end(), id);
+        int row = int(it - rows.begin());
+        bool shown = it != rows.end() && *it == id;
+        bool match = std::binary_search(matching.begin(), matching.end(), unsigned(i));
+
+        if(shown && match)
+        {
+            emit dataChanged(index(row), index(row));
+        }
+        else if(match)
+        {
+            beginInsertRows(QModelIndex(), row, row);
+            rows.insert(it, id);
+            endInsertRows();
+        }
+        else if(shown)
+        {
+            beginRemoveRows(QModelIndex(), row, row);
+            rows.erase(it);
+            endRemoveRows();
+        }
+    }
+}
+
+void TrackListModel::orderedTracksChanged(const vector<int> &indexes, const vector<unsigned int> &matching)
+{
+    // Rows follow the named playlist here, so a track entering or leaving
+    // the filter is placed by building the rows again.
+    vector<unsigned int> sortedOrder;
+    bool rebuild = false;
+    for(int i : indexes)
+    {
+        unsigned int id = playlist->tracks[i].getId();
+        auto found = positions.find(id);
+        bool match = std::binary_search(matching.begin(), matching.end(), unsigned(i));
+        if(found != positions.end())
+        {
+            if(match)
+                emit dataChanged(index(found->second), index(found->second));
+            else
+                rebuild = true;
+        }
+        else if(match)
+        {
+            if(sortedOrder.empty())
+            {
+                sortedOrder = order;
+                std::sort(sortedOrder.begin(), sortedOrder.end());
+            }
+            rebuild = rebuild || std::binary_search(sortedOrder.begin(), sortedOrder.end(), id);
+        }
+    }
+
+    if(rebuild)
+        refresh();
+}
+
+int TrackListModel::trackIndex(int row) const
+{
+    if(row < 0 || row >= int(rows.size()))
+        return -1;
+
+    return playlist->indexOf(rows[row]);
+}
+
+int TrackListModel::rowOf(int trackIndex) const
+{
+    if(trackIndex < 0 || trackIndex >= int(playlist->tracks.size()))
+        return -1;
+
+    unsigned int id = playlist->tracks[trackIndex].getId();
+    if(ordered)
+    {
+        auto found = positions.find(id);
+        return found == positions.end() ? -1 : found->second;
+    }
+
+    auto it = std::lower_bound(rows.begin(), rows.end(), id);
+    if(it == rows.end() || *it != id)
+        return -1;
+
+    return int(it - rows.begin());
+}
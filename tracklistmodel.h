@@ -0,0 +1,89 @@
+#ifndef TRACKLISTMODEL_H
+#define TRACKLISTMODEL_H
+
+#include <QAbstractListModel>
+#include <unordered_map>
+#include <vector>
+#include "coverart.h"
+#include "playlist.h"
+#include "query.h"
+
+// Presents the tracks of a Playlist to a view. Every row maps to a track id
+// through a compact index vector, so filtering never copies track names and
+// a row can always be resolved back to the right file. The filter text is
+// a Query run against Playlist::columns. A scope (a smart playlist's rule)
+// can narrow the rows further, or the rows can follow the order of a named
+// playlist instead of the whole playlist.
+class TrackListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    TrackListModel(Playlist *playlist, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    void setFilter(const QString &text);
+
+    // Shows only the tracks matching scope, starting from ids: the tracks
+    // already known to match it, sorted. An empty scope shows them all.
+    void setScope(const Query &scope, const vector<unsigned int> &ids);
+
+    // Shows the tracks of a named playlist, in its order; nullptr goes
+    // back to the whole playlist.
+    void setOrder(const vector<unsigned int> *ids);
+
+    void setCoverArt(CoverArt *covers);
+
+    void coversChanged();
+
+    void refresh();
+
+    void tracksAppended(int first);
+
+    // Tracks appended to the named playlist being shown.
+    void orderAppended(const vector<unsigned int> &ids);
+
+    void trackRemoved(unsigned int id);
+
+    void tracksRemoved(vector<unsigned int> ids);
+
+    void tracksChanged(vector<int> indexes);
+
+    int trackIndex(int row) const;
+
+    int rowOf(int trackIndex) const;
+
+private:
+    vector<unsigned int> select() const;
+
+    void setRows(const vector<unsigned int> &indexes);
+
+    void indexRows(size_t from);
+
+    void orderedTracksChanged(const vector<int> &indexes, const vector<unsigned int> &matching);
+
+    Playlist *playlist;
+
+    CoverArt *covers = nullptr;
+
+    string filterText = "";
+
+    Query query;
+
+    Query scope;
+
+    std::vector<unsigned int> rows;
+
+    // While following a named playlist, rows are not sorted by id, so
+    // they are found through positions.
+    bool ordered = false;
+
+    vector<unsigned int> order;
+
+    std::unordered_map<unsigned int, int> positions;
+};
+
+#endif // TRACKLISTMODEL_H
@@ -1,31 +1,217 @@
-#ifndef UTILS_H
-#define UTILS_H
-
-#include <string>
-
-using namespace std;
-
-string getNameFromLocation(string str)
-{
-    string ret;
-    int index;
-
-    for(int i = int(str.size()) - 1; i >= 0; i--)
-    {
-        if(str[i] == '/')
-        {
-            index = i + 1;
-            i = -1;
-        }
-    }
-
-    while(index < int(str.size()))
-    {
-        ret.push_back(str[index]);
-        index++;
-    }
-
-    return ret;
-}
-
-#endif // UTILS_H
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <string>
+
+using namespace std;
+
+inline string getNameFromLocation(string str)
+{
+    string ret;
+    int index;
+
+    for(int i = int(str.size()) - 1; i >= 0; i--)
+    {
+        if(str[i] == '/')
+        {
+            index = i + 1;
+            i = -1;
+        }
+    }
+
+    while(index < int(str.size()))
+    {
+        ret.push_back(str[index]);
+        index++;
+    }
+
+    return ret;
+}
+
+inline string getDirectoryFromLocation(const string &str)
+{
+    size_t slash = str.rfind('/');
+    return slash == string::npos ? string() : str.substr(0, slash);
+}
+
+inline char toLowerAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+// Case-insensitive (ASCII) substring test that works in place, without
+// building lowered copies of either string. Other bytes must match exactly,
+// so it only ignores case beyond ASCII when both strings went through
+// toLowerUtf8() already.
+inline bool containsIgnoreCase(const string &haystack, const string &needle)
+{
+    if(needle.empty())
+        return true;
+
+    int n = int(needle.size());
+    int last = int(haystack.size()) - n;
+
+    for(int i = 0; i <= last; i++)
+    {
+        int j = 0;
+        while(j < n && toLowerAscii(haystack[i + j]) == toLowerAscii(needle[j]))
+            j++;
+        if(j == n)
+            return true;
+    }
+
+    return false;
+}
+
+// Lower case of a code point, for the scripts tags are usually written in:
+// Latin (including the extended blocks), Greek, Cyrillic, Armenian,
+// Georgian and fullwidth Latin. Anything else is returned as it is. No
+// other letter is mapped to or from ASCII, so text that is ASCII folds the
+// same way here as with toLowerAscii().
+inline unsigned int toLowerCodePoint(unsigned int c)
+{
+    if(c < 0x80)
+        return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+
+    if((c >= 0xc0 && c <= 0xde && c != 0xd7) || (c >= 0x391 && c <= 0x3ab && c != 0x3a2) ||
+       (c >= 0x410 && c <= 0x42f) || (c >= 0xff21 && c <= 0xff3a))
+        return c + 32;
+    if(c >= 0x400 && c <= 0x40f)
+        return c + 80;
+    if(c >= 0x531 && c <= 0x556)
+        return c + 48;
+    if((c >= 0x10a0 && c <= 0x10c5) || c == 0x10c7 || c == 0x10cd)
+        return c + 0x2d00 - 0x10a0;
+
+    // Blocks where capitals and small letters alternate.
+    if((c >= 0x100 && c <= 0x12f) || (c >= 0x132 && c <= 0x137) || (c >= 0x14a && c <= 0x177) ||
+       (c >= 0x1de && c <= 0x1ef) || (c >= 0x1f8 && c <= 0x21f) || (c >= 0x222 && c <= 0x233) ||
+       (c >= 0x246 && c <= 0x24f) || (c >= 0x3d8 && c <= 0x3ef) || (c >= 0x460 && c <= 0x481) ||
+       (c >= 0x48a && c <= 0x4bf) || (c >= 0x4d0 && c <= 0x52f) || (c >= 0x1e00 && c <= 0x1e95) ||
+       (c >= 0x1ea0 && c <= 0x1eff))
+        return c | 1;
+    if((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17e) || (c >= 0x1cd && c <= 0x1dc) ||
+       (c >= 0x4c1 && c <= 0x4ce))
+        return (c & 1) ? c + 1 : c;
+
+    switch(c)
+    {
+    case 0x178: return 0xff;
+    case 0x386: return 0x3ac;
+    case 0x388: case 0x389: case 0x38a: return c + 37;
+    case 0x38c: return 0x3cc;
+    case 0x38e: case 0x38f: return c + 63;
+    case 0x4c0: return 0x4cf;
+    case 0x1e9e: return 0xdf;
+    }
+    return c;
+}
+
+// Lower-cases UTF-8 text into lower (see toLowerCodePoint()). Bytes that
+// are not part of a valid sequence are copied as they are.
+inline void toLowerUtf8(const string &text, string &lower)
+{
+    lower.clear();
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(text.data());
+    const unsigned char *end = p + text.size();
+    while(p < end)
+    {
+        if(*p < 0x80)
+        {
+            lower.push_back(toLowerAscii(char(*p++)));
+            continue;
+        }
+
+        int extra = (*p >> 5) == 6 ? 1 : (*p >> 4) == 14 ? 2 : (*p >> 3) == 30 ? 3 : -1;
+        bool valid = extra > 0 && end - p > extra;
+        for(int i = 1; valid && i <= extra; i++)
+            valid = (p[i] & 0xc0) == 0x80;
+        if(!valid)
+        {
+            lower.push_back(char(*p++));
+            continue;
+        }
+
+        unsigned int c = *p & (0x3f >> extra);
+        for(int i = 1; i <= extra; i++)
+            c = (c << 6) | (p[i] & 0x3f);
+        if(c < 0x80)
+        {
+            // Overlong; kept as it is so it cannot turn into ASCII.
+            lower.append(reinterpret_cast<const char *>(p), extra + 1);
+            p += extra + 1;
+            continue;
+        }
+        p += extra + 1;
+
+        c = toLowerCodePoint(c);
+        if(c < 0x800)
+        {
+            lower.push_back(char(0xc0 | (c >> 6)));
+        }
+        else if(c < 0x10000)
+        {
+            lower.push_back(char(0xe0 | (c >> 12)));
+            lower.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+        }
+        else
+        {
+            lower.push_back(char(0xf0 | (c >> 18)));
+            lower.push_back(char(0x80 | ((c >> 12) & 0x3f)));
+            lower.push_back(char(0x80 | ((c >> 6) & 0x3f)));
+        }
+        lower.push_back(char(0x80 | (c & 0x3f)));
+    }
+}
+
+inline string toLowerUtf8(const string &text)
+{
+    string lower;
+    lower.reserve(text.size());
+    toLowerUtf8(text, lower);
+    return lower;
+}
+
+// Old playlists and cue sheets are often Latin-1 (or a Windows code page
+// close to it) rather than UTF-8; text that is not valid UTF-8 is taken to
+// be Latin-1.
+inline bool isValidUtf8(const char *text, size_t size)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(text);
+    const unsigned char *end = p + size;
+    while(p < end)
+    {
+        int extra = *p < 0x80 ? 0 : (*p >> 5) == 6 ? 1 : (*p >> 4) == 14 ? 2 : (*p >> 3) == 30 ? 3 : -1;
+        if(extra < 0 || end - p <= extra)
+            return false;
+        for(int i = 1; i <= extra; i++)
+        {
+            if((p[i] & 0xc0) != 0x80)
+                return false;
+        }
+        p += extra + 1;
+    }
+    return true;
+}
+
+inline string latin1ToUtf8(const string &text)
+{
+    string utf8;
+    utf8.reserve(text.size() + text.size() / 4);
+    for(char c : text)
+    {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if(byte < 0x80)
+        {
+            utf8.push_back(c);
+        }
+        else
+        {
+            utf8.push_back(char(0xc0 | (byte >> 6)));
+            utf8.push_back(char(0x80 | (byte & 0x3f)));
+        }
+    }
+    return utf8;
+}
+
+#endif // UTILS_H